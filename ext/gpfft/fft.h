@@ -14,4 +14,12 @@ void dfct(int n, double *a, double *t, int *ip, double *w);
 /* dfst: Sine Transform of RDFT (Real Anti-symmetric DFT) */
 void dfst(int n, double *a, double *t, int *ip, double *w);
 
+/* Single precision variants of the above */
+void cdftf(int n, int isgn, float *a, int *ip, float *w);
+void rdftf(int n, int isgn, float *a, int *ip, float *w);
+void ddctf(int n, int isgn, float *a, int *ip, float *w);
+void ddstf(int n, int isgn, float *a, int *ip, float *w);
+void dfctf(int n, float *a, float *t, int *ip, float *w);
+void dfstf(int n, float *a, float *t, int *ip, float *w);
+
 #endif /* __FFT_H__ */
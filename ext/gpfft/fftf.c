@@ -0,0 +1,20 @@
+/* Single precision variants of the Ooura FFT routines.
+ *
+ * This compiles fft.c a second time with all double precision
+ * data replaced by floats and the public functions renamed
+ * to their 'f' suffixed names.
+ */
+
+#include <math.h>
+#include "fft.h"
+
+#define double float
+
+#define cdft cdftf
+#define rdft rdftf
+#define ddct ddctf
+#define ddst ddstf
+#define dfct dfctf
+#define dfst dfstf
+
+#include "fft.c"
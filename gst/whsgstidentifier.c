@@ -42,9 +42,22 @@ enum
   PROP_0,
   PROP_FRAME_SIZE,
   PROP_DISTANCE,
-  PROP_PATTERN
+  PROP_PATTERN,
+  PROP_BUNDLE
 };
 
+/* Bundles are shared by all identifiers, so a bundle is only mapped
+ * and checked once no matter how many patterns are used from it */
+typedef struct
+{
+  gchar *filename;
+  WhsPatternBundle *bundle;
+  guint users;
+} WhsGstBundle;
+
+G_LOCK_DEFINE_STATIC (bundles);
+static GHashTable *bundles = NULL;
+
 GST_BOILERPLATE (WhsGstIdentifier, whs_gst_identifier, GstAudioFilter,
     GST_TYPE_AUDIO_FILTER);
 
@@ -54,6 +67,7 @@ static void whs_gst_identifier_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
 static void whs_gst_identifier_finalize (GObject * obj);
 
+static gboolean whs_gst_identifier_start (GstBaseTransform * trans);
 static gboolean whs_gst_identifier_stop (GstBaseTransform * trans);
 static gboolean whs_gst_identifier_event (GstBaseTransform * trans, GstEvent *event);
 static GstFlowReturn whs_gst_identifier_transform_ip (GstBaseTransform * trans,
@@ -100,11 +114,17 @@ whs_gst_identifier_class_init (WhsGstIdentifierClass * klass)
 
   g_object_class_install_property (gobject_class, PROP_PATTERN,
       g_param_spec_string ("pattern", "Pattern",
-          "Pattern filename",
+          "Pattern filename, or the name of the pattern in the bundle",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BUNDLE,
+      g_param_spec_string ("bundle", "Bundle",
+          "Pattern bundle filename",
           NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   GST_DEBUG_CATEGORY_INIT (whs_gst_identifier_debug, "whs_gst_identifier", 0, "Whistler identifier");
 
+  trans_class->start = GST_DEBUG_FUNCPTR (whs_gst_identifier_start);
   trans_class->stop = GST_DEBUG_FUNCPTR (whs_gst_identifier_stop);
   trans_class->event = GST_DEBUG_FUNCPTR (whs_gst_identifier_event);
   trans_class->transform_ip = GST_DEBUG_FUNCPTR (whs_gst_identifier_transform_ip);
@@ -116,21 +136,93 @@ whs_gst_identifier_class_init (WhsGstIdentifierClass * klass)
 static void
 whs_gst_identifier_reset (WhsGstIdentifier *identifier)
 {
-  gst_adapter_clear (identifier->adapter);
-
   if (identifier->identifier) {
     whs_object_unref (identifier->identifier);
     identifier->identifier = NULL;
   }
 }
 
+static WhsPatternBundle *
+whs_gst_bundle_acquire (const gchar *filename)
+{
+  WhsGstBundle *shared;
+  WhsPatternBundle *bundle = NULL;
+
+  G_LOCK (bundles);
+
+  if (!bundles)
+    bundles = g_hash_table_new (g_str_hash, g_str_equal);
+
+  shared = g_hash_table_lookup (bundles, filename);
+  if (!shared) {
+    bundle = whs_pattern_bundle_load (filename);
+    if (bundle) {
+      shared = g_slice_new (WhsGstBundle);
+      shared->filename = g_strdup (filename);
+      shared->bundle = bundle;
+      shared->users = 0;
+      g_hash_table_insert (bundles, shared->filename, shared);
+    }
+  }
+
+  if (shared) {
+    shared->users++;
+    bundle = WHS_PATTERN_BUNDLE (whs_object_ref (shared->bundle));
+  }
+
+  G_UNLOCK (bundles);
+
+  return bundle;
+}
+
+static gboolean
+whs_gst_bundle_match (gpointer key, gpointer value, gpointer user_data)
+{
+  return ((WhsGstBundle *) value)->bundle == user_data;
+}
+
+static void
+whs_gst_bundle_release (WhsPatternBundle *bundle)
+{
+  WhsGstBundle *shared;
+
+  G_LOCK (bundles);
+
+  shared = g_hash_table_find (bundles, whs_gst_bundle_match, bundle);
+  if (shared && --shared->users == 0) {
+    g_hash_table_remove (bundles, shared->filename);
+    whs_object_unref (shared->bundle);
+    g_free (shared->filename);
+    g_slice_free (WhsGstBundle, shared);
+  }
+
+  G_UNLOCK (bundles);
+
+  whs_object_unref (bundle);
+}
+
+static void
+whs_gst_identifier_release (WhsGstIdentifier *identifier)
+{
+  whs_gst_identifier_reset (identifier);
+
+  if (identifier->loaded_pattern) {
+    whs_object_unref (identifier->loaded_pattern);
+    identifier->loaded_pattern = NULL;
+  }
+
+  if (identifier->loaded_bundle) {
+    whs_gst_bundle_release (identifier->loaded_bundle);
+    identifier->loaded_bundle = NULL;
+  }
+}
+
 static void
 whs_gst_identifier_init (WhsGstIdentifier *identifier, WhsGstIdentifierClass * g_class)
 {
-  identifier->adapter = gst_adapter_new ();
   identifier->frame_size = 512;
   identifier->distance = 10;
-  identifier->current_timestamp = 0;
+  identifier->segment_start = 0;
 }
 
 static void
@@ -138,19 +230,14 @@ whs_gst_identifier_finalize (GObject * obj)
 {
   WhsGstIdentifier *identifier = WHS_GST_IDENTIFIER (obj);
 
-  if (identifier->adapter) {
-    g_object_unref (G_OBJECT (identifier->adapter));
-    identifier->adapter = NULL;
-  }
-
-  if (identifier->identifier) {
-    whs_object_unref (identifier->identifier);
-    identifier->identifier = NULL;
-  }
+  whs_gst_identifier_release (identifier);
 
   g_free (identifier->pattern);
   identifier->pattern = NULL;
 
+  g_free (identifier->bundle);
+  identifier->bundle = NULL;
+
   G_OBJECT_CLASS (parent_class)->finalize (obj);
 }
 
@@ -170,8 +257,13 @@ whs_gst_identifier_set_property (GObject * object, guint prop_id,
       whs_gst_identifier_reset (identifier);
       break;
     case PROP_PATTERN:
+      g_free (identifier->pattern);
       identifier->pattern = g_value_dup_string (value);
       break;
+    case PROP_BUNDLE:
+      g_free (identifier->bundle);
+      identifier->bundle = g_value_dup_string (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -194,6 +286,9 @@ whs_gst_identifier_get_property (GObject * object, guint prop_id,
     case PROP_PATTERN:
       g_value_set_string (value, identifier->pattern);
       break;
+    case PROP_BUNDLE:
+      g_value_set_string (value, identifier->bundle);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -210,12 +305,48 @@ whs_gst_identifier_setup (GstAudioFilter * filter, GstRingBufferSpec * format)
   return TRUE;
 }
 
+/* Patterns are loaded before the first buffer arrives */
+static gboolean
+whs_gst_identifier_start (GstBaseTransform * trans)
+{
+  WhsGstIdentifier *identifier = WHS_GST_IDENTIFIER (trans);
+
+  whs_gst_identifier_release (identifier);
+
+  if (!identifier->pattern) {
+    GST_ELEMENT_ERROR (identifier, RESOURCE, NOT_FOUND, (NULL), ("No pattern set"));
+    return FALSE;
+  }
+
+  if (identifier->bundle) {
+    identifier->loaded_bundle = whs_gst_bundle_acquire (identifier->bundle);
+    if (!identifier->loaded_bundle) {
+      GST_ELEMENT_ERROR (identifier, RESOURCE, OPEN_READ, (NULL),
+          ("Can't load pattern bundle %s", identifier->bundle));
+      return FALSE;
+    }
+
+    identifier->loaded_pattern = whs_pattern_bundle_get_pattern (identifier->loaded_bundle, identifier->pattern);
+  } else {
+    identifier->loaded_pattern = whs_pattern_load (identifier->pattern);
+  }
+
+  if (!identifier->loaded_pattern) {
+    GST_ELEMENT_ERROR (identifier, RESOURCE, OPEN_READ, (NULL),
+        ("Can't load pattern %s", identifier->pattern));
+    whs_gst_identifier_release (identifier);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 static gboolean
 whs_gst_identifier_stop (GstBaseTransform * trans)
 {
   WhsGstIdentifier *identifier = WHS_GST_IDENTIFIER (trans);
 
-  whs_gst_identifier_reset (identifier);
+  whs_gst_identifier_release (identifier);
 
   return TRUE;
 }
@@ -246,7 +377,7 @@ whs_gst_identifier_event (GstBaseTransform * trans, GstEvent *event)
 	event = gst_event_new_new_segment (FALSE, rate, GST_FORMAT_TIME, 0, -1, 0);
       }
 
-      identifier->current_timestamp = start;
+      identifier->segment_start = start;
       break;
     }
     default:
@@ -257,7 +388,7 @@ whs_gst_identifier_event (GstBaseTransform * trans, GstEvent *event)
 }
 
 static GstMessage *
-whs_gst_identifier_message_new (WhsGstIdentifier * identifier, WhsResult *res, GstClockTime timestamp)
+whs_gst_identifier_message_new (WhsGstIdentifier * identifier, const WhsResult *res, GstClockTime timestamp)
 {
   GstStructure *s;
   GValue v = { 0, };
@@ -275,42 +406,60 @@ whs_gst_identifier_message_new (WhsGstIdentifier * identifier, WhsResult *res, G
   gst_structure_set_value (s, "result", &v);
   g_value_unset (&v);
 
+  // Multi-class patterns also give the score of every class
+  if (res->n_classes > 0) {
+    GValue score = { 0, };
+    guint c;
+
+    g_value_init (&v, GST_TYPE_ARRAY);
+    g_value_init (&score, G_TYPE_FLOAT);
+    for (c = 0; c < res->n_classes; c++) {
+      g_value_set_float (&score, res->scores[c]);
+      gst_value_array_append_value (&v, &score);
+    }
+    g_value_unset (&score);
+    gst_structure_set_value (s, "scores", &v);
+    g_value_unset (&v);
+  }
+
   return gst_message_new_element (GST_OBJECT (identifier), s);
 }
 
+static void
+whs_gst_identifier_post_result (WhsIdentifier *self, const WhsResult *res,
+    guint64 offset, gpointer user_data)
+{
+  WhsGstIdentifier *identifier = WHS_GST_IDENTIFIER (user_data);
+  gint rate = GST_AUDIO_FILTER (identifier)->format.rate;
+  GstClockTime timestamp;
+  GstMessage *m;
+
+  timestamp = identifier->segment_start + gst_util_uint64_scale_int (offset, GST_SECOND, rate);
+  m = whs_gst_identifier_message_new (identifier, res, timestamp);
+  gst_element_post_message (GST_ELEMENT (identifier), m);
+}
+
 static GstFlowReturn
 whs_gst_identifier_transform_ip (GstBaseTransform * trans, GstBuffer * buffer)
 {
   WhsGstIdentifier *identifier = WHS_GST_IDENTIFIER (trans);
-  gint wanted = 2 * 4 * identifier->frame_size;
   gint rate = GST_AUDIO_FILTER (identifier)->format.rate;
 
   if (!identifier->identifier) {
-    WhsPattern *pattern;
-
-    pattern = whs_pattern_load (identifier->pattern);
-    identifier->identifier = whs_identifier_new (rate, identifier->frame_size, 2, identifier->distance, pattern);
-    whs_object_unref (pattern);
- }
-
- gst_adapter_push (identifier->adapter, gst_buffer_copy (buffer));
-
-  while (gst_adapter_available (identifier->adapter) >= wanted) {
-    gfloat *in = (gfloat *) gst_adapter_peek (identifier->adapter, wanted);
-    GstMessage *m;
-    WhsResult *res;
-
-    res = whs_identifier_process (identifier->identifier, in,
-        WHS_IDENTIFIER_MODE_CLASSIFY | WHS_IDENTIFIER_MODE_LOCALIZE);
-   
-    m = whs_gst_identifier_message_new (identifier, res, identifier->current_timestamp);
-    gst_element_post_message (GST_ELEMENT (identifier), m);
-    g_free (res);
-    
-    gst_adapter_flush (identifier->adapter, wanted);
-    identifier->current_timestamp += gst_util_uint64_scale_int (identifier->frame_size, GST_SECOND, rate);
+    identifier->identifier = whs_identifier_new (rate, identifier->frame_size, 2, identifier->distance,
+        identifier->loaded_pattern);
+    if (!identifier->identifier) {
+      GST_ELEMENT_ERROR (identifier, STREAM, FAILED, (NULL),
+          ("Can't use pattern %s", identifier->pattern));
+      return GST_FLOW_ERROR;
+    }
   }
 
+  // The identifier keeps incomplete frames itself
+  whs_identifier_push (identifier->identifier, (const gfloat *) GST_BUFFER_DATA (buffer),
+      GST_BUFFER_SIZE (buffer) / (2 * 4),
+      WHS_IDENTIFIER_MODE_CLASSIFY | WHS_IDENTIFIER_MODE_LOCALIZE,
+      whs_gst_identifier_post_result, identifier);
+
   return GST_FLOW_OK;
 }
-
@@ -21,12 +21,12 @@
 
 
 #include <gst/gst.h>
-#include <gst/base/gstadapter.h>
 #include <gst/base/gstbasetransform.h>
 #include <gst/audio/gstaudiofilter.h>
 
 #include <whs/whs.h>
 #include <whs/whsidentifier.h>
+#include <whs/whspatternbundle.h>
 
 G_BEGIN_DECLS
 
@@ -55,14 +55,15 @@ typedef struct _WhsGstIdentifierClass WhsGstIdentifierClass;
 struct _WhsGstIdentifier {
   GstAudioFilter element;
 
-  GstAdapter *adapter;
-
   guint frame_size;
   guint distance;
   gchar *pattern;
+  gchar *bundle;
 
+  WhsPatternBundle *loaded_bundle;
+  WhsPattern *loaded_pattern;
   WhsIdentifier *identifier;
-  GstClockTime current_timestamp;
+  GstClockTime segment_start;
 };
 
 struct _WhsGstIdentifierClass {
@@ -0,0 +1,103 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <string.h>
+#include <whs/whs.h>
+#include <whs/whspattern.h>
+#include <whs/whspatternbundle.h>
+
+static int
+list (const gchar *filename)
+{
+  WhsPatternBundle *bundle = whs_pattern_bundle_load (filename);
+  if (!bundle) {
+    g_warning ("Could not load bundle");
+    return -2;
+  }
+
+  for (guint i = 0; i < whs_pattern_bundle_get_n_patterns (bundle); i++) {
+    const gchar *name = whs_pattern_bundle_get_name (bundle, i);
+    WhsPattern *pattern = whs_pattern_bundle_get_pattern (bundle, name);
+
+    g_print ("%-20s %s\n", name, (pattern) ? whs_pattern_get_classifier_name (pattern) : "(invalid)");
+    if (pattern)
+      whs_object_unref (pattern);
+  }
+
+  whs_object_unref (bundle);
+
+  return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  if (argc < 2) {
+    g_print ("usage: bundle OUT-BUNDLE NAME=PATTERN...\n");
+    g_print ("       bundle BUNDLE\n");
+    return -1;
+  }
+
+  whs_init ();
+
+  if (argc == 2)
+    return list (argv[1]);
+
+  WhsPatternBundle *bundle = whs_pattern_bundle_new ();
+
+  for (gint i = 2; i < argc; i++) {
+    gchar *name = g_strdup (argv[i]);
+    gchar *filename = strchr (name, '=');
+
+    if (!filename || filename == name || filename[1] == '\0') {
+      g_warning ("Invalid pattern %s, expected NAME=PATTERN", argv[i]);
+      g_free (name);
+      whs_object_unref (bundle);
+      return -1;
+    }
+    *filename++ = '\0';
+
+    WhsPattern *pattern = whs_pattern_load (filename);
+    if (!pattern || !whs_pattern_bundle_add (bundle, name, pattern)) {
+      g_warning ("Could not add pattern %s", filename);
+      if (pattern)
+        whs_object_unref (pattern);
+      g_free (name);
+      whs_object_unref (bundle);
+      return -2;
+    }
+
+    whs_object_unref (pattern);
+    g_free (name);
+  }
+
+  if (!whs_pattern_bundle_save (bundle, argv[1])) {
+    g_warning ("Could not save bundle");
+    whs_object_unref (bundle);
+    return -3;
+  }
+
+  whs_object_unref (bundle);
+
+  return 0;
+}
@@ -21,17 +21,50 @@
 #endif
 
 #include <glib.h>
+#include <string.h>
 #include <whs/whs.h>
 #include <whs/whslearner.h>
 #include <whs/whspattern.h>
 
 #define CLASSIFIER "WhsNNClassifier_32_32_32_1"
 
+static gchar *optimizer = NULL;
+static gdouble learn_rate = 0.0;
+static gint max_epochs = 0;
+static gdouble max_time = 0.0;
+static gdouble validation = 0.0;
+static gint patience = 0;
+static gdouble sample = 0.0;
+
+static GOptionEntry entries[] = {
+  { "optimizer", 'o', 0, G_OPTION_ARG_STRING, &optimizer, "Optimizer, momentum (default), rprop or adam", "NAME" },
+  { "learn-rate", 'l', 0, G_OPTION_ARG_DOUBLE, &learn_rate, "Learn rate or initial step size of the optimizer", "N" },
+  { "max-epochs", 'e', 0, G_OPTION_ARG_INT, &max_epochs, "Stop after N runs over all values", "N" },
+  { "max-time", 't', 0, G_OPTION_ARG_DOUBLE, &max_time, "Stop after SECONDS of training", "SECONDS" },
+  { "validation", 'v', 0, G_OPTION_ARG_DOUBLE, &validation, "Fraction of the values held out for validation", "FRACTION" },
+  { "patience", 'p', 0, G_OPTION_ARG_INT, &patience, "Stop after N runs without improvement", "N" },
+  { "sample", 's', 0, G_OPTION_ARG_DOUBLE, &sample, "Fraction of the values used in each run", "FRACTION" },
+  { NULL }
+};
+
 int
 main(int argc, char **argv)
 {
+  GOptionContext *context = g_option_context_new ("[CLASSIFIER] RATE IN-FILE OUT-FILE");
+  GError *error = NULL;
+  WhsTrainOptions options;
+
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_print ("%s\n", error->message);
+    g_error_free (error);
+    g_option_context_free (context);
+    return -1;
+  }
+  g_option_context_free (context);
+
   if (argc != 4 && argc != 5) {
-    g_print ("usage: learn [CLASSIFIER] RATE IN-FILE OUT-FILE\n");
+    g_print ("usage: learn [OPTION...] [CLASSIFIER] RATE IN-FILE OUT-FILE\n");
     return -1;
   }
 
@@ -56,7 +89,8 @@ main(int argc, char **argv)
     classifier = CLASSIFIER;
   }
 
-  WhsLearner *learner = whs_learner_new_from_state (classifier, 0, 512, in_file, load_pattern);
+  // The state is only read, so it doesn't have to fit into memory
+  WhsLearner *learner = whs_learner_map_state (classifier, 0, 512, in_file, load_pattern);
 
   if (load_pattern)
     whs_object_unref (load_pattern);
@@ -74,7 +108,35 @@ main(int argc, char **argv)
     return -4;
   }
 
-  WhsPattern *pattern = whs_learner_generate_pattern (learner, rate);
+  whs_train_options_init (&options, rate);
+
+  if (optimizer == NULL || strcmp (optimizer, "momentum") == 0) {
+    options.optimizer = WHS_OPTIMIZER_MOMENTUM;
+  } else if (strcmp (optimizer, "rprop") == 0) {
+    options.optimizer = WHS_OPTIMIZER_RPROP;
+  } else if (strcmp (optimizer, "adam") == 0) {
+    options.optimizer = WHS_OPTIMIZER_ADAM;
+  } else {
+    g_warning ("Unknown optimizer %s", optimizer);
+    whs_object_unref (learner);
+    return -4;
+  }
+
+  if (learn_rate < 0.0 || max_epochs < 0 || max_time < 0.0 || patience < 0 ||
+      validation < 0.0 || validation >= 1.0 || sample < 0.0 || sample > 1.0) {
+    g_warning ("Wrong training options");
+    whs_object_unref (learner);
+    return -4;
+  }
+
+  options.learn_rate = learn_rate;
+  options.max_epochs = max_epochs;
+  options.max_time = max_time;
+  options.validation = validation;
+  options.patience = patience;
+  options.sample = sample;
+
+  WhsPattern *pattern = whs_learner_generate_pattern_full (learner, &options);
 
   if (!pattern) {
     g_warning ("Could not generate pattern");
@@ -82,7 +144,13 @@ main(int argc, char **argv)
     return -3;
   }
 
-  whs_pattern_save (pattern, out_file);
+  if (!whs_pattern_save (pattern, out_file)) {
+    g_warning ("Could not save pattern");
+    whs_object_unref (pattern);
+    whs_object_unref (learner);
+    return -5;
+  }
+
   whs_object_unref (pattern);
   whs_object_unref (learner);
 
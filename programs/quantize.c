@@ -0,0 +1,89 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <whs/whs.h>
+#include <whs/whslearner.h>
+#include <whs/whspattern.h>
+
+int
+main(int argc, char **argv)
+{
+  if (argc != 4) {
+    g_print ("usage: quantize IN-PATTERN LEARNER-STATE OUT-PATTERN\n");
+    return -1;
+  }
+
+  whs_init ();
+
+  const gchar *in_file = argv[1], *state_file = argv[2], *out_file = argv[3];
+
+  WhsPattern *pattern = whs_pattern_load (in_file);
+  if (!pattern) {
+    g_warning ("Could not load pattern");
+    return -2;
+  }
+
+  WhsLearner *learner = whs_learner_map_state (NULL, 0, 512, state_file, pattern);
+  if (!learner) {
+    g_warning ("Could not create learner");
+    whs_object_unref (pattern);
+    return -3;
+  }
+
+  WhsPattern *quantized = whs_pattern_quantize (pattern);
+  if (!quantized) {
+    g_warning ("Could not quantize pattern");
+    whs_object_unref (learner);
+    whs_object_unref (pattern);
+    return -4;
+  }
+
+  gdouble rate, mse, q_rate, q_mse;
+
+  if (!whs_learner_evaluate (learner, pattern, &rate, &mse) ||
+      !whs_learner_evaluate (learner, quantized, &q_rate, &q_mse)) {
+    g_warning ("Could not evaluate patterns");
+    whs_object_unref (quantized);
+    whs_object_unref (learner);
+    whs_object_unref (pattern);
+    return -5;
+  }
+
+  g_print ("%-20s rate: %f, mse: %lf\n", whs_pattern_get_classifier_name (pattern), rate, mse);
+  g_print ("%-20s rate: %f, mse: %lf\n", whs_pattern_get_classifier_name (quantized), q_rate, q_mse);
+  g_print ("%-20s rate: %+f, mse: %+lf\n", "delta", q_rate - rate, q_mse - mse);
+
+  if (!whs_pattern_save (quantized, out_file)) {
+    g_warning ("Could not save pattern");
+    whs_object_unref (quantized);
+    whs_object_unref (learner);
+    whs_object_unref (pattern);
+    return -6;
+  }
+
+  whs_object_unref (quantized);
+  whs_object_unref (learner);
+  whs_object_unref (pattern);
+
+  return 0;
+}
@@ -0,0 +1,176 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <whs/whs.h>
+#include <whs/whslearner.h>
+#include <whs/whspattern.h>
+
+static gchar *encoding = NULL;
+static gdouble train_rate = 0.0;
+
+static GOptionEntry entries[] = {
+  { "encoding", 'e', 0, G_OPTION_ARG_STRING, &encoding, "Encoding of the vectors, plain (default), half or q8", "NAME" },
+  { "train", 't', 0, G_OPTION_ARG_DOUBLE, &train_rate, "Also train on both states with this rate and compare on IN-STATE", "RATE" },
+  { NULL }
+};
+
+static gint64
+file_size (const gchar *filename)
+{
+  struct stat st;
+
+  return (g_stat (filename, &st) == 0) ? (gint64) st.st_size : -1;
+}
+
+/* Rewrites a learner state with another encoding of the vectors. Given
+ * a pattern, it is evaluated on the original and the encoded vectors
+ * like by whs-quantize. That only shows how much the encoding distorts
+ * the input of an already trained pattern. With --train, a pattern is
+ * also trained on each state, both are evaluated on the original
+ * vectors, which shows what training on the encoded vectors costs */
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context = g_option_context_new ("IN-STATE OUT-STATE [PATTERN]");
+  GError *error = NULL;
+  WhsStateEncoding state_encoding;
+
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_print ("%s\n", error->message);
+    g_error_free (error);
+    g_option_context_free (context);
+    return -1;
+  }
+  g_option_context_free (context);
+
+  if (argc != 3 && argc != 4) {
+    g_print ("usage: state [OPTION...] IN-STATE OUT-STATE [PATTERN]\n");
+    return -1;
+  }
+
+  if (train_rate < 0.0 || train_rate > 1.0) {
+    g_warning ("Wrong rate");
+    return -1;
+  }
+
+  if (encoding == NULL || strcmp (encoding, "plain") == 0) {
+    state_encoding = WHS_STATE_ENCODING_PLAIN;
+  } else if (strcmp (encoding, "half") == 0) {
+    state_encoding = WHS_STATE_ENCODING_HALF;
+  } else if (strcmp (encoding, "q8") == 0) {
+    state_encoding = WHS_STATE_ENCODING_Q8;
+  } else {
+    g_warning ("Unknown encoding %s", encoding);
+    return -1;
+  }
+
+  whs_init ();
+
+  const gchar *in_file = argv[1], *out_file = argv[2];
+  WhsPattern *pattern = NULL;
+
+  if (argc == 4 && !(pattern = whs_pattern_load (argv[3]))) {
+    g_warning ("Could not load pattern");
+    return -2;
+  }
+
+  WhsLearner *learner = whs_learner_map_state (NULL, 0, 512, in_file, pattern);
+  if (!learner) {
+    g_warning ("Could not create learner");
+    if (pattern)
+      whs_object_unref (pattern);
+    return -3;
+  }
+
+  // OUT-STATE may be IN-STATE, the mapped vectors stay valid while it is replaced
+  gint64 in_size = file_size (in_file);
+
+  if (!whs_learner_save_state_full (learner, out_file, state_encoding)) {
+    g_warning ("Could not save learner state");
+    whs_object_unref (learner);
+    if (pattern)
+      whs_object_unref (pattern);
+    return -4;
+  }
+
+  g_print ("%-20s %" G_GINT64_FORMAT " bytes\n", in_file, in_size);
+  g_print ("%-20s %" G_GINT64_FORMAT " bytes\n", out_file, file_size (out_file));
+
+  if (!pattern) {
+    whs_object_unref (learner);
+    return 0;
+  }
+
+  WhsLearner *encoded = whs_learner_new_from_state (NULL, 0, 512, out_file, pattern);
+  gdouble rate, mse, e_rate, e_mse;
+
+  if (!encoded || !whs_learner_evaluate (learner, pattern, &rate, &mse) ||
+      !whs_learner_evaluate (encoded, pattern, &e_rate, &e_mse)) {
+    g_warning ("Could not evaluate pattern");
+    if (encoded)
+      whs_object_unref (encoded);
+    whs_object_unref (learner);
+    whs_object_unref (pattern);
+    return -5;
+  }
+
+  g_print ("%-20s rate: %f, mse: %lf\n", in_file, rate, mse);
+  g_print ("%-20s rate: %f, mse: %lf\n", out_file, e_rate, e_mse);
+  g_print ("%-20s rate: %+f, mse: %+lf\n", "delta", e_rate - rate, e_mse - mse);
+
+  if (train_rate > 0.0) {
+    WhsPattern *trained = whs_learner_generate_pattern (learner, train_rate);
+    WhsPattern *e_trained = whs_learner_generate_pattern (encoded, train_rate);
+
+    if (!trained || !e_trained || !whs_learner_evaluate (learner, trained, &rate, &mse) ||
+        !whs_learner_evaluate (learner, e_trained, &e_rate, &e_mse)) {
+      g_warning ("Could not train patterns");
+      if (trained)
+        whs_object_unref (trained);
+      if (e_trained)
+        whs_object_unref (e_trained);
+      whs_object_unref (encoded);
+      whs_object_unref (learner);
+      whs_object_unref (pattern);
+      return -6;
+    }
+
+    g_print ("trained on each state, evaluated on %s\n", in_file);
+    g_print ("%-20s rate: %f, mse: %lf\n", in_file, rate, mse);
+    g_print ("%-20s rate: %f, mse: %lf\n", out_file, e_rate, e_mse);
+    g_print ("%-20s rate: %+f, mse: %+lf\n", "delta", e_rate - rate, e_mse - mse);
+
+    whs_object_unref (e_trained);
+    whs_object_unref (trained);
+  }
+
+  whs_object_unref (encoded);
+  whs_object_unref (learner);
+  whs_object_unref (pattern);
+
+  return 0;
+}
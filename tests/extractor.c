@@ -0,0 +1,156 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ *
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks the MFCCs of every kernel implementation that runs on this CPU
+ * against the double precision reference implementation of the extractor,
+ * for several frame lengths, sample rates and frequency bands. The DCT is
+ * undone and the log magnitudes of the mel bins are compared */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <glib-object.h>
+#include <math.h>
+
+#include "whsextractor.h"
+#include "fft.h"
+
+#define N_FRAMES (200)
+
+/* The rounding errors of the single precision FFT are relative to the
+ * loudest part of the spectrum, so only mel bins down to 30 dB below the
+ * loudest one are compared */
+#define DYNAMIC_RANGE (1.5)
+
+/* Of the log10 magnitudes, relative for magnitudes below -1 */
+#define MAX_ERROR (1e-5)
+
+static const struct {
+  guint sample_rate, frame_length, min_freq, max_freq;
+} configs[] = {
+  { 44100, 512, 0, 0 },
+  { 44100, 512, 1000, 4000 },
+  { 48000, 1024, 0, 0 },
+  { 16000, 256, 300, 3400 },
+  { 8000, 2048, 0, 0 },
+};
+
+/* Sines, noise and now and then silence and clipping */
+static void
+generate_frame (gfloat *frame, guint frame_length, guint sample_rate, guint n, GRand *rand)
+{
+  gdouble f1 = g_rand_double_range (rand, 50.0, sample_rate / 2.0);
+  gdouble f2 = g_rand_double_range (rand, 50.0, sample_rate / 2.0);
+  gdouble gain = pow (10.0, -g_rand_double_range (rand, 0.0, 6.0));
+
+  for (guint i = 0; i < frame_length; i++) {
+    gdouble t = (gdouble) i / sample_rate;
+    gdouble x = 0.5 * sin (2.0 * M_PI * f1 * t) + 0.3 * sin (2.0 * M_PI * f2 * t) +
+        0.2 * g_rand_double_range (rand, -1.0, 1.0);
+
+    if (n % 17 == 0)
+      x = 0.0;
+    else if (n % 13 == 0)
+      x = CLAMP (4.0 * x, -1.0, 1.0);
+    else
+      x *= gain;
+
+    frame[i] = x;
+  }
+}
+
+/* Inverts the DCT of the extractor, which gives the log magnitudes of
+ * the mel bins */
+static void
+mel_bins (const WhsFeatureVector *vec, gdouble *mel, gint *ip, gdouble *w)
+{
+  for (guint i = 0; i < 32; i++)
+    mel[i] = vec->mfcc[i];
+
+  mel[0] *= 0.5;
+  ddct (32, 1, mel, ip, w);
+
+  for (guint i = 0; i < 32; i++)
+    mel[i] *= 2.0 / 32;
+}
+
+int
+main (int argc, char **argv)
+{
+  const WhsDspFunctions * const *dsps;
+  gboolean ret = TRUE;
+  gint ip[8] = { 0, };
+  gdouble w[41];
+
+  g_type_init ();
+
+  dsps = whs_dsp_get_implementations ();
+
+  for (guint c = 0; c < G_N_ELEMENTS (configs); c++) {
+    guint sample_rate = configs[c].sample_rate, frame_length = configs[c].frame_length;
+    WhsExtractor *reference = whs_extractor_new_full (sample_rate, frame_length,
+        configs[c].min_freq, configs[c].max_freq, NULL);
+    gfloat *frame = g_new (gfloat, frame_length);
+
+    for (guint d = 0; dsps[d]; d++) {
+      WhsExtractor *extractor = whs_extractor_new_full (sample_rate, frame_length,
+          configs[c].min_freq, configs[c].max_freq, dsps[d]);
+      GRand *rand = g_rand_new_with_seed (c);
+      gdouble max_error = 0.0;
+
+      for (guint n = 0; n < N_FRAMES; n++) {
+        WhsFeatureVector expected, vec;
+        gdouble mel[32], e_mel[32], loudest, error = 0.0;
+
+        generate_frame (frame, frame_length, sample_rate, n, rand);
+        whs_extractor_process (reference, frame, &expected);
+        whs_extractor_process (extractor, frame, &vec);
+
+        mel_bins (&expected, e_mel, ip, w);
+        mel_bins (&vec, mel, ip, w);
+
+        loudest = e_mel[0];
+        for (guint i = 1; i < 32; i++)
+          loudest = MAX (loudest, e_mel[i]);
+        for (guint i = 0; i < 32; i++)
+          if (e_mel[i] >= loudest - DYNAMIC_RANGE)
+            error = MAX (error, fabs (mel[i] - e_mel[i]) / MAX (1.0, fabs (e_mel[i])));
+
+        max_error = MAX (max_error, error);
+      }
+
+      g_print ("%-8s %5u Hz %4u samples %4u-%-4u Hz: max error %g\n", dsps[d]->name, sample_rate,
+          frame_length, configs[c].min_freq, configs[c].max_freq, max_error);
+
+      if (max_error >= MAX_ERROR) {
+        g_print ("%s: error above %g\n", dsps[d]->name, MAX_ERROR);
+        ret = FALSE;
+      }
+
+      g_rand_free (rand);
+      whs_object_unref (extractor);
+    }
+
+    g_free (frame);
+    whs_object_unref (reference);
+  }
+
+  return ret ? 0 : 1;
+}
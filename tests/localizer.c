@@ -0,0 +1,123 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ *
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks that the time domain cross correlation and GCC-PHAT both find
+ * fractional delays between two channels, and that they agree with each
+ * other, so that it doesn't matter which one the localizer picks */
+
+#include "whslocalizer.c"
+
+#include <glib.h>
+
+#define N_DELAYS (200)
+#define N_TAPS (32)
+#define MAX_LAG (128)
+
+/* In samples, of each method and between them */
+#define MAX_ERROR (0.25)
+#define MAX_DIFFERENCE (0.15)
+
+static const struct {
+  guint sample_rate, frame_length, distance;
+} configs[] = {
+  { 44100, 512, 10 },
+  { 44100, 512, 50 },
+  { 48000, 1024, 30 },
+  { 16000, 256, 100 },
+};
+
+/* Fills the 2 * frame_length samples of both channels with the same
+ * white noise, the second channel delayed by delay samples with a
+ * windowed sinc filter */
+static void
+generate (gfloat **in, guint frame_length, gdouble delay, gdouble *noise, GRand *rand)
+{
+  gint n = 2 * frame_length + 2 * (MAX_LAG + N_TAPS);
+
+  for (gint i = 0; i < n; i++)
+    noise[i] = g_rand_double_range (rand, -1.0, 1.0);
+
+  for (gint i = 0; i < 2 * frame_length; i++) {
+    gint center = i + MAX_LAG + N_TAPS;
+    gdouble x1 = 0.0;
+
+    in[0][i] = noise[center];
+
+    for (gint k = - N_TAPS; k <= N_TAPS; k++) {
+      gdouble t = k - (delay - floor (delay));
+      gdouble sinc = (t == 0.0) ? 1.0 : sin (M_PI * t) / (M_PI * t);
+      gdouble window = 0.5 + 0.5 * cos (M_PI * t / (N_TAPS + 1));
+
+      x1 += noise[center - (gint) floor (delay) - k] * sinc * window;
+    }
+
+    in[1][i] = x1;
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  gboolean ret = TRUE;
+
+  g_type_init ();
+
+  for (guint c = 0; c < G_N_ELEMENTS (configs); c++) {
+    guint sample_rate = configs[c].sample_rate, frame_length = configs[c].frame_length;
+    WhsLocalizer *xcorr = whs_localizer_new_full (sample_rate, frame_length, 2,
+        configs[c].distance, WHS_LOCALIZER_METHOD_XCORR);
+    WhsLocalizer *phat = whs_localizer_new_full (sample_rate, frame_length, 2,
+        configs[c].distance, WHS_LOCALIZER_METHOD_PHAT);
+    gint max_range = xcorr->priv->max_range;
+    gfloat *in[2] = { g_new (gfloat, 2 * frame_length), g_new (gfloat, 2 * frame_length) };
+    gdouble *noise = g_new (gdouble, 2 * frame_length + 2 * (MAX_LAG + N_TAPS));
+    GRand *rand = g_rand_new_with_seed (c);
+    gdouble max_xcorr = 0.0, max_phat = 0.0, max_diff = 0.0;
+
+    for (guint n = 0; n < N_DELAYS; n++) {
+      // Away from the ends of the range, where the peak can't be interpolated
+      gdouble delay = g_rand_double_range (rand, 1 - max_range, max_range - 2);
+      gdouble lag_xcorr, lag_phat;
+
+      generate (in, frame_length, delay, noise, rand);
+      lag_xcorr = whs_localizer_xcorr (xcorr, (const gfloat **) in);
+      lag_phat = whs_localizer_gcc_phat (phat, (const gfloat **) in);
+
+      max_xcorr = MAX (max_xcorr, fabs (lag_xcorr - delay));
+      max_phat = MAX (max_phat, fabs (lag_phat - delay));
+      max_diff = MAX (max_diff, fabs (lag_xcorr - lag_phat));
+    }
+
+    g_print ("%5u Hz %4u samples %3u cm: max error xcorr %g, phat %g, difference %g\n",
+        sample_rate, frame_length, configs[c].distance, max_xcorr, max_phat, max_diff);
+
+    if (max_xcorr >= MAX_ERROR || max_phat >= MAX_ERROR || max_diff >= MAX_DIFFERENCE) {
+      g_print ("error above %g or difference above %g samples\n", MAX_ERROR, MAX_DIFFERENCE);
+      ret = FALSE;
+    }
+
+    g_rand_free (rand);
+    g_free (in[0]);
+    g_free (in[1]);
+    g_free (noise);
+    whs_object_unref (xcorr);
+    whs_object_unref (phat);
+  }
+
+  return ret ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ *
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks the sigmoid of every implementation that runs on this CPU
+ * against 1 / (1 + exp (-x)) in double precision, with the error bounds
+ * documented in whsdsp.c */
+
+#include "whsdsp.c"
+
+#include <glib.h>
+#include <string.h>
+
+#define N_VALUES (2000001)
+#define RANGE (100.0)
+
+#define MAX_ABS_ERROR (1e-7)
+#define MAX_REL_ERROR (2e-7)
+
+static gboolean
+check_sigmoid (const WhsDspFunctions *dsp, const gfloat *in, gfloat *out, guint n)
+{
+  gdouble max_abs = 0.0, max_rel = 0.0;
+  gboolean ret = TRUE;
+
+  memcpy (out, in, n * sizeof (gfloat));
+  dsp->sigmoid (out, n);
+
+  for (guint i = 0; i < n; i++) {
+    gdouble x = in[i];
+    gdouble expected = 1.0 / (1.0 + exp (-x));
+    gdouble error = fabs (out[i] - expected);
+
+    // Below the cutoff the result is exactly 0 instead of a denormal
+    if (x < -SIGMOID_MAX) {
+      if (out[i] != 0.0f) {
+        g_print ("%s: sigmoid (%g) = %g, expected 0\n", dsp->name, x, out[i]);
+        ret = FALSE;
+      }
+      continue;
+    }
+
+    if (i > 0 && out[i] < out[i - 1]) {
+      g_print ("%s: sigmoid (%g) = %g is smaller than sigmoid (%g) = %g\n", dsp->name,
+          x, out[i], (gdouble) in[i - 1], out[i - 1]);
+      ret = FALSE;
+    }
+
+    max_abs = MAX (max_abs, error);
+    max_rel = MAX (max_rel, error / expected);
+  }
+
+  g_print ("%-8s max abs error %g, max rel error %g\n", dsp->name, max_abs, max_rel);
+
+  if (max_abs >= MAX_ABS_ERROR || max_rel >= MAX_REL_ERROR) {
+    g_print ("%s: error above %g absolute or %g relative\n", dsp->name, MAX_ABS_ERROR, MAX_REL_ERROR);
+    ret = FALSE;
+  }
+
+  return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+  const WhsDspFunctions *dsps[4];
+  guint n_dsps = 0;
+  gboolean ret = TRUE;
+
+  dsps[n_dsps++] = &dsp_c;
+
+#if defined (HAVE_SSE2) || defined (HAVE_AVX2)
+  __builtin_cpu_init ();
+#endif
+
+#ifdef HAVE_SSE2
+  if (__builtin_cpu_supports ("sse2"))
+    dsps[n_dsps++] = &dsp_sse2;
+#endif
+
+#ifdef HAVE_AVX2
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma"))
+    dsps[n_dsps++] = &dsp_avx2;
+#endif
+
+#ifdef HAVE_NEON
+  dsps[n_dsps++] = &dsp_neon;
+#endif
+
+  // Evenly spaced values in [-RANGE, RANGE], followed by the extremes
+  // and the values around the cutoff in ascending order
+  guint n = N_VALUES + 6;
+  gfloat *in = g_new (gfloat, n);
+  gfloat *out = g_new (gfloat, n);
+
+  for (guint i = 0; i < N_VALUES; i++)
+    in[i] = -RANGE + (2.0 * RANGE * i) / (N_VALUES - 1);
+  in[N_VALUES + 0] = -G_MAXFLOAT;
+  in[N_VALUES + 1] = nextafterf (-SIGMOID_MAX, -G_MAXFLOAT);
+  in[N_VALUES + 2] = -SIGMOID_MAX;
+  in[N_VALUES + 3] = nextafterf (-SIGMOID_MAX, 0.0f);
+  in[N_VALUES + 4] = -0.0f;
+  in[N_VALUES + 5] = G_MAXFLOAT;
+
+  for (guint d = 0; d < n_dsps; d++) {
+    ret &= check_sigmoid (dsps[d], in, out, N_VALUES);
+    ret &= check_sigmoid (dsps[d], in + N_VALUES, out, n - N_VALUES);
+  }
+
+  g_free (in);
+  g_free (out);
+
+  return ret ? 0 : 1;
+}
@@ -26,6 +26,8 @@
 void
 whs_classifier_register (void)
 {
+  WHS_TYPE_MLP_CLASSIFIER;
+  WHS_TYPE_MLP_Q8_CLASSIFIER;
   WHS_TYPE_NN_CLASSIFIER_32_16_1;
   WHS_TYPE_NN_CLASSIFIER_32_32_1;
   WHS_TYPE_NN_CLASSIFIER_32_32_32_1;
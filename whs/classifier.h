@@ -21,9 +21,7 @@
 
 #include "whsclassifier.h"
 
-#include "classifier/whsnnclassifier32-16-1.h"
-#include "classifier/whsnnclassifier32-32-1.h"
-#include "classifier/whsnnclassifier32-32-32-1.h"
+#include "classifier/whsmlpclassifier.h"
 
 G_GNUC_INTERNAL void whs_classifier_register (void);
 
@@ -0,0 +1,437 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "whsmlpclassifier.h"
+#include "whsmlpmodel.h"
+#include "whsmlptrainer.h"
+#include "whsclassifier.h"
+#include "whsprivate.h"
+#include "whsutils.h"
+#include "whspatternprivate.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Generic multi layer perceptron, see whsmlpmodel.c for the layout of
+ * the pattern data. The weights are shared by all classifiers created
+ * from the same pattern data, every classifier only has its own buffers
+ * for the layer outputs. */
+
+#define N_INPUTS (G_N_ELEMENTS (((WhsFeatureVector *) NULL)->mfcc))
+
+/* Maximum number of vectors that go through the network at once */
+#define BATCH_SIZE (32)
+
+static const guint default_topology[] = { N_INPUTS, 32, 32, 1 };
+
+struct _WhsMLPClassifierPrivate
+{
+  WhsMLPModel *model;
+  WhsMLPScratch *scratch;
+  WhsMLPScratch *batch_scratch;
+
+  /* Batch size 0 uses the default of the optimizer */
+  WhsMLPTrainParams train;
+};
+
+typedef struct
+{
+  guint widths[WHS_MLP_MAX_LAYERS + 1];
+  guint n_widths;
+  WhsMLPActivation activation;
+  WhsMLPActivation output;
+  /* Set if any of the above is given */
+  gboolean topology;
+
+  WhsMLPTrainParams train;
+  /* Seed for the initial weights */
+  gboolean seeded;
+  guint32 seed;
+} WhsMLPArgs;
+
+static guint
+default_n_threads (void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  glong n = sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (n > 0)
+    return MIN (n, 64);
+#endif
+
+  return 1;
+}
+
+static gboolean
+parse_uint (const gchar *str, guint max, guint *value)
+{
+  gchar *end;
+  guint64 v = g_ascii_strtoull (str, &end, 10);
+
+  if (end == str || *end != '\0' || v > max)
+    return FALSE;
+
+  *value = v;
+
+  return TRUE;
+}
+
+/* Parses a comma separated list of a topology like "32-16-1", the
+ * activation function "sigmoid" or "tanh", "softmax" for the output
+ * layer and the training options "fast", "batch=N" for mini-batches of
+ * N values, "threads=N" and "seed=N" */
+static gboolean
+parse_args (const gchar *str, WhsMLPArgs *args)
+{
+  gchar **parts = g_strsplit (str, ",", -1);
+  gboolean ret = TRUE;
+
+  for (guint p = 0; ret && parts[p]; p++) {
+    if (strcmp (parts[p], "fast") == 0) {
+      args->train.fast = TRUE;
+      continue;
+    } else if (g_str_has_prefix (parts[p], "batch=")) {
+      ret = parse_uint (parts[p] + 6, G_MAXINT, &args->train.batch_size) && args->train.batch_size > 0;
+      continue;
+    } else if (g_str_has_prefix (parts[p], "threads=")) {
+      ret = parse_uint (parts[p] + 8, 64, &args->train.n_threads) && args->train.n_threads > 0;
+      continue;
+    } else if (g_str_has_prefix (parts[p], "seed=")) {
+      ret = args->seeded = parse_uint (parts[p] + 5, G_MAXUINT32, &args->seed);
+      continue;
+    }
+
+    args->topology = TRUE;
+
+    if (strcmp (parts[p], "tanh") == 0) {
+      args->activation = WHS_MLP_ACTIVATION_TANH;
+      continue;
+    } else if (strcmp (parts[p], "sigmoid") == 0) {
+      args->activation = WHS_MLP_ACTIVATION_SIGMOID;
+      continue;
+    } else if (strcmp (parts[p], "softmax") == 0) {
+      args->output = WHS_MLP_ACTIVATION_SOFTMAX;
+      continue;
+    }
+
+    gchar **w = g_strsplit (parts[p], "-", -1);
+
+    args->n_widths = 0;
+    for (guint i = 0; ret && w[i]; i++) {
+      if (args->n_widths == WHS_MLP_MAX_LAYERS + 1 || !parse_uint (w[i], WHS_MLP_MAX_WIDTH, &args->widths[args->n_widths]))
+        ret = FALSE;
+      else
+        args->n_widths++;
+    }
+
+    g_strfreev (w);
+  }
+
+  g_strfreev (parts);
+
+  return ret;
+}
+
+#define WHS_MLP_CLASSIFIER_GET_PRIVATE(obj)  \
+    (G_TYPE_INSTANCE_GET_PRIVATE ((obj), WHS_TYPE_MLP_CLASSIFIER, WhsMLPClassifierPrivate))
+
+static void whs_mlp_classifier_init (WhsMLPClassifier * self);
+static void whs_mlp_classifier_class_init (WhsMLPClassifierClass * klass);
+static void whs_mlp_classifier_finalize (WhsObject *object);
+
+static WhsClassifier * whs_mlp_classifier_constructor (WhsPattern *pattern, const gchar *args);
+static void whs_mlp_classifier_process (WhsClassifier *classifier, const WhsFeatureVector *vec, WhsResult *res);
+static void whs_mlp_classifier_process_batch (WhsClassifier *classifier, const WhsFeatureVector *vecs, guint n, WhsResult *res);
+static WhsPattern * whs_mlp_classifier_learn (WhsClassifier *self, const WhsFeatureStore *store, const WhsTrainOptions *options);
+static WhsPattern * whs_mlp_classifier_quantize (WhsClassifier *self);
+
+G_DEFINE_TYPE (WhsMLPClassifier, whs_mlp_classifier, WHS_TYPE_CLASSIFIER);
+
+static WhsClassifierClass *parent_class = NULL;
+
+static void
+whs_mlp_classifier_class_init (WhsMLPClassifierClass * klass)
+{
+  WhsObjectClass *o_klass = (WhsObjectClass *) klass;
+  WhsClassifierClass *c_klass = (WhsClassifierClass *) klass;
+
+  parent_class = WHS_CLASSIFIER_CLASS (g_type_class_peek_parent (klass));
+
+  g_type_class_add_private (klass, sizeof (WhsMLPClassifierPrivate));
+
+  o_klass->finalize = whs_mlp_classifier_finalize;
+  c_klass->constructor = whs_mlp_classifier_constructor;
+  c_klass->learn = whs_mlp_classifier_learn;
+  c_klass->process = whs_mlp_classifier_process;
+  c_klass->process_batch = whs_mlp_classifier_process_batch;
+  c_klass->quantize = whs_mlp_classifier_quantize;
+}
+
+static void
+whs_mlp_classifier_init (WhsMLPClassifier * self)
+{
+  self->priv = WHS_MLP_CLASSIFIER_GET_PRIVATE (self);
+}
+
+static void
+whs_mlp_classifier_finalize (WhsObject *object)
+{
+  WhsMLPClassifier *self = WHS_MLP_CLASSIFIER (object);
+
+  if (self->priv->scratch) {
+    whs_mlp_scratch_free (self->priv->scratch);
+    self->priv->scratch = NULL;
+  }
+
+  if (self->priv->batch_scratch) {
+    whs_mlp_scratch_free (self->priv->batch_scratch);
+    self->priv->batch_scratch = NULL;
+  }
+
+  if (self->priv->model) {
+    whs_mlp_model_unref (self->priv->model);
+    self->priv->model = NULL;
+  }
+
+  WHS_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static WhsClassifier *
+whs_mlp_classifier_create (GType type, WhsPattern *pattern, const gchar *args)
+{
+  WhsMLPClassifier *self = WHS_MLP_CLASSIFIER_CAST (g_type_create_instance (type));
+  WhsMLPClassifierClass *klass = WHS_MLP_CLASSIFIER_GET_CLASS (self);
+  WhsMLPModel *model = NULL;
+  WhsMLPArgs a = { { 0, }, G_N_ELEMENTS (default_topology), WHS_MLP_ACTIVATION_SIGMOID,
+      WHS_MLP_ACTIVATION_SIGMOID, FALSE, { 0, default_n_threads (), FALSE }, FALSE, 0 };
+
+  memcpy (a.widths, default_topology, sizeof (default_topology));
+  if (args && !parse_args (args, &a)) {
+    g_warning ("Invalid arguments \"%s\"", args);
+    whs_object_unref (self);
+    return NULL;
+  }
+
+  if (pattern) {
+    if (a.topology)
+      g_warning ("Topology is taken from the pattern, ignoring \"%s\"", args);
+
+    model = whs_mlp_model_load (g_type_name (type), pattern, klass->topology, klass->n_topology, klass->quantized);
+  } else if (klass->quantized) {
+    g_warning ("%s can only be created from a quantized pattern", g_type_name (type));
+  } else if (klass->topology) {
+    if (a.topology)
+      g_warning ("%s has a fixed topology, ignoring \"%s\"", g_type_name (type), args);
+
+    model = whs_mlp_model_new (klass->topology, klass->n_topology, WHS_MLP_ACTIVATION_SIGMOID, WHS_MLP_ACTIVATION_SIGMOID);
+  } else {
+    model = whs_mlp_model_new (a.widths, a.n_widths, a.activation, a.output);
+  }
+
+  if (!model) {
+    whs_object_unref (self);
+    return NULL;
+  }
+
+  if (!pattern) {
+    GRand *rand = (a.seeded) ? g_rand_new_with_seed (a.seed) : NULL;
+
+    whs_mlp_model_randomize (model, rand);
+    if (rand)
+      g_rand_free (rand);
+  }
+
+  self->priv->model = model;
+  self->priv->scratch = whs_mlp_scratch_new (model, 1);
+  self->priv->train = a.train;
+
+  guint n_out = model->layers[model->n_layers - 1].n_out;
+  WHS_CLASSIFIER_CAST (self)->n_classes = (n_out > 1) ? n_out : 0;
+
+  return WHS_CLASSIFIER_CAST (self);
+}
+
+static WhsClassifier *
+whs_mlp_classifier_constructor (WhsPattern *pattern, const gchar *args)
+{
+  return whs_mlp_classifier_create (WHS_TYPE_MLP_CLASSIFIER, pattern, args);
+}
+
+static void
+whs_mlp_classifier_process (WhsClassifier *classifier, const WhsFeatureVector *vec, WhsResult *res)
+{
+  WhsMLPClassifier *self = WHS_MLP_CLASSIFIER (classifier);
+  const gfloat *out = whs_mlp_model_forward (self->priv->model, self->priv->scratch, vec->mfcc, FALSE);
+
+  whs_mlp_model_get_result (self->priv->model, out, res);
+}
+
+static void
+whs_mlp_classifier_process_batch (WhsClassifier *classifier, const WhsFeatureVector *vecs, guint n, WhsResult *res)
+{
+  WhsMLPClassifier *self = WHS_MLP_CLASSIFIER (classifier);
+  WhsMLPClassifierPrivate *priv = self->priv;
+
+  if (n == 1) {
+    whs_mlp_classifier_process (classifier, vecs, res);
+    return;
+  }
+
+  if (!priv->batch_scratch)
+    priv->batch_scratch = whs_mlp_scratch_new (priv->model, BATCH_SIZE);
+
+  guint stride = WHS_MLP_STRIDE (priv->model->layers[priv->model->n_layers - 1].n_out);
+
+  for (guint i = 0; i < n; i += BATCH_SIZE) {
+    guint len = MIN (BATCH_SIZE, n - i);
+    const gfloat *out = whs_mlp_model_forward_batch (priv->model, priv->batch_scratch, vecs[i].mfcc, len, FALSE);
+
+    for (guint b = 0; b < len; b++)
+      whs_mlp_model_get_result (priv->model, out + b * stride, &res[i + b]);
+  }
+}
+
+static WhsPattern *
+whs_mlp_classifier_learn (WhsClassifier *classifier, const WhsFeatureStore *store, const WhsTrainOptions *options)
+{
+  WhsMLPClassifier *self = WHS_MLP_CLASSIFIER (classifier);
+
+  if (self->priv->model->quantized) {
+    g_warning ("Quantized models can't be trained");
+    return NULL;
+  }
+
+  // Shared models are read-only, train a private copy
+  if (self->priv->model->key || self->priv->model->refcount > 1) {
+    WhsMLPModel *model = whs_mlp_model_copy (self->priv->model);
+
+    whs_mlp_model_unref (self->priv->model);
+    self->priv->model = model;
+  }
+
+  for (guint i = 0; i < store->n && classifier->n_classes > 0; ) {
+    const gint32 *labels;
+    const WhsFeatureVector *vecs;
+    guint len = whs_feature_store_get_run (store, i, &labels, &vecs), j;
+
+    for (j = 0; j < len && labels[j] < (gint32) classifier->n_classes; j++);
+
+    if (j < len) {
+      g_warning ("Ignoring values of class %d, the network only has %u outputs", labels[j], classifier->n_classes);
+      break;
+    }
+
+    i += len;
+  }
+
+  whs_mlp_model_train (self->priv->model, store, &self->priv->train, options);
+
+  WhsPattern *ret = WHS_PATTERN_CAST (g_type_create_instance (WHS_TYPE_PATTERN));
+  gsize size;
+  guint8 *data = whs_mlp_model_save (self->priv->model, &size);
+
+  whs_pattern_set_classifier_data (ret, g_type_name (G_TYPE_FROM_INSTANCE (self)), data, size, WHS_PATTERN_LAYOUT_NATIVE);
+
+  return ret;
+}
+
+static WhsPattern *
+whs_mlp_classifier_quantize (WhsClassifier *classifier)
+{
+  WhsMLPClassifier *self = WHS_MLP_CLASSIFIER (classifier);
+
+  if (self->priv->model->quantized) {
+    g_warning ("Model is already quantized");
+    return NULL;
+  }
+
+  WhsMLPModel *model = whs_mlp_model_quantize (self->priv->model);
+  WhsPattern *ret = WHS_PATTERN_CAST (g_type_create_instance (WHS_TYPE_PATTERN));
+  gsize size;
+  guint8 *data = whs_mlp_model_save (model, &size);
+
+  whs_pattern_set_classifier_data (ret, g_type_name (WHS_TYPE_MLP_Q8_CLASSIFIER), data, size, WHS_PATTERN_LAYOUT_NATIVE);
+  whs_mlp_model_unref (model);
+
+  return ret;
+}
+
+/* Quantized variant, the topology is always stored in the pattern data */
+
+typedef WhsMLPClassifier WhsMLPQ8Classifier;
+typedef WhsMLPClassifierClass WhsMLPQ8ClassifierClass;
+
+G_DEFINE_TYPE (WhsMLPQ8Classifier, whs_mlp_q8_classifier, WHS_TYPE_MLP_CLASSIFIER);
+
+static WhsClassifier *
+whs_mlp_q8_classifier_constructor (WhsPattern *pattern, const gchar *args)
+{
+  return whs_mlp_classifier_create (WHS_TYPE_MLP_Q8_CLASSIFIER, pattern, args);
+}
+
+static void
+whs_mlp_q8_classifier_class_init (WhsMLPQ8ClassifierClass * klass)
+{
+  klass->quantized = TRUE;
+  WHS_CLASSIFIER_CLASS (klass)->constructor = whs_mlp_q8_classifier_constructor;
+}
+
+static void
+whs_mlp_q8_classifier_init (WhsMLPQ8Classifier * self)
+{
+}
+
+/* Fixed topology subclasses, kept for the pattern files of older versions */
+
+#define WHS_DEFINE_NN_CLASSIFIER(TN, t_n, T_N, ...) \
+typedef WhsMLPClassifier TN; \
+typedef WhsMLPClassifierClass TN##Class; \
+\
+static const guint t_n##_topology[] = { __VA_ARGS__ }; \
+\
+G_DEFINE_TYPE (TN, t_n, WHS_TYPE_MLP_CLASSIFIER); \
+\
+static WhsClassifier * \
+t_n##_constructor (WhsPattern *pattern, const gchar *args) \
+{ \
+  return whs_mlp_classifier_create (T_N, pattern, args); \
+} \
+\
+static void \
+t_n##_class_init (TN##Class * klass) \
+{ \
+  klass->topology = t_n##_topology; \
+  klass->n_topology = G_N_ELEMENTS (t_n##_topology); \
+  WHS_CLASSIFIER_CLASS (klass)->constructor = t_n##_constructor; \
+} \
+\
+static void \
+t_n##_init (TN * self) \
+{ \
+}
+
+WHS_DEFINE_NN_CLASSIFIER (WhsNNClassifier_32_16_1, whs_nn_classifier_32_16_1, WHS_TYPE_NN_CLASSIFIER_32_16_1, 32, 16, 1);
+WHS_DEFINE_NN_CLASSIFIER (WhsNNClassifier_32_32_1, whs_nn_classifier_32_32_1, WHS_TYPE_NN_CLASSIFIER_32_32_1, 32, 32, 1);
+WHS_DEFINE_NN_CLASSIFIER (WhsNNClassifier_32_32_32_1, whs_nn_classifier_32_32_32_1, WHS_TYPE_NN_CLASSIFIER_32_32_32_1, 32, 32, 32, 1);
@@ -0,0 +1,88 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WHS_MLP_CLASSIFIER_H__
+#define __WHS_MLP_CLASSIFIER_H__
+
+#include <glib.h>
+#include "whs.h"
+#include "whsobject.h"
+#include "whsclassifier.h"
+
+G_BEGIN_DECLS
+
+/* Arguments are the layer widths and the hidden layer activation, e.g.
+ * "WhsMLPClassifier:32-16-1,tanh". "fast" trains with the approximated
+ * activation functions that are used for classification. Networks with
+ * several outputs score one class per output, with a sigmoid for every
+ * output or "softmax". "batch=256,threads=8" trains on mini-batches that
+ * are split across threads, "batch=1" after every value. Without it the
+ * optimizer of the WhsTrainOptions selects the batch size. "seed=N" gives
+ * reproducible initial weights */
+#define WHS_TYPE_MLP_CLASSIFIER          (whs_mlp_classifier_get_type())
+#define WHS_IS_MLP_CLASSIFIER(obj)       (G_TYPE_CHECK_INSTANCE_TYPE ((obj), WHS_TYPE_MLP_CLASSIFIER))
+#define WHS_IS_MLP_CLASSIFIER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), WHS_TYPE_MLP_CLASSIFIER))
+#define WHS_MLP_CLASSIFIER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), WHS_TYPE_MLP_CLASSIFIER, WhsMLPClassifierClass))
+#define WHS_MLP_CLASSIFIER(obj)          (G_TYPE_CHECK_INSTANCE_CAST ((obj), WHS_TYPE_MLP_CLASSIFIER, WhsMLPClassifier))
+#define WHS_MLP_CLASSIFIER_CLASS(klass)  (G_TYPE_CHECK_CLASS_CAST ((klass), WHS_TYPE_MLP_CLASSIFIER, WhsMLPClassifierClass))
+#define WHS_MLP_CLASSIFIER_CAST(obj)     ((WhsMLPClassifier*)(obj))
+
+/* int8 weights, only created from the patterns of the other
+ * classifiers by whs_pattern_quantize() */
+#define WHS_TYPE_MLP_Q8_CLASSIFIER        (whs_mlp_q8_classifier_get_type())
+
+/* Fixed topology classifiers of older versions, they use the
+ * per neuron [bias, weights...] layout for the pattern data */
+#define WHS_TYPE_NN_CLASSIFIER_32_16_1    (whs_nn_classifier_32_16_1_get_type())
+#define WHS_TYPE_NN_CLASSIFIER_32_32_1    (whs_nn_classifier_32_32_1_get_type())
+#define WHS_TYPE_NN_CLASSIFIER_32_32_32_1 (whs_nn_classifier_32_32_32_1_get_type())
+
+typedef struct _WhsMLPClassifier WhsMLPClassifier;
+typedef struct _WhsMLPClassifierClass WhsMLPClassifierClass;
+typedef struct _WhsMLPClassifierPrivate WhsMLPClassifierPrivate;
+
+struct _WhsMLPClassifier
+{
+  WhsClassifier parent;
+
+  WhsMLPClassifierPrivate *priv;
+};
+
+struct _WhsMLPClassifierClass
+{
+  WhsClassifierClass parent;
+
+  /* Layer widths of subclasses with a fixed topology,
+   * NULL if the topology is stored in the pattern data */
+  const guint *topology;
+  guint n_topology;
+
+  /* The pattern data contains a quantized model */
+  gboolean quantized;
+};
+
+G_GNUC_INTERNAL GType whs_mlp_classifier_get_type (void);
+G_GNUC_INTERNAL GType whs_mlp_q8_classifier_get_type (void);
+
+G_GNUC_INTERNAL GType whs_nn_classifier_32_16_1_get_type (void);
+G_GNUC_INTERNAL GType whs_nn_classifier_32_32_1_get_type (void);
+G_GNUC_INTERNAL GType whs_nn_classifier_32_32_32_1_get_type (void);
+
+G_END_DECLS
+
+#endif /* __WHS_MLP_CLASSIFIER_H__ */
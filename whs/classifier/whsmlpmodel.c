@@ -0,0 +1,991 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "whsmlpmodel.h"
+#include "whsdsp.h"
+#include "whsprivate.h"
+#include "whsutils.h"
+#include "whspatternprivate.h"
+
+#include <math.h>
+#include <string.h>
+
+/* The native pattern data layout is the one of the model in memory, in
+ * the byte order of the pattern file:
+ *
+ *   guint32 n_layers
+ *   guint32 width[n_layers + 1]
+ *   guint32 activation[n_layers]
+ *
+ * padded to a multiple of 64 bytes, followed by the n_params floats of
+ * the model including the zero padding of rows. Quantized models then
+ * have the int8 weights of all layers at the next multiple of 64 bytes.
+ * Patterns written before have one of the portable layouts.
+ *
+ * The generic portable pattern data layout is (all values big endian)
+ *
+ *   guint32 n_layers
+ *   guint32 width[n_layers + 1]
+ *   guint32 activation[n_layers]
+ *
+ * followed by the bias vector and the row-major weight matrix
+ * (width[l + 1] rows of width[l] columns) of every layer. The legacy
+ * layout has a fixed topology and stores every neuron as
+ * [bias, weights...]. Quantized models have the same header, followed
+ * by the bias and scale vectors of every layer and then the int8 weights
+ * of all layers, row-major without padding */
+
+#define N_INPUTS (G_N_ELEMENTS (((WhsFeatureVector *) NULL)->mfcc))
+
+/* Rows are aligned to 32 bytes so the forward pass runs over whole vectors */
+#define ALIGNMENT (32)
+#define ROWS(n) (((n) + 3) & ~3)
+
+/* Sections of the native layout are aligned to 64 bytes */
+#define NATIVE_ALIGN(n) (((n) + 63) & ~((gsize) 63))
+
+/* Models loaded from pattern data by the checksum of the data. The
+ * reference count of these is only decreased with the lock held so
+ * a model can't be looked up while it is freed */
+G_LOCK_DEFINE_STATIC (models);
+static GHashTable *models = NULL;
+
+static inline gfloat
+activate (WhsMLPActivation activation, gfloat x)
+{
+  if (activation == WHS_MLP_ACTIVATION_TANH)
+    return tanhf (x);
+
+  return 1.0f / (1.0f + expf (-x));
+}
+
+/* Derivative of the activation function by its output o */
+static inline gfloat
+activate_derivative (WhsMLPActivation activation, gfloat o)
+{
+  if (activation == WHS_MLP_ACTIVATION_TANH)
+    return 1.0f - o * o;
+
+  return o * (1.0f - o);
+}
+
+static gpointer
+alloc_aligned (gsize n_floats, gpointer *mem)
+{
+  *mem = g_malloc0 (n_floats * sizeof (gfloat) + ALIGNMENT - 1);
+  return (gpointer) (((gsize) *mem + ALIGNMENT - 1) & ~((gsize) ALIGNMENT - 1));
+}
+
+static gsize
+whs_mlp_model_n_values (const WhsMLPModel *self)
+{
+  gsize n_values = 0;
+
+  for (guint l = 0; l < self->n_layers; l++)
+    n_values += self->layers[l].n_out * (self->layers[l].n_in + 1);
+
+  return n_values;
+}
+
+/* Size of the weights and biases in the generic layout */
+static gsize
+whs_mlp_model_data_size (const WhsMLPModel *self)
+{
+  gsize size = 0;
+
+  if (!self->quantized)
+    return sizeof (gfloat) * whs_mlp_model_n_values (self);
+
+  for (guint l = 0; l < self->n_layers; l++)
+    size += self->layers[l].n_out * (2 * sizeof (gfloat) + self->layers[l].n_in);
+
+  return size;
+}
+
+/* Points the layers into params and qparams, which are aligned
+ * to ALIGNMENT and have the layout of whs_mlp_model_alloc() */
+static void
+whs_mlp_model_assign (WhsMLPModel *self, gfloat *params, gint8 *qparams)
+{
+  self->params = params;
+
+  for (guint l = 0; l < self->n_layers; l++) {
+    WhsMLPLayer *layer = &self->layers[l];
+
+    if (self->quantized) {
+      layer->qweights = qparams;
+      qparams += layer->n_out * WHS_MLP_Q8_STRIDE (layer->n_in);
+      layer->scale = params;
+      params += WHS_MLP_STRIDE (layer->n_out);
+    } else {
+      layer->weights = params;
+      params += ROWS (layer->n_out) * layer->stride;
+    }
+    layer->bias = params;
+    params += WHS_MLP_STRIDE (layer->n_out);
+  }
+}
+
+/* activation is used for the hidden layers, output for the last layer.
+ * The parameters are left unset if mapped is TRUE */
+static WhsMLPModel *
+whs_mlp_model_alloc (const guint *widths, guint n_widths, WhsMLPActivation activation,
+    WhsMLPActivation output, gboolean quantized, gboolean mapped)
+{
+  if (n_widths < 2 || n_widths > WHS_MLP_MAX_LAYERS + 1) {
+    g_warning ("Invalid number of layers %u", n_widths - 1);
+    return NULL;
+  }
+
+  if (widths[0] != N_INPUTS || widths[n_widths - 1] == 0 || widths[n_widths - 1] > WHS_MAX_CLASSES) {
+    g_warning ("Network needs %u inputs and 1 to %u outputs", (guint) N_INPUTS, WHS_MAX_CLASSES);
+    return NULL;
+  }
+
+  if (activation == WHS_MLP_ACTIVATION_SOFTMAX && n_widths > 2) {
+    g_warning ("Softmax is only possible for the output layer");
+    return NULL;
+  }
+
+  if (output == WHS_MLP_ACTIVATION_SOFTMAX && widths[n_widths - 1] == 1) {
+    g_warning ("Softmax needs more than one output");
+    return NULL;
+  }
+
+  for (guint l = 0; l < n_widths; l++) {
+    if (widths[l] == 0 || widths[l] > WHS_MLP_MAX_WIDTH) {
+      g_warning ("Invalid layer width %u", widths[l]);
+      return NULL;
+    }
+  }
+
+  WhsMLPModel *self = g_slice_new0 (WhsMLPModel);
+
+  self->refcount = 1;
+  self->n_layers = n_widths - 1;
+  self->quantized = quantized;
+
+  for (guint l = 0; l < self->n_layers; l++) {
+    WhsMLPLayer *layer = &self->layers[l];
+
+    layer->n_in = widths[l];
+    layer->n_out = widths[l + 1];
+    layer->stride = WHS_MLP_STRIDE (layer->n_in);
+    layer->activation = activation;
+
+    if (quantized) {
+      self->n_params += 2 * WHS_MLP_STRIDE (layer->n_out);
+      self->n_qparams += layer->n_out * WHS_MLP_Q8_STRIDE (layer->n_in);
+    } else {
+      self->n_params += ROWS (layer->n_out) * layer->stride + WHS_MLP_STRIDE (layer->n_out);
+    }
+  }
+
+  // The output layer always gives probabilities
+  self->layers[self->n_layers - 1].activation = output;
+
+  if (!mapped) {
+    gfloat *params = alloc_aligned (self->n_params, &self->params_mem);
+    gint8 *qparams = (quantized) ? alloc_aligned ((self->n_qparams + 3) / 4, &self->qparams_mem) : NULL;
+
+    whs_mlp_model_assign (self, params, qparams);
+  }
+
+  return self;
+}
+
+WhsMLPModel *
+whs_mlp_model_new (const guint *widths, guint n_widths, WhsMLPActivation activation, WhsMLPActivation output)
+{
+  return whs_mlp_model_alloc (widths, n_widths, activation, output, FALSE, FALSE);
+}
+
+static void
+whs_mlp_model_free (WhsMLPModel *self)
+{
+  if (self->owner)
+    whs_object_unref (self->owner);
+  g_free (self->params_mem);
+  g_free (self->qparams_mem);
+  g_free (self->key);
+  g_slice_free (WhsMLPModel, self);
+}
+
+WhsMLPModel *
+whs_mlp_model_ref (WhsMLPModel *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->refcount > 0, NULL);
+
+  g_atomic_int_inc (&self->refcount);
+
+  return self;
+}
+
+void
+whs_mlp_model_unref (WhsMLPModel *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->refcount > 0);
+
+  if (self->key) {
+    G_LOCK (models);
+    if (g_atomic_int_dec_and_test (&self->refcount)) {
+      g_hash_table_remove (models, self->key);
+      whs_mlp_model_free (self);
+    }
+    G_UNLOCK (models);
+  } else if (g_atomic_int_dec_and_test (&self->refcount)) {
+    whs_mlp_model_free (self);
+  }
+}
+
+WhsMLPModel *
+whs_mlp_model_copy (const WhsMLPModel *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (!self->quantized, NULL);
+
+  guint widths[WHS_MLP_MAX_LAYERS + 1];
+
+  widths[0] = self->layers[0].n_in;
+  for (guint l = 0; l < self->n_layers; l++)
+    widths[l + 1] = self->layers[l].n_out;
+
+  WhsMLPModel *copy = whs_mlp_model_new (widths, self->n_layers + 1, WHS_MLP_ACTIVATION_SIGMOID, WHS_MLP_ACTIVATION_SIGMOID);
+
+  for (guint l = 0; l < self->n_layers; l++)
+    copy->layers[l].activation = self->layers[l].activation;
+  memcpy (copy->params, self->params, sizeof (gfloat) * self->n_params);
+
+  return copy;
+}
+
+/* Returns a quantized copy of the model. Every weight row is scaled
+ * symmetrically to [-127, 127] by its maximum absolute value */
+WhsMLPModel *
+whs_mlp_model_quantize (const WhsMLPModel *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (!self->quantized, NULL);
+
+  guint widths[WHS_MLP_MAX_LAYERS + 1];
+
+  widths[0] = self->layers[0].n_in;
+  for (guint l = 0; l < self->n_layers; l++)
+    widths[l + 1] = self->layers[l].n_out;
+
+  WhsMLPModel *ret = whs_mlp_model_alloc (widths, self->n_layers + 1, WHS_MLP_ACTIVATION_SIGMOID, WHS_MLP_ACTIVATION_SIGMOID, TRUE, FALSE);
+
+  for (guint l = 0; l < self->n_layers; l++) {
+    const WhsMLPLayer *layer = &self->layers[l];
+    WhsMLPLayer *q = &ret->layers[l];
+
+    q->activation = layer->activation;
+
+    for (guint i = 0; i < layer->n_out; i++) {
+      const gfloat *w = layer->weights + i * layer->stride;
+      gint8 *qw = q->qweights + i * WHS_MLP_Q8_STRIDE (q->n_in);
+      gfloat max = 0.0f;
+
+      for (guint j = 0; j < layer->n_in; j++)
+        max = MAX (max, fabsf (w[j]));
+
+      q->scale[i] = (max > 0.0f) ? max / 127.0f : 1.0f;
+      q->bias[i] = layer->bias[i];
+
+      for (guint j = 0; j < layer->n_in; j++)
+        qw[j] = CLAMP (lrintf (w[j] / q->scale[i]), -127, 127);
+    }
+  }
+
+  return ret;
+}
+
+/* Initializes all weights randomly, from rand if it isn't NULL */
+void
+whs_mlp_model_randomize (WhsMLPModel *self, GRand *rand)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->key == NULL);
+  g_return_if_fail (!self->quantized);
+
+  for (guint l = 0; l < self->n_layers; l++) {
+    WhsMLPLayer *layer = &self->layers[l];
+
+    for (guint i = 0; i < layer->n_out; i++) {
+      layer->bias[i] = (rand) ? g_rand_double_range (rand, -2.0, 2.0) : g_random_double_range (-2.0, 2.0);
+      for (guint j = 0; j < layer->n_in; j++)
+        layer->weights[i * layer->stride + j] = (rand) ? g_rand_double_range (rand, -2.0, 2.0) : g_random_double_range (-2.0, 2.0);
+    }
+  }
+}
+
+static gboolean
+valid_activation (const WhsMLPModel *self, guint l, WhsMLPActivation activation)
+{
+  if (activation == WHS_MLP_ACTIVATION_SIGMOID || activation == WHS_MLP_ACTIVATION_TANH)
+    return TRUE;
+
+  return activation == WHS_MLP_ACTIVATION_SOFTMAX && l == self->n_layers - 1 && self->layers[l].n_out > 1;
+}
+
+static WhsMLPModel *
+whs_mlp_model_load_generic (const guint8 *bytes, gsize size, gboolean quantized)
+{
+  const guint32 *header = (const guint32 *) bytes;
+
+  if (size < sizeof (guint32)) {
+    g_warning ("No topology in the pattern");
+    return NULL;
+  }
+
+  guint n_layers = GUINT32_FROM_BE (header[0]);
+  if (n_layers == 0 || n_layers > WHS_MLP_MAX_LAYERS || size < sizeof (guint32) * (2 * n_layers + 2)) {
+    g_warning ("Invalid topology in the pattern");
+    return NULL;
+  }
+
+  guint widths[WHS_MLP_MAX_LAYERS + 1];
+  for (guint l = 0; l <= n_layers; l++)
+    widths[l] = GUINT32_FROM_BE (header[1 + l]);
+
+  WhsMLPModel *self = whs_mlp_model_alloc (widths, n_layers + 1, WHS_MLP_ACTIVATION_SIGMOID, WHS_MLP_ACTIVATION_SIGMOID, quantized, FALSE);
+  if (!self)
+    return NULL;
+
+  for (guint l = 0; l < n_layers; l++) {
+    WhsMLPActivation activation = GUINT32_FROM_BE (header[n_layers + 2 + l]);
+
+    if (!valid_activation (self, l, activation)) {
+      g_warning ("Invalid activation function %u", activation);
+      whs_mlp_model_free (self);
+      return NULL;
+    }
+    self->layers[l].activation = activation;
+  }
+
+  if (size != sizeof (guint32) * (2 * n_layers + 2) + whs_mlp_model_data_size (self)) {
+    g_warning ("Invalid pattern data size");
+    whs_mlp_model_free (self);
+    return NULL;
+  }
+
+  const gfloat *data = (const gfloat *) (header + 2 * n_layers + 2);
+
+  if (quantized) {
+    for (guint l = 0; l < n_layers; l++) {
+      WhsMLPLayer *layer = &self->layers[l];
+
+      for (guint i = 0; i < layer->n_out; i++)
+        layer->bias[i] = GFLOAT_FROM_BE (*data++);
+      for (guint i = 0; i < layer->n_out; i++)
+        layer->scale[i] = GFLOAT_FROM_BE (*data++);
+    }
+
+    const gint8 *qdata = (const gint8 *) data;
+    for (guint l = 0; l < n_layers; l++) {
+      WhsMLPLayer *layer = &self->layers[l];
+
+      for (guint i = 0; i < layer->n_out; i++) {
+        for (guint j = 0; j < layer->n_in; j++) {
+          if (*qdata < -127) {
+            g_warning ("Invalid quantized weight");
+            whs_mlp_model_free (self);
+            return NULL;
+          }
+          layer->qweights[i * WHS_MLP_Q8_STRIDE (layer->n_in) + j] = *qdata++;
+        }
+      }
+    }
+
+    return self;
+  }
+
+  for (guint l = 0; l < n_layers; l++) {
+    WhsMLPLayer *layer = &self->layers[l];
+
+    for (guint i = 0; i < layer->n_out; i++)
+      layer->bias[i] = GFLOAT_FROM_BE (*data++);
+
+    for (guint i = 0; i < layer->n_out; i++)
+      for (guint j = 0; j < layer->n_in; j++)
+        layer->weights[i * layer->stride + j] = GFLOAT_FROM_BE (*data++);
+  }
+
+  return self;
+}
+
+static WhsMLPModel *
+whs_mlp_model_load_legacy (const guint8 *bytes, gsize size, const guint *topology, guint n_topology)
+{
+  const gfloat *data = (const gfloat *) bytes;
+
+  WhsMLPModel *self = whs_mlp_model_new (topology, n_topology, WHS_MLP_ACTIVATION_SIGMOID, WHS_MLP_ACTIVATION_SIGMOID);
+  if (!self)
+    return NULL;
+
+  if (size != sizeof (gfloat) * whs_mlp_model_n_values (self)) {
+    g_warning ("Invalid pattern data size");
+    whs_mlp_model_free (self);
+    return NULL;
+  }
+
+  for (guint l = 0; l < self->n_layers; l++) {
+    WhsMLPLayer *layer = &self->layers[l];
+
+    for (guint i = 0; i < layer->n_out; i++) {
+      layer->bias[i] = GFLOAT_FROM_BE (*data++);
+      for (guint j = 0; j < layer->n_in; j++)
+        layer->weights[i * layer->stride + j] = GFLOAT_FROM_BE (*data++);
+    }
+  }
+
+  return self;
+}
+
+static void
+copy_words (guint32 *dest, const guint32 *src, gsize n, gboolean swapped)
+{
+  if (!swapped) {
+    memcpy (dest, src, sizeof (guint32) * n);
+    return;
+  }
+
+  for (gsize i = 0; i < n; i++)
+    dest[i] = GUINT32_SWAP_LE_BE (src[i]);
+}
+
+/* Size of the native layout of the model */
+static gsize
+whs_mlp_model_native_size (const WhsMLPModel *self)
+{
+  gsize size = NATIVE_ALIGN (sizeof (guint32) * (2 * self->n_layers + 2));
+
+  if (self->quantized)
+    return size + NATIVE_ALIGN (sizeof (gfloat) * self->n_params) + self->n_qparams;
+
+  return size + sizeof (gfloat) * self->n_params;
+}
+
+/* Loads the native layout, swapped if it was written with the other byte
+ * order. The parameters of the model point into bytes if owner is given */
+static WhsMLPModel *
+whs_mlp_model_load_native (const guint8 *bytes, gsize size, gboolean swapped, WhsPattern *owner,
+    const guint *topology, guint n_topology, gboolean quantized)
+{
+  const guint32 *header = (const guint32 *) bytes;
+  guint32 words[2 * WHS_MLP_MAX_LAYERS + 2];
+
+  if (size < sizeof (guint32)) {
+    g_warning ("No topology in the pattern");
+    return NULL;
+  }
+
+  copy_words (words, header, 1, swapped);
+
+  guint n_layers = words[0];
+  if (n_layers == 0 || n_layers > WHS_MLP_MAX_LAYERS || size < sizeof (guint32) * (2 * n_layers + 2)) {
+    g_warning ("Invalid topology in the pattern");
+    return NULL;
+  }
+
+  copy_words (words, header, 2 * n_layers + 2, swapped);
+
+  guint widths[WHS_MLP_MAX_LAYERS + 1];
+  for (guint l = 0; l <= n_layers; l++)
+    widths[l] = words[1 + l];
+
+  if (topology && (n_topology != n_layers + 1 || memcmp (widths, topology, sizeof (guint) * n_topology) != 0)) {
+    g_warning ("Pattern doesn't match the topology of the classifier");
+    return NULL;
+  }
+
+  WhsMLPModel *self = whs_mlp_model_alloc (widths, n_layers + 1, WHS_MLP_ACTIVATION_SIGMOID, WHS_MLP_ACTIVATION_SIGMOID, quantized, TRUE);
+  if (!self)
+    return NULL;
+
+  for (guint l = 0; l < n_layers; l++) {
+    WhsMLPActivation activation = words[n_layers + 2 + l];
+
+    if (!valid_activation (self, l, activation) || (topology && activation != WHS_MLP_ACTIVATION_SIGMOID)) {
+      g_warning ("Invalid activation function %u", activation);
+      whs_mlp_model_free (self);
+      return NULL;
+    }
+    self->layers[l].activation = activation;
+  }
+
+  if (size != whs_mlp_model_native_size (self)) {
+    g_warning ("Invalid pattern data size");
+    whs_mlp_model_free (self);
+    return NULL;
+  }
+
+  const guint8 *params = bytes + NATIVE_ALIGN (sizeof (guint32) * (2 * n_layers + 2));
+  const guint8 *qparams = params + NATIVE_ALIGN (sizeof (gfloat) * self->n_params);
+
+  // The padding is zero as written by whs_mlp_model_save ()
+  if (owner) {
+    self->owner = WHS_PATTERN_CAST (whs_object_ref (owner));
+    whs_mlp_model_assign (self, (gfloat *) params, (gint8 *) ((quantized) ? qparams : NULL));
+    return self;
+  }
+
+  gfloat *p = alloc_aligned (self->n_params, &self->params_mem);
+  gint8 *q = (quantized) ? alloc_aligned ((self->n_qparams + 3) / 4, &self->qparams_mem) : NULL;
+
+  copy_words ((guint32 *) p, (const guint32 *) params, self->n_params, swapped);
+  if (quantized)
+    memcpy (q, qparams, self->n_qparams);
+
+  whs_mlp_model_assign (self, p, q);
+
+  return self;
+}
+
+/* Returns the shared model for the pattern data of classifier, the
+ * legacy layout is used for portable data if topology is given.
+ * Native data in the byte order of the host is used in place */
+WhsMLPModel *
+whs_mlp_model_load (const gchar *classifier, WhsPattern *pattern, const guint *topology, guint n_topology, gboolean quantized)
+{
+  g_return_val_if_fail (classifier != NULL, NULL);
+  g_return_val_if_fail (WHS_IS_PATTERN (pattern), NULL);
+
+  WhsPatternLayout layout;
+  gsize size;
+  const guint8 *data = whs_pattern_get_classifier_data (pattern, classifier, &size, &layout);
+  gchar *key;
+
+  if (!data)
+    return NULL;
+
+  // Mapped data is only identified by its address, hashing
+  // it would read all of it
+  gboolean in_place = (layout == WHS_PATTERN_LAYOUT_NATIVE && ((gsize) data & (ALIGNMENT - 1)) == 0);
+
+  if (in_place) {
+    key = g_strdup_printf ("%s@%p", classifier, data);
+  } else {
+    GChecksum *checksum = g_checksum_new (G_CHECKSUM_SHA1);
+    g_checksum_update (checksum, (const guchar *) classifier, strlen (classifier) + 1);
+    g_checksum_update (checksum, data, size);
+    key = g_strdup (g_checksum_get_string (checksum));
+    g_checksum_free (checksum);
+  }
+
+  G_LOCK (models);
+
+  if (!models)
+    models = g_hash_table_new (g_str_hash, g_str_equal);
+
+  WhsMLPModel *self = g_hash_table_lookup (models, key);
+  if (self) {
+    g_atomic_int_inc (&self->refcount);
+    g_free (key);
+  } else {
+    if (layout != WHS_PATTERN_LAYOUT_PORTABLE)
+      self = whs_mlp_model_load_native (data, size, layout == WHS_PATTERN_LAYOUT_SWAPPED, (in_place) ? pattern : NULL,
+          topology, n_topology, quantized);
+    else if (topology)
+      self = whs_mlp_model_load_legacy (data, size, topology, n_topology);
+    else
+      self = whs_mlp_model_load_generic (data, size, quantized);
+
+    if (self) {
+      self->key = key;
+      g_hash_table_insert (models, self->key, self);
+    } else {
+      g_free (key);
+    }
+  }
+
+  G_UNLOCK (models);
+
+  return self;
+}
+
+/* Returns the model in the native layout */
+guint8 *
+whs_mlp_model_save (const WhsMLPModel *self, gsize *size)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (size != NULL, NULL);
+
+  guint n_layers = self->n_layers;
+  guint8 *ret;
+
+  *size = whs_mlp_model_native_size (self);
+  ret = g_malloc0 (*size);
+
+  guint32 *header = (guint32 *) ret;
+  header[0] = n_layers;
+  header[1] = self->layers[0].n_in;
+  for (guint l = 0; l < n_layers; l++) {
+    header[2 + l] = self->layers[l].n_out;
+    header[n_layers + 2 + l] = self->layers[l].activation;
+  }
+
+  guint8 *params = ret + NATIVE_ALIGN (sizeof (guint32) * (2 * n_layers + 2));
+
+  memcpy (params, self->params, sizeof (gfloat) * self->n_params);
+  if (self->quantized)
+    memcpy (params + NATIVE_ALIGN (sizeof (gfloat) * self->n_params), self->layers[0].qweights, self->n_qparams);
+
+  return ret;
+}
+
+/* Weight rows are aligned, the inputs only to floats */
+typedef gfloat WhsMLPV4F __attribute__ ((vector_size (16)));
+typedef gfloat WhsMLPV4FU __attribute__ ((vector_size (16), aligned (4)));
+
+static inline gfloat
+hsum (WhsMLPV4F v)
+{
+  return (v[0] + v[1]) + (v[2] + v[3]);
+}
+
+/* out[i] = bias[i] + sum (weights[i][j] * in[j]), in has to be padded
+ * with zeroes to the stride of the layer. 4 neurons are calculated at
+ * once so their dot products don't wait for each other */
+static void
+whs_mlp_layer_gemv (const WhsMLPLayer *layer, const gfloat *in, gfloat *out)
+{
+  const guint stride = layer->stride;
+  const guint n_out = layer->n_out;
+
+  for (guint i = 0; i < n_out; i += 4) {
+    const gfloat *w = layer->weights + i * stride;
+    WhsMLPV4F acc[4] = { { 0.0f, }, };
+
+    for (guint j = 0; j < stride; j += 4) {
+      const WhsMLPV4F x = *(const WhsMLPV4FU *) (in + j);
+
+      for (guint r = 0; r < 4; r++)
+        acc[r] += *(const WhsMLPV4F *) (w + r * stride + j) * x;
+    }
+
+    for (guint r = 0; r < 4 && i + r < n_out; r++)
+      out[i + r] = layer->bias[i + r] + hsum (acc[r]);
+  }
+}
+
+/* out[b][i] = bias[i] + sum (weights[i][j] * in[b][j]) for the n rows of in.
+ * Tiles of 4 neurons and 2 inputs keep their 8 accumulators in registers,
+ * so each loaded weight vector is used twice and each input vector four
+ * times. Gives exactly the same results as whs_mlp_layer_gemv() */
+static void
+whs_mlp_layer_gemm (const WhsMLPLayer *layer, const gfloat *in, guint in_stride,
+    gfloat *out, guint out_stride, guint n)
+{
+  const guint stride = layer->stride;
+  const guint n_out = layer->n_out;
+  guint b;
+
+  for (b = 0; b + 2 <= n; b += 2) {
+    const gfloat *x0 = in + b * in_stride;
+    const gfloat *x1 = x0 + in_stride;
+    gfloat *o0 = out + b * out_stride;
+    gfloat *o1 = o0 + out_stride;
+
+    for (guint i = 0; i < n_out; i += 4) {
+      const gfloat *w = layer->weights + i * stride;
+      WhsMLPV4F acc0[4] = { { 0.0f, }, };
+      WhsMLPV4F acc1[4] = { { 0.0f, }, };
+
+      for (guint j = 0; j < stride; j += 4) {
+        const WhsMLPV4F y0 = *(const WhsMLPV4FU *) (x0 + j);
+        const WhsMLPV4F y1 = *(const WhsMLPV4FU *) (x1 + j);
+
+        for (guint r = 0; r < 4; r++) {
+          const WhsMLPV4F v = *(const WhsMLPV4F *) (w + r * stride + j);
+
+          acc0[r] += v * y0;
+          acc1[r] += v * y1;
+        }
+      }
+
+      for (guint r = 0; r < 4 && i + r < n_out; r++) {
+        o0[i + r] = layer->bias[i + r] + hsum (acc0[r]);
+        o1[i + r] = layer->bias[i + r] + hsum (acc1[r]);
+      }
+    }
+  }
+
+  if (b < n)
+    whs_mlp_layer_gemv (layer, in + b * in_stride, out + b * out_stride);
+}
+
+/* out[i] = bias[i] + scale[i] * s * sum (qweights[i][j] * q[j]), where the
+ * input is quantized to q[j] = round (in[j] / s) with s = max (|in|) / 127.
+ * The padding of the quantized input doesn't need to be zero, as the
+ * weights are zero there */
+static void
+whs_mlp_layer_q8 (const WhsMLPLayer *layer, const gfloat *in, gfloat *out, WhsMLPScratch *scratch)
+{
+  const guint n_in = layer->n_in;
+  gfloat max = 0.0f, s;
+
+  for (guint j = 0; j < n_in; j++)
+    max = MAX (max, fabsf (in[j]));
+
+  s = (max > 0.0f) ? max / 127.0f : 1.0f;
+
+  for (guint j = 0; j < n_in; j++)
+    scratch->qinput[j] = CLAMP (lrintf (in[j] / s), -127, 127);
+
+  whs_dsp_get_functions ()->dot_s8 (scratch->qacc, layer->qweights, scratch->qinput,
+      WHS_MLP_Q8_STRIDE (n_in), layer->n_out);
+
+  for (guint i = 0; i < layer->n_out; i++)
+    out[i] = layer->bias[i] + (layer->scale[i] * s) * scratch->qacc[i];
+}
+
+/* Normalizes the outputs to probabilities, exp (x - max) keeps all
+ * exponentials in (0, 1]. The approximation uses exp (x) = s / (1 - s)
+ * with s = sigmoid (x), which is exact enough as s <= 0.5 for x <= 0 */
+static void
+whs_mlp_layer_softmax (gfloat *out, guint n_out, gboolean exact)
+{
+  gfloat max = out[0], sum = 0.0f;
+
+  for (guint i = 1; i < n_out; i++)
+    max = MAX (max, out[i]);
+
+  if (exact) {
+    for (guint i = 0; i < n_out; i++)
+      out[i] = expf (out[i] - max);
+  } else {
+    for (guint i = 0; i < n_out; i++)
+      out[i] -= max;
+
+    whs_dsp_get_functions ()->sigmoid (out, n_out);
+
+    for (guint i = 0; i < n_out; i++)
+      out[i] = out[i] / (1.0f - out[i]);
+  }
+
+  for (guint i = 0; i < n_out; i++)
+    sum += out[i];
+  for (guint i = 0; i < n_out; i++)
+    out[i] /= sum;
+}
+
+/* Applies the activation function to the n_out outputs of the layer,
+ * either with libm or with the vectorized sigmoid of whsdsp.
+ * tanh (x) = 2 * sigmoid (2 * x) - 1 */
+static void
+whs_mlp_layer_activate (const WhsMLPLayer *layer, gfloat *out, gboolean exact)
+{
+  const guint n_out = layer->n_out;
+
+  if (layer->activation == WHS_MLP_ACTIVATION_SOFTMAX) {
+    whs_mlp_layer_softmax (out, n_out, exact);
+  } else if (exact) {
+    for (guint i = 0; i < n_out; i++)
+      out[i] = activate (layer->activation, out[i]);
+  } else if (layer->activation == WHS_MLP_ACTIVATION_TANH) {
+    for (guint i = 0; i < n_out; i++)
+      out[i] *= 2.0f;
+
+    whs_dsp_get_functions ()->sigmoid (out, n_out);
+
+    for (guint i = 0; i < n_out; i++)
+      out[i] = 2.0f * out[i] - 1.0f;
+  } else {
+    whs_dsp_get_functions ()->sigmoid (out, n_out);
+  }
+}
+
+/* Runs the network on in, the outputs of all layers are kept in
+ * scratch. Returns the output of the last layer. The activation
+ * functions are approximated unless exact is TRUE */
+const gfloat *
+whs_mlp_model_forward (const WhsMLPModel *self, WhsMLPScratch *scratch, const gfloat *in, gboolean exact)
+{
+  if (self->layers[0].stride != N_INPUTS) {
+    memcpy (scratch->input, in, sizeof (gfloat) * N_INPUTS);
+    in = scratch->input;
+  }
+
+  for (guint l = 0; l < self->n_layers; l++) {
+    if (self->quantized)
+      whs_mlp_layer_q8 (&self->layers[l], in, scratch->out[l], scratch);
+    else
+      whs_mlp_layer_gemv (&self->layers[l], in, scratch->out[l]);
+    whs_mlp_layer_activate (&self->layers[l], scratch->out[l], exact);
+    in = scratch->out[l];
+  }
+
+  return in;
+}
+
+/* Runs the network on n <= scratch->n_batch inputs of N_INPUTS values each,
+ * one layer after another. Returns the outputs of the last layer, the one
+ * of input b is at b * WHS_MLP_STRIDE (n_out) */
+const gfloat *
+whs_mlp_model_forward_batch (const WhsMLPModel *self, WhsMLPScratch *scratch, const gfloat *in, guint n, gboolean exact)
+{
+  guint in_stride = N_INPUTS;
+
+  g_return_val_if_fail (n <= scratch->n_batch, NULL);
+
+  for (guint l = 0; l < self->n_layers; l++) {
+    guint out_stride = WHS_MLP_STRIDE (self->layers[l].n_out);
+
+    if (self->quantized) {
+      for (guint b = 0; b < n; b++)
+        whs_mlp_layer_q8 (&self->layers[l], in + b * in_stride, scratch->out[l] + b * out_stride, scratch);
+    } else {
+      whs_mlp_layer_gemm (&self->layers[l], in, in_stride, scratch->out[l], out_stride, n);
+    }
+    for (guint b = 0; b < n; b++)
+      whs_mlp_layer_activate (&self->layers[l], scratch->out[l] + b * out_stride, exact);
+    in = scratch->out[l];
+    in_stride = out_stride;
+  }
+
+  return in;
+}
+
+/* Calculates the deltas of all layers for the outputs of input b in
+ * scratch. label is the index of the expected output, or any non-zero
+ * value for a whistle if the network has a single output. Softmax is
+ * trained on the cross entropy, where its derivative cancels out */
+void
+whs_mlp_model_backward (const WhsMLPModel *self, WhsMLPScratch *scratch, guint b, gint32 label)
+{
+  const WhsMLPLayer *layers = self->layers;
+  gint n_layers = self->n_layers;
+  const WhsMLPLayer *output = &layers[n_layers - 1];
+  const guint out_stride = WHS_MLP_STRIDE (output->n_out);
+  const gfloat *o = scratch->out[n_layers - 1] + b * out_stride;
+  gfloat *delta = scratch->delta[n_layers - 1] + b * out_stride;
+
+  for (guint k = 0; k < output->n_out; k++) {
+    gfloat target = (output->n_out == 1) ? (label > 0) : (k == label);
+
+    if (output->activation == WHS_MLP_ACTIVATION_SOFTMAX)
+      delta[k] = target - o[k];
+    else
+      delta[k] = activate_derivative (output->activation, o[k]) * (target - o[k]);
+  }
+
+  for (gint l = n_layers - 2; l >= 0; l--) {
+    const WhsMLPLayer *next = &layers[l + 1];
+    const WhsMLPLayer *layer = &layers[l];
+    const guint stride = WHS_MLP_STRIDE (layer->n_out);
+    const gfloat *next_delta = scratch->delta[l + 1] + b * WHS_MLP_STRIDE (next->n_out);
+
+    o = scratch->out[l] + b * stride;
+    delta = scratch->delta[l] + b * stride;
+
+    for (guint i = 0; i < layer->n_out; i++)
+      delta[i] = 0.0f;
+
+    for (guint k = 0; k < next->n_out; k++) {
+      const gfloat *w = next->weights + k * next->stride;
+      const gfloat d = next_delta[k];
+
+      for (guint i = 0; i < layer->n_out; i++)
+        delta[i] += w[i] * d;
+    }
+
+    for (guint i = 0; i < layer->n_out; i++)
+      delta[i] *= activate_derivative (layer->activation, o[i]);
+  }
+}
+
+/* Sets the result for the outputs of the network. Networks with several
+ * outputs give the score of every class, output 0 is the score for no
+ * whistle */
+void
+whs_mlp_model_get_result (const WhsMLPModel *self, const gfloat *out, WhsResult *res)
+{
+  guint n_out = self->layers[self->n_layers - 1].n_out;
+
+  if (n_out == 1) {
+    res->result = out[0];
+    res->n_classes = 0;
+    return;
+  }
+
+  res->n_classes = n_out;
+  res->result = 0.0f;
+  for (guint c = 0; c < n_out; c++) {
+    res->scores[c] = out[c];
+    if (c > 0)
+      res->result = MAX (res->result, out[c]);
+  }
+}
+
+WhsMLPScratch *
+whs_mlp_scratch_new (const WhsMLPModel *model, guint n_batch)
+{
+  g_return_val_if_fail (model != NULL, NULL);
+  g_return_val_if_fail (n_batch > 0, NULL);
+
+  WhsMLPScratch *self = g_slice_new0 (WhsMLPScratch);
+
+  self->n_batch = n_batch;
+
+  gsize n_scratch = WHS_MLP_STRIDE (N_INPUTS);
+  for (guint l = 0; l < model->n_layers; l++)
+    n_scratch += 2 * n_batch * WHS_MLP_STRIDE (model->layers[l].n_out);
+
+  gfloat *scratch = alloc_aligned (n_scratch, &self->mem);
+
+  self->input = scratch;
+  scratch += WHS_MLP_STRIDE (N_INPUTS);
+
+  for (guint l = 0; l < model->n_layers; l++) {
+    self->out[l] = scratch;
+    scratch += n_batch * WHS_MLP_STRIDE (model->layers[l].n_out);
+    self->delta[l] = scratch;
+    scratch += n_batch * WHS_MLP_STRIDE (model->layers[l].n_out);
+  }
+
+  if (model->quantized) {
+    guint max_in = 0, max_out = 0;
+
+    for (guint l = 0; l < model->n_layers; l++) {
+      max_in = MAX (max_in, model->layers[l].n_in);
+      max_out = MAX (max_out, model->layers[l].n_out);
+    }
+
+    self->qacc = alloc_aligned (max_out + WHS_MLP_Q8_STRIDE (max_in) / 4, &self->qmem);
+    self->qinput = (gint8 *) (self->qacc + max_out);
+  }
+
+  return self;
+}
+
+void
+whs_mlp_scratch_free (WhsMLPScratch *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_free (self->mem);
+  g_free (self->qmem);
+  g_slice_free (WhsMLPScratch, self);
+}
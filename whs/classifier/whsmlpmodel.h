@@ -0,0 +1,132 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WHS_MLP_MODEL_H__
+#define __WHS_MLP_MODEL_H__
+
+#include <glib.h>
+#include "whs.h"
+#include "whspattern.h"
+
+G_BEGIN_DECLS
+
+#define WHS_MLP_MAX_LAYERS (16)
+#define WHS_MLP_MAX_WIDTH (4096)
+
+/* Rows of weights and layer outputs are padded to a multiple of 8 floats */
+#define WHS_MLP_STRIDE(n) (((n) + 7) & ~7)
+
+/* Rows of int8 weights are padded to a multiple of 32 bytes */
+#define WHS_MLP_Q8_STRIDE(n) (((n) + 31) & ~31)
+
+typedef struct _WhsMLPLayer WhsMLPLayer;
+typedef struct _WhsMLPModel WhsMLPModel;
+typedef struct _WhsMLPScratch WhsMLPScratch;
+
+/* Softmax is only possible for the output layer of
+ * networks with more than one output */
+typedef enum {
+  WHS_MLP_ACTIVATION_SIGMOID = 0,
+  WHS_MLP_ACTIVATION_TANH = 1,
+  WHS_MLP_ACTIVATION_SOFTMAX = 2
+} WhsMLPActivation;
+
+struct _WhsMLPLayer
+{
+  guint n_in, n_out;
+  /* row stride of the weight matrix, n_in padded to 8 floats */
+  guint stride;
+  WhsMLPActivation activation;
+
+  /* n_out rows of stride floats, 32 byte aligned. Padded
+   * with zero rows to a multiple of 4 rows */
+  gfloat *weights;
+  gfloat *bias;
+
+  /* Quantized models only, weights is NULL for them. n_out rows of
+   * WHS_MLP_Q8_STRIDE (n_in) values, weights[i][j] = qweights[i][j] * scale[i] */
+  gint8 *qweights;
+  gfloat *scale;
+};
+
+/* Weights of a network. Models loaded from pattern data are shared
+ * between all classifiers using the same data and must not be changed,
+ * only models with a reference count of 1 are writable */
+struct _WhsMLPModel
+{
+  volatile gint refcount;
+  gchar *key;
+
+  /* int8 weights with per row scales, only for inference */
+  gboolean quantized;
+
+  guint n_layers;
+  WhsMLPLayer layers[WHS_MLP_MAX_LAYERS];
+
+  /* weights and biases of all layers */
+  gfloat *params;
+  gsize n_params;
+  /* int8 weights of all layers of quantized models */
+  gsize n_qparams;
+  gpointer params_mem;
+  gpointer qparams_mem;
+
+  /* Pattern whose memory mapped data the parameters point
+   * into, NULL if they are allocated for the model */
+  WhsPattern *owner;
+};
+
+/* Per user buffers for the layer outputs and deltas of up to n_batch
+ * inputs. Row b of layer l starts at out[l] + b * WHS_MLP_STRIDE (n_out) */
+struct _WhsMLPScratch
+{
+  guint n_batch;
+
+  gfloat *input;
+  gfloat *out[WHS_MLP_MAX_LAYERS];
+  gfloat *delta[WHS_MLP_MAX_LAYERS];
+
+  /* quantized input and integer dot products of quantized models */
+  gint8 *qinput;
+  gint32 *qacc;
+
+  gpointer mem;
+  gpointer qmem;
+};
+
+G_GNUC_INTERNAL WhsMLPModel * whs_mlp_model_new (const guint *widths, guint n_widths, WhsMLPActivation activation, WhsMLPActivation output) G_GNUC_MALLOC;
+G_GNUC_INTERNAL WhsMLPModel * whs_mlp_model_load (const gchar *classifier, WhsPattern *pattern, const guint *topology, guint n_topology, gboolean quantized);
+G_GNUC_INTERNAL guint8 * whs_mlp_model_save (const WhsMLPModel *self, gsize *size) G_GNUC_MALLOC;
+G_GNUC_INTERNAL WhsMLPModel * whs_mlp_model_copy (const WhsMLPModel *self) G_GNUC_MALLOC;
+G_GNUC_INTERNAL WhsMLPModel * whs_mlp_model_quantize (const WhsMLPModel *self) G_GNUC_MALLOC;
+
+G_GNUC_INTERNAL WhsMLPModel * whs_mlp_model_ref (WhsMLPModel *self);
+G_GNUC_INTERNAL void whs_mlp_model_unref (WhsMLPModel *self);
+
+G_GNUC_INTERNAL void whs_mlp_model_randomize (WhsMLPModel *self, GRand *rand);
+G_GNUC_INTERNAL const gfloat * whs_mlp_model_forward (const WhsMLPModel *self, WhsMLPScratch *scratch, const gfloat *in, gboolean exact);
+G_GNUC_INTERNAL const gfloat * whs_mlp_model_forward_batch (const WhsMLPModel *self, WhsMLPScratch *scratch, const gfloat *in, guint n, gboolean exact);
+G_GNUC_INTERNAL void whs_mlp_model_backward (const WhsMLPModel *self, WhsMLPScratch *scratch, guint b, gint32 label);
+G_GNUC_INTERNAL void whs_mlp_model_get_result (const WhsMLPModel *self, const gfloat *out, WhsResult *res);
+
+G_GNUC_INTERNAL WhsMLPScratch * whs_mlp_scratch_new (const WhsMLPModel *model, guint n_batch) G_GNUC_MALLOC;
+G_GNUC_INTERNAL void whs_mlp_scratch_free (WhsMLPScratch *self);
+
+G_END_DECLS
+
+#endif /* __WHS_MLP_MODEL_H__ */
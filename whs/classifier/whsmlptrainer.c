@@ -0,0 +1,762 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "whsmlptrainer.h"
+#include "whsclassifier.h"
+#include "whsprivate.h"
+
+#include <math.h>
+#include <string.h>
+
+/* Training of the MLP models, either online after every value or on
+ * mini-batches. Every batch is split into one shard per thread and the
+ * gradients of the shards are summed in a fixed order, so the result
+ * only depends on the initial weights and the number of threads. The
+ * weights after every epoch are rated on the same threads while the
+ * next epoch is trained, shard by shard together with it.
+ *
+ * The values are used in place in the feature store, which can be a
+ * mapped state file, in the order of the store. Only batches that span
+ * two runs of contiguous values are copied */
+
+#define N_INPUTS (G_N_ELEMENTS (((WhsFeatureVector *) NULL)->mfcc))
+
+/* Consecutive values are similar, so whole blocks
+ * of them are held out for validation */
+#define VALIDATION_BLOCK (100)
+
+/* Epochs on a sample of the values use random chunks of this many
+ * values, 512 KiB of vectors that are read sequentially */
+#define SAMPLE_CHUNK (4096)
+#define SAMPLE_SEED (0x5eed)
+
+/* Every shard propagates at most this many values through the model at
+ * once, so its buffers don't grow with the batch size */
+#define SHARD_CHUNK (256)
+
+/* Backpropagation with momentum, default learn rate and inertia rate */
+#define MOMENTUM_N (0.0001f)
+#define MOMENTUM_A (0.25f)
+
+/* iRprop-, the default learn rate is the initial step size */
+#define RPROP_STEP (0.1f)
+#define RPROP_STEP_MIN (1e-6f)
+#define RPROP_STEP_MAX (50.0f)
+#define RPROP_INCREASE (1.2f)
+#define RPROP_DECREASE (0.5f)
+
+/* Adam */
+#define ADAM_N (0.001f)
+#define ADAM_BETA1 (0.9f)
+#define ADAM_BETA2 (0.999f)
+#define ADAM_EPSILON (1e-8f)
+
+typedef struct _WhsMLPTrainer WhsMLPTrainer;
+typedef struct _WhsMLPShard WhsMLPShard;
+typedef struct _WhsMLPValues WhsMLPValues;
+typedef struct _WhsMLPRun WhsMLPRun;
+typedef struct _WhsMLPRating WhsMLPRating;
+
+/* n contiguous rows of N_INPUTS features and their labels, which are
+ * the values from start on */
+struct _WhsMLPRun
+{
+  const gfloat *vecs;
+  const gint32 *labels;
+  guint start, n;
+};
+
+/* n values in n_runs runs */
+struct _WhsMLPValues
+{
+  WhsMLPRun *runs;
+  guint n_runs, runs_size;
+  guint n;
+};
+
+struct _WhsMLPRating
+{
+  gint correct;
+  gdouble error;
+};
+
+struct _WhsMLPShard
+{
+  WhsMLPTrainer *trainer;
+  WhsMLPScratch *scratch;
+
+  /* Training and validation values of the current batch */
+  guint start, len;
+  guint valid_start, valid_len;
+
+  /* Gradient of the shard, with the layout of the model parameters */
+  gfloat *gradient;
+
+  /* Copies of values that span runs, for scratch->n_batch values */
+  gfloat *vecs;
+  gint32 *labels;
+
+  /* Rating of the snapshot */
+  WhsMLPRating rating, valid_rating;
+};
+
+struct _WhsMLPTrainer
+{
+  WhsMLPModel *model;
+  /* Weights after the last epoch, NULL before the first one is done */
+  const WhsMLPModel *snapshot;
+  const WhsTrainOptions *options;
+  gboolean fast;
+
+  /* Only the snapshot is rated if FALSE */
+  gboolean train;
+  /* Weights are changed after every value */
+  gboolean online;
+  guint batch_size;
+  gfloat learn_rate;
+
+  WhsMLPValues values, valid_values;
+  /* Values of the current epoch, values or a sample of them */
+  const WhsMLPValues *epoch;
+  WhsMLPValues sample;
+
+  WhsMLPShard *shards;
+  guint n_shards;
+
+  /* Per parameter state of the optimizer */
+  gfloat *state[2];
+  guint n_updates;
+
+  GThreadPool *pool;
+  GMutex *lock;
+  GCond *cond;
+  guint pending;
+};
+
+/* Adds n rows to values, to the last run if they follow it */
+static void
+whs_mlp_values_add (WhsMLPValues *values, const gfloat *vecs, const gint32 *labels, guint n)
+{
+  WhsMLPRun *last = (values->n_runs > 0) ? &values->runs[values->n_runs - 1] : NULL;
+
+  if (last && last->vecs + last->n * N_INPUTS == vecs && last->labels + last->n == labels) {
+    last->n += n;
+  } else {
+    if (values->n_runs == values->runs_size) {
+      values->runs_size = MAX (values->runs_size * 2, 16);
+      values->runs = g_renew (WhsMLPRun, values->runs, values->runs_size);
+    }
+
+    last = &values->runs[values->n_runs++];
+    last->vecs = vecs;
+    last->labels = labels;
+    last->start = values->n;
+    last->n = n;
+  }
+
+  values->n += n;
+}
+
+/* Returns the run that contains value i */
+static guint
+whs_mlp_values_find (const WhsMLPValues *values, guint i)
+{
+  guint lo = 0, hi = values->n_runs;
+
+  while (hi - lo > 1) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (values->runs[mid].start <= i)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/* Returns the vectors of len > 0 values from start on and sets labels to
+ * their labels. They are used in place if they lie in one run and copied
+ * to the buffers of shard otherwise */
+static const gfloat *
+whs_mlp_values_get (const WhsMLPValues *values, WhsMLPShard *shard, guint start, guint len, const gint32 **labels)
+{
+  const WhsMLPRun *run = &values->runs[whs_mlp_values_find (values, start)];
+  guint offset = start - run->start;
+
+  if (offset + len <= run->n) {
+    *labels = run->labels + offset;
+    return run->vecs + offset * N_INPUTS;
+  }
+
+  for (guint i = 0; i < len; run++, offset = 0) {
+    guint n = MIN (len - i, run->n - offset);
+
+    memcpy (shard->vecs + i * N_INPUTS, run->vecs + offset * N_INPUTS, sizeof (gfloat) * N_INPUTS * n);
+    memcpy (shard->labels + i, run->labels + offset, sizeof (gint32) * n);
+    i += n;
+  }
+
+  *labels = shard->labels;
+  return shard->vecs;
+}
+
+static void
+whs_mlp_rate (const WhsMLPModel *model, WhsMLPShard *shard, const WhsMLPValues *values,
+    guint start, guint len, WhsMLPRating *rating)
+{
+  WhsMLPScratch *scratch = shard->scratch;
+  const guint stride = WHS_MLP_STRIDE (model->layers[model->n_layers - 1].n_out);
+
+  for (guint i = 0; i < len; i += scratch->n_batch) {
+    guint n = MIN (scratch->n_batch, len - i);
+    const gint32 *labels;
+    const gfloat *in = whs_mlp_values_get (values, shard, start + i, n, &labels);
+    const gfloat *out = whs_mlp_model_forward_batch (model, scratch, in, n, FALSE);
+
+    for (guint b = 0; b < n; b++) {
+      WhsResult res;
+
+      whs_mlp_model_get_result (model, out + b * stride, &res);
+      if (whs_classifier_rate (&res, labels[b], &rating->error))
+        rating->correct++;
+    }
+  }
+}
+
+/* Backpropagation with momentum after a single value */
+static void
+whs_mlp_shard_update_online (WhsMLPShard *shard, const gfloat *in)
+{
+  WhsMLPTrainer *trainer = shard->trainer;
+  WhsMLPModel *model = trainer->model;
+  WhsMLPScratch *scratch = shard->scratch;
+  gfloat *last_change = trainer->state[0];
+
+  for (guint l = 0; l < model->n_layers; l++) {
+    WhsMLPLayer *layer = &model->layers[l];
+    const gfloat *x = (l == 0) ? in : scratch->out[l - 1];
+    gfloat *change_w = last_change + (layer->weights - model->params);
+    gfloat *change_b = last_change + (layer->bias - model->params);
+
+    for (guint i = 0; i < layer->n_out; i++) {
+      const gfloat d = trainer->learn_rate * scratch->delta[l][i];
+      gfloat *w = layer->weights + i * layer->stride;
+      gfloat *c = change_w + i * layer->stride;
+
+      layer->bias[i] += (change_b[i] = d + MOMENTUM_A * change_b[i]);
+      for (guint j = 0; j < layer->n_in; j++)
+        w[j] += (c[j] = d * x[j] + MOMENTUM_A * c[j]);
+    }
+  }
+}
+
+/* Adds the gradient of n values that were propagated through the model
+ * to the gradient of shard */
+static void
+whs_mlp_shard_accumulate (WhsMLPShard *shard, const gfloat *in, const gint32 *labels, guint n)
+{
+  const WhsMLPModel *model = shard->trainer->model;
+  WhsMLPScratch *scratch = shard->scratch;
+  const guint n_out = model->layers[model->n_layers - 1].n_out;
+
+  for (guint l = 0; l < model->n_layers; l++) {
+    const WhsMLPLayer *layer = &model->layers[l];
+    const gfloat *x = (l == 0) ? in : scratch->out[l - 1];
+    const guint x_stride = (l == 0) ? N_INPUTS : WHS_MLP_STRIDE (model->layers[l - 1].n_out);
+    const guint d_stride = WHS_MLP_STRIDE (layer->n_out);
+    gfloat *gradient_w = shard->gradient + (layer->weights - model->params);
+    gfloat *gradient_b = shard->gradient + (layer->bias - model->params);
+
+    for (guint b = 0; b < n; b++) {
+      if (n_out > 1 && labels[b] >= (gint32) n_out)
+        continue;
+
+      const gfloat *delta = scratch->delta[l] + b * d_stride;
+      const gfloat *xb = x + b * x_stride;
+
+      for (guint i = 0; i < layer->n_out; i++) {
+        gfloat *g = gradient_w + i * layer->stride;
+        const gfloat d = delta[i];
+
+        gradient_b[i] += d;
+        for (guint j = 0; j < layer->n_in; j++)
+          g[j] += d * xb[j];
+      }
+    }
+  }
+}
+
+static void
+whs_mlp_shard_run (WhsMLPShard *shard)
+{
+  WhsMLPTrainer *trainer = shard->trainer;
+  const WhsMLPModel *model = trainer->model;
+  WhsMLPScratch *scratch = shard->scratch;
+  const guint n_out = model->layers[model->n_layers - 1].n_out;
+
+  // Rate the snapshot as it is used for classification
+  if (trainer->snapshot) {
+    whs_mlp_rate (trainer->snapshot, shard, trainer->epoch, shard->start, shard->len, &shard->rating);
+    whs_mlp_rate (trainer->snapshot, shard, &trainer->valid_values, shard->valid_start, shard->valid_len, &shard->valid_rating);
+  }
+
+  if (!trainer->train)
+    return;
+
+  if (!trainer->online)
+    memset (shard->gradient, 0, sizeof (gfloat) * model->n_params);
+
+  // The values are propagated in chunks that fit the scratch, the
+  // gradient of each parameter still sums up in the order of the values
+  for (guint c = 0; c < shard->len; c += scratch->n_batch) {
+    guint n = MIN (scratch->n_batch, shard->len - c);
+    const gint32 *labels;
+    const gfloat *in = whs_mlp_values_get (trainer->epoch, shard, shard->start + c, n, &labels);
+
+    whs_mlp_model_forward_batch (model, scratch, in, n, !trainer->fast);
+
+    // Values of classes without an output are not trained
+    for (guint b = 0; b < n; b++)
+      if (n_out == 1 || labels[b] < (gint32) n_out)
+        whs_mlp_model_backward (model, scratch, b, labels[b]);
+
+    // Online training has batches of a single value
+    if (trainer->online) {
+      if (n_out == 1 || labels[0] < (gint32) n_out)
+        whs_mlp_shard_update_online (shard, in);
+    } else {
+      whs_mlp_shard_accumulate (shard, in, labels, n);
+    }
+  }
+}
+
+static void
+whs_mlp_trainer_worker (gpointer data, gpointer user_data)
+{
+  WhsMLPShard *shard = data;
+  WhsMLPTrainer *trainer = shard->trainer;
+
+  whs_mlp_shard_run (shard);
+
+  g_mutex_lock (trainer->lock);
+  if (--trainer->pending == 0)
+    g_cond_signal (trainer->cond);
+  g_mutex_unlock (trainer->lock);
+}
+
+/* Sums the gradients of all shards and changes the weights by them. The
+ * gradients point in the direction of a smaller error. Momentum and Adam
+ * use the mean over the len values, so a learn rate means the same for
+ * every batch size. RPROP only uses the sign */
+static void
+whs_mlp_trainer_update (WhsMLPTrainer *trainer, guint len)
+{
+  WhsMLPModel *model = trainer->model;
+  gfloat *gradient = trainer->shards[0].gradient;
+  gfloat *params = model->params;
+  const gsize n_params = model->n_params;
+  const gfloat scale = 1.0f / len;
+
+  for (guint s = 1; s < trainer->n_shards; s++) {
+    const gfloat *g = trainer->shards[s].gradient;
+
+    for (gsize p = 0; p < n_params; p++)
+      gradient[p] += g[p];
+  }
+
+  trainer->n_updates++;
+
+  switch (trainer->options->optimizer) {
+    case WHS_OPTIMIZER_MOMENTUM: {
+      gfloat *change = trainer->state[0];
+
+      for (gsize p = 0; p < n_params; p++) {
+        change[p] = trainer->learn_rate * gradient[p] * scale + MOMENTUM_A * change[p];
+        params[p] += change[p];
+      }
+      break;
+    }
+    case WHS_OPTIMIZER_RPROP: {
+      gfloat *step = trainer->state[0];
+      gfloat *last = trainer->state[1];
+
+      // Only the sign of the gradient is used. The step size grows while
+      // it doesn't change and the step is skipped if it does
+      for (gsize p = 0; p < n_params; p++) {
+        gfloat g = gradient[p];
+
+        if (g * last[p] > 0.0f) {
+          step[p] = MIN (step[p] * RPROP_INCREASE, RPROP_STEP_MAX);
+        } else if (g * last[p] < 0.0f) {
+          step[p] = MAX (step[p] * RPROP_DECREASE, RPROP_STEP_MIN);
+          g = 0.0f;
+        }
+
+        if (g > 0.0f)
+          params[p] += step[p];
+        else if (g < 0.0f)
+          params[p] -= step[p];
+        last[p] = g;
+      }
+      break;
+    }
+    case WHS_OPTIMIZER_ADAM: {
+      gfloat *m = trainer->state[0];
+      gfloat *v = trainer->state[1];
+      const gfloat n = trainer->learn_rate * sqrt (1.0 - pow (ADAM_BETA2, trainer->n_updates)) /
+          (1.0 - pow (ADAM_BETA1, trainer->n_updates));
+
+      for (gsize p = 0; p < n_params; p++) {
+        const gfloat g = gradient[p] * scale;
+
+        m[p] = ADAM_BETA1 * m[p] + (1.0f - ADAM_BETA1) * g;
+        v[p] = ADAM_BETA2 * v[p] + (1.0f - ADAM_BETA2) * g * g;
+        params[p] += n * m[p] / (sqrtf (v[p]) + ADAM_EPSILON);
+      }
+      break;
+    }
+  }
+}
+
+/* Trains on one batch and rates the snapshot on the given validation
+ * values, the first shard is calculated by the calling thread */
+static void
+whs_mlp_trainer_step (WhsMLPTrainer *trainer, guint start, guint len, guint valid_start, guint valid_len)
+{
+  guint n_shards = trainer->n_shards;
+  guint shard_len = (len + n_shards - 1) / n_shards;
+  guint valid_shard_len = (valid_len + n_shards - 1) / n_shards;
+
+  for (guint s = 0; s < n_shards; s++) {
+    guint offset = MIN (len, s * shard_len);
+    guint valid_offset = MIN (valid_len, s * valid_shard_len);
+
+    trainer->shards[s].start = start + offset;
+    trainer->shards[s].len = MIN (shard_len, len - offset);
+    trainer->shards[s].valid_start = valid_start + valid_offset;
+    trainer->shards[s].valid_len = MIN (valid_shard_len, valid_len - valid_offset);
+  }
+
+  trainer->pending = n_shards - 1;
+  for (guint s = 1; s < n_shards; s++)
+    g_thread_pool_push (trainer->pool, &trainer->shards[s], NULL);
+
+  whs_mlp_shard_run (&trainer->shards[0]);
+
+  if (n_shards > 1) {
+    g_mutex_lock (trainer->lock);
+    while (trainer->pending > 0)
+      g_cond_wait (trainer->cond, trainer->lock);
+    g_mutex_unlock (trainer->lock);
+  }
+
+  if (trainer->train && !trainer->online)
+    whs_mlp_trainer_update (trainer, len);
+}
+
+/* Goes once over the values of the epoch, the validation values are spread
+ * over all batches. Sums up the rating of the snapshot in rating and
+ * valid_rating */
+static void
+whs_mlp_trainer_epoch (WhsMLPTrainer *trainer, WhsMLPRating *rating, WhsMLPRating *valid_rating)
+{
+  guint n = trainer->epoch->n;
+  guint n_valid = trainer->valid_values.n;
+  guint n_steps = (n + trainer->batch_size - 1) / trainer->batch_size;
+
+  for (guint s = 0; s < trainer->n_shards; s++) {
+    memset (&trainer->shards[s].rating, 0, sizeof (WhsMLPRating));
+    memset (&trainer->shards[s].valid_rating, 0, sizeof (WhsMLPRating));
+  }
+
+  for (guint i = 0; i < n_steps; i++) {
+    guint start = i * trainer->batch_size;
+    guint valid_start = ((guint64) i * n_valid) / n_steps;
+    guint valid_end = ((guint64) (i + 1) * n_valid) / n_steps;
+
+    whs_mlp_trainer_step (trainer, start, MIN (trainer->batch_size, n - start), valid_start, valid_end - valid_start);
+  }
+
+  memset (rating, 0, sizeof (WhsMLPRating));
+  memset (valid_rating, 0, sizeof (WhsMLPRating));
+  for (guint s = 0; s < trainer->n_shards; s++) {
+    rating->correct += trainer->shards[s].rating.correct;
+    rating->error += trainer->shards[s].rating.error;
+    valid_rating->correct += trainer->shards[s].valid_rating.correct;
+    valid_rating->error += trainer->shards[s].valid_rating.error;
+  }
+}
+
+/* Splits the values with a label, a fraction of them goes to valid */
+static void
+whs_mlp_values_split (const WhsFeatureStore *store, gfloat fraction, WhsMLPValues *train, WhsMLPValues *valid)
+{
+  guint n = 0;
+
+  memset (train, 0, sizeof (WhsMLPValues));
+  memset (valid, 0, sizeof (WhsMLPValues));
+
+  for (guint i = 0; i < store->n; ) {
+    const gint32 *labels;
+    const WhsFeatureVector *vecs;
+    guint len = whs_feature_store_get_run (store, i, &labels, &vecs);
+
+    for (guint j = 0; j < len; ) {
+      guint block = n / VALIDATION_BLOCK;
+      guint count = 0;
+      WhsMLPValues *to;
+
+      if (labels[j] < 0) {
+        j++;
+        continue;
+      }
+
+      while (j + count < len && count < VALIDATION_BLOCK - n % VALIDATION_BLOCK && labels[j + count] >= 0)
+        count++;
+
+      // Spread the validation blocks evenly
+      to = ((guint) ((block + 1) * fraction) > (guint) (block * fraction)) ? valid : train;
+
+      whs_mlp_values_add (to, vecs[j].mfcc, labels + j, count);
+      n += count;
+      j += count;
+    }
+
+    i += len;
+  }
+}
+
+/* Selects a fraction of the chunks of values at random, in their order */
+static void
+whs_mlp_values_sample (const WhsMLPValues *values, gfloat fraction, GRand *rand, WhsMLPValues *sample)
+{
+  guint n_chunks = (values->n + SAMPLE_CHUNK - 1) / SAMPLE_CHUNK;
+  guint n_picks = CLAMP ((guint) (fraction * n_chunks + 0.5f), 1, n_chunks);
+  guint r = 0;
+
+  sample->n_runs = 0;
+  sample->n = 0;
+
+  // Every chunk is picked with the ratio of the picks and the chunks left
+  for (guint c = 0; c < n_chunks && n_picks > 0; c++) {
+    if ((guint) g_rand_int_range (rand, 0, n_chunks - c) >= n_picks)
+      continue;
+
+    guint start = c * SAMPLE_CHUNK;
+    guint end = MIN (values->n, start + SAMPLE_CHUNK);
+
+    while (values->runs[r].start + values->runs[r].n <= start)
+      r++;
+
+    for (guint i = start; i < end; ) {
+      const WhsMLPRun *run = &values->runs[r];
+      guint offset = i - run->start;
+      guint len = MIN (end - i, run->n - offset);
+
+      whs_mlp_values_add (sample, run->vecs + offset * N_INPUTS, run->labels + offset, len);
+      i += len;
+      if (offset + len == run->n)
+        r++;
+    }
+
+    n_picks--;
+  }
+}
+
+static void
+whs_mlp_values_free (WhsMLPValues *values)
+{
+  g_free (values->runs);
+}
+
+/* Trains the model until one of the conditions of options is met, the
+ * model is left with the weights that reached the rate or the best ones */
+void
+whs_mlp_model_train (WhsMLPModel *self, const WhsFeatureStore *store, const WhsMLPTrainParams *params, const WhsTrainOptions *options)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->key == NULL && !self->quantized);
+  g_return_if_fail (params != NULL && params->n_threads > 0);
+  g_return_if_fail (store != NULL);
+  g_return_if_fail (options != NULL);
+
+  WhsMLPTrainer trainer = { self, NULL, options, params->fast, };
+  gboolean sampled = (options->sample > 0.0f && options->sample < 1.0f);
+  GRand *rand = NULL;
+
+  whs_mlp_values_split (store, options->validation, &trainer.values, &trainer.valid_values);
+  trainer.epoch = &trainer.values;
+
+  if (trainer.values.n == 0) {
+    g_warning ("Nothing to train");
+    whs_mlp_values_free (&trainer.values);
+    whs_mlp_values_free (&trainer.valid_values);
+    return;
+  }
+
+  // RPROP only works well with the gradient over all values
+  trainer.batch_size = params->batch_size;
+  switch (options->optimizer) {
+    case WHS_OPTIMIZER_MOMENTUM:
+      trainer.learn_rate = MOMENTUM_N;
+      if (trainer.batch_size == 0)
+        trainer.batch_size = 1;
+      break;
+    case WHS_OPTIMIZER_RPROP:
+      trainer.learn_rate = RPROP_STEP;
+      if (trainer.batch_size == 0)
+        trainer.batch_size = trainer.values.n;
+      break;
+    case WHS_OPTIMIZER_ADAM:
+      trainer.learn_rate = ADAM_N;
+      if (trainer.batch_size == 0)
+        trainer.batch_size = 32;
+      break;
+  }
+
+  if (options->learn_rate > 0.0f)
+    trainer.learn_rate = options->learn_rate;
+
+  trainer.batch_size = MIN (trainer.batch_size, trainer.values.n);
+
+  // The default learn rate of momentum is for steps after single values,
+  // a step with the mean of a mini-batch goes as far as all of them
+  if (options->optimizer == WHS_OPTIMIZER_MOMENTUM && options->learn_rate <= 0.0f)
+    trainer.learn_rate *= trainer.batch_size;
+
+  trainer.online = (trainer.batch_size == 1 && options->optimizer == WHS_OPTIMIZER_MOMENTUM);
+
+  trainer.n_shards = MIN (params->n_threads, trainer.batch_size);
+  trainer.shards = g_new0 (WhsMLPShard, trainer.n_shards);
+  for (guint s = 0; s < trainer.n_shards; s++) {
+    trainer.shards[s].trainer = &trainer;
+    trainer.shards[s].scratch = whs_mlp_scratch_new (self, MIN ((trainer.batch_size + trainer.n_shards - 1) / trainer.n_shards, SHARD_CHUNK));
+    trainer.shards[s].vecs = g_new (gfloat, trainer.shards[s].scratch->n_batch * N_INPUTS);
+    trainer.shards[s].labels = g_new (gint32, trainer.shards[s].scratch->n_batch);
+    if (!trainer.online)
+      trainer.shards[s].gradient = g_new (gfloat, self->n_params);
+  }
+
+  if (trainer.n_shards > 1) {
+    trainer.lock = g_mutex_new ();
+    trainer.cond = g_cond_new ();
+    trainer.pool = g_thread_pool_new (whs_mlp_trainer_worker, NULL, trainer.n_shards - 1, TRUE, NULL);
+  }
+
+  trainer.state[0] = g_new0 (gfloat, self->n_params);
+  trainer.state[1] = g_new0 (gfloat, self->n_params);
+  if (options->optimizer == WHS_OPTIMIZER_RPROP)
+    for (gsize p = 0; p < self->n_params; p++)
+      trainer.state[0][p] = trainer.learn_rate;
+
+  WhsMLPModel *snapshot = whs_mlp_model_copy (self);
+  WhsMLPModel *best = whs_mlp_model_copy (self);
+  gdouble best_error = G_MAXDOUBLE;
+  guint best_run = 0;
+  GTimer *timer = g_timer_new ();
+  guint n_valid = trainer.valid_values.n;
+
+  if (sampled) {
+    rand = g_rand_new_with_seed (SAMPLE_SEED);
+    trainer.epoch = &trainer.sample;
+  }
+
+  for (guint epoch = 0; ; epoch++) {
+    WhsMLPRating rating, valid_rating;
+    gboolean last = (options->max_epochs > 0 && epoch == options->max_epochs) ||
+        (options->max_time > 0.0 && g_timer_elapsed (timer, NULL) >= options->max_time);
+
+    if (sampled)
+      whs_mlp_values_sample (&trainer.values, options->sample, rand, &trainer.sample);
+
+    // The last epoch is only rated
+    trainer.train = !last;
+    if (trainer.snapshot || trainer.train)
+      whs_mlp_trainer_epoch (&trainer, &rating, &valid_rating);
+
+    guint n = trainer.epoch->n;
+
+    if (trainer.snapshot) {
+      guint run = epoch - 1;
+      gdouble error = (n_valid > 0) ? valid_rating.error / n_valid : rating.error / n;
+      gdouble rate = (n_valid > 0) ? ((gdouble) valid_rating.correct) / n_valid : ((gdouble) rating.correct) / n;
+
+      if (n_valid > 0)
+        g_print ("run %u, %d of %u, rate: %f, mse: %lf, validation %d of %u, rate: %f, mse: %lf\n", run,
+            rating.correct, n, ((gfloat) rating.correct) / n, rating.error / n,
+            valid_rating.correct, n_valid, ((gfloat) valid_rating.correct) / n_valid, valid_rating.error / n_valid);
+      else
+        g_print ("run %u, %d of %u, rate: %f, mse: %lf\n", run, rating.correct, n, ((gfloat) rating.correct) / n, rating.error / n);
+
+      if (rate >= options->rate) {
+        memcpy (best->params, snapshot->params, sizeof (gfloat) * self->n_params);
+        break;
+      }
+
+      if (error < best_error) {
+        best_error = error;
+        best_run = run;
+        memcpy (best->params, snapshot->params, sizeof (gfloat) * self->n_params);
+      } else if (options->patience > 0 && run - best_run >= options->patience) {
+        g_print ("No improvement since run %u, stopping\n", best_run);
+        break;
+      }
+    }
+
+    if (last) {
+      g_print ("Rate not reached, keeping run %u\n", best_run);
+      break;
+    }
+
+    memcpy (snapshot->params, self->params, sizeof (gfloat) * self->n_params);
+    trainer.snapshot = snapshot;
+  }
+
+  memcpy (self->params, best->params, sizeof (gfloat) * self->n_params);
+
+  if (trainer.pool) {
+    g_thread_pool_free (trainer.pool, FALSE, TRUE);
+    g_mutex_free (trainer.lock);
+    g_cond_free (trainer.cond);
+  }
+
+  for (guint s = 0; s < trainer.n_shards; s++) {
+    whs_mlp_scratch_free (trainer.shards[s].scratch);
+    g_free (trainer.shards[s].gradient);
+    g_free (trainer.shards[s].vecs);
+    g_free (trainer.shards[s].labels);
+  }
+
+  if (rand)
+    g_rand_free (rand);
+
+  g_timer_destroy (timer);
+  whs_mlp_model_unref (snapshot);
+  whs_mlp_model_unref (best);
+  g_free (trainer.state[0]);
+  g_free (trainer.state[1]);
+  g_free (trainer.shards);
+  whs_mlp_values_free (&trainer.values);
+  whs_mlp_values_free (&trainer.valid_values);
+  whs_mlp_values_free (&trainer.sample);
+}
@@ -0,0 +1,46 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WHS_MLP_TRAINER_H__
+#define __WHS_MLP_TRAINER_H__
+
+#include <glib.h>
+#include "whslearner.h"
+#include "whsfeaturestore.h"
+#include "whsmlpmodel.h"
+
+G_BEGIN_DECLS
+
+typedef struct _WhsMLPTrainParams WhsMLPTrainParams;
+
+struct _WhsMLPTrainParams
+{
+  /* Number of values whose gradients are summed for one update, 1 updates
+   * after every value and 0 selects the default of the optimizer */
+  guint batch_size;
+  /* Number of threads every batch is split across */
+  guint n_threads;
+  /* train with the approximated activation functions */
+  gboolean fast;
+};
+
+G_GNUC_INTERNAL void whs_mlp_model_train (WhsMLPModel *self, const WhsFeatureStore *store, const WhsMLPTrainParams *params, const WhsTrainOptions *options);
+
+G_END_DECLS
+
+#endif /* __WHS_MLP_TRAINER_H__ */
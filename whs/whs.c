@@ -36,6 +36,10 @@ whs_get_version (void)
 gboolean
 whs_init (void)
 {
+  // The NN classifiers train on several threads
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+
   g_type_init ();
 
   WHS_TYPE_OBJECT;
@@ -23,12 +23,22 @@
 
 G_BEGIN_DECLS
 
+/* Maximum number of output classes of a classifier */
+#define WHS_MAX_CLASSES (16)
+
 typedef struct _WhsResult WhsResult;
 
+/* result is the probability of a whistle. Classifiers with several
+ * output classes also give the score of every class, class 0 means no
+ * whistle and result is the largest score of the other classes then.
+ * n_classes is 0 for classifiers with a single output */
 struct _WhsResult
 {
   gfloat result;
   gfloat location;
+
+  guint n_classes;
+  gfloat scores[WHS_MAX_CLASSES];
 };
 
 gint32 whs_get_version (void) G_GNUC_PURE;
@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <complex.h>
 
 
 /* Adapted from GStreamer's audiochebband element which was written by me.
@@ -43,68 +44,52 @@
  * 
  */
 
+/* The filter is a cascade of biquads (second order sections) in
+ * transposed direct form II:
+ *
+ *   y  = b0 * x + s1
+ *   s1 = b1 * x - a1 * y + s2
+ *   s2 = b2 * x - a2 * y
+ *
+ * Expanding the cascade into one high order polynomial is numerically
+ * fragile for narrow bands at low frequencies, the sections are not.
+ */
 typedef struct
 {
-  gdouble *x;
-  gint x_pos;
-  gdouble *y;
-  gint y_pos;
-} WhsBandpassChannelCtx;
-
-struct _WhsBandpass {
-  guint nchannels;
-
-  gdouble *a;
-  gint num_a;
-  gdouble *b;
-  gint num_b;
-  WhsBandpassChannelCtx *channels;
-};
+  gdouble b0, b1, b2;
+  gdouble a1, a2;
+} WhsBandpassSection;
 
-static inline gdouble
-process (WhsBandpass * bp,
-    WhsBandpassChannelCtx * ctx, gdouble x0)
+typedef struct
 {
-  gdouble val = bp->a[0] * x0;
-  gint i, j;
-
-  for (i = 1, j = ctx->x_pos; i < bp->num_a; i++) {
-    val += bp->a[i] * ctx->x[j];
-    j--;
-    if (j < 0)
-      j = bp->num_a - 1;
-  }
-
-  for (i = 1, j = ctx->y_pos; i < bp->num_b; i++) {
-    val += bp->b[i] * ctx->y[j];
-    j--;
-    if (j < 0)
-      j = bp->num_b - 1;
-  }
+  gfloat b0, b1, b2;
+  gfloat a1, a2;
+} WhsBandpassSectionF;
 
-  if (ctx->x) {
-    ctx->x_pos++;
-    if (ctx->x_pos > bp->num_a - 1)
-      ctx->x_pos = 0;
-    ctx->x[ctx->x_pos] = x0;
-  }
+#define MAX_SECTIONS (16)
 
-  if (ctx->y) {
-    ctx->y_pos++;
-    if (ctx->y_pos > bp->num_b - 1)
-      ctx->y_pos = 0;
+struct _WhsBandpass {
+  guint nchannels;
+  WhsBandpassPrecision precision;
 
-    ctx->y[ctx->y_pos] = val;
-  }
+  guint nsections;
+  WhsBandpassSection *sections;
+  WhsBandpassSectionF *sections_f;
 
-  return val;
-}
+  /* s1 and s2 of every section for every channel */
+  gdouble *state;
+  gfloat *state_f;
+};
 
+/* Calculates the p-th biquad of the lowpass at frequency 1 as
+ *
+ *   x0 + x1 * z^-1 + x2 * z^-2
+ *   --------------------------
+ *    1 - y1 * z^-1 - y2 * z^-2
+ */
 static void
-generate_biquad_coefficients (WhsBandpass * bp,
-    guint poles, gfloat ripple, guint type, gfloat min, gfloat max, guint sample_rate,
-    gint p, gdouble * a0, gdouble * a1, gdouble * a2, gdouble * a3,
-    gdouble * a4, gdouble * b1, gdouble * b2, gdouble * b3, gdouble * b4)
+generate_lowpass_coefficients (guint poles, gfloat ripple, guint type,
+    gint p, gdouble * x0, gdouble * x1, gdouble * x2, gdouble * y1, gdouble * y2)
 {
   gint np = poles / 2;
 
@@ -114,9 +99,6 @@ generate_biquad_coefficients (WhsBandpass * bp,
   /* zero location in s-plane */
   gdouble rz = 0.0, iz = 0.0;
 
-  /* transfer function coefficients for the z-plane */
-  gdouble x0, x1, x2, y1, y2;
-
   /* Calculate pole location for lowpass at frequency 1 */
   {
     gdouble angle = (M_PI / 2.0) * (2.0 * p - 1) / np;
@@ -178,11 +160,11 @@ generate_biquad_coefficients (WhsBandpass * bp,
     m = rp * rp + ip * ip;
     d = 4.0 - 4.0 * rp * t + m * t * t;
 
-    x0 = (t * t) / d;
-    x1 = 2.0 * x0;
-    x2 = x0;
-    y1 = (8.0 - 2.0 * m * t * t) / d;
-    y2 = (-4.0 - 4.0 * rp * t - m * t * t) / d;
+    *x0 = (t * t) / d;
+    *x1 = 2.0 * *x0;
+    *x2 = *x0;
+    *y1 = (8.0 - 2.0 * m * t * t) / d;
+    *y2 = (-4.0 - 4.0 * rp * t - m * t * t) / d;
   } else {
     gdouble t, m, d;
 
@@ -190,234 +172,384 @@ generate_biquad_coefficients (WhsBandpass * bp,
     m = rp * rp + ip * ip;
     d = 4.0 - 4.0 * rp * t + m * t * t;
 
-    x0 = (t * t * iz * iz + 4.0) / d;
-    x1 = (-8.0 + 2.0 * iz * iz * t * t) / d;
-    x2 = x0;
-    y1 = (8.0 - 2.0 * m * t * t) / d;
-    y2 = (-4.0 - 4.0 * rp * t - m * t * t) / d;
+    *x0 = (t * t * iz * iz + 4.0) / d;
+    *x1 = (-8.0 + 2.0 * iz * iz * t * t) / d;
+    *x2 = *x0;
+    *y1 = (8.0 - 2.0 * m * t * t) / d;
+    *y2 = (-4.0 - 4.0 * rp * t - m * t * t) / d;
   }
+}
 
-  /* Convert from lowpass at frequency 1 to bandpass
-   *
-   * Substitute z^(-1) with:
-   *
-   *   -2            -1
-   * -z   + alpha * z   - beta
-   * ----------------------------
-   *         -2            -1
-   * beta * z   - alpha * z   + 1
-   *
-   * alpha = (2*a*b)/(1+b)
-   * beta = (b-1)/(b+1)
-   * a = cos((w1 + w0)/2) / cos((w1 - w0)/2)
-   * b = tan(1/2) * cot((w1 - w0)/2)
-   */
-  {
-    gdouble a, b, d;
-    gdouble alpha, beta;
-    gdouble w0 =
-        2.0 * M_PI * (min / sample_rate);
-    gdouble w1 =
-        2.0 * M_PI * (max / sample_rate);
+/* Roots of c2 * x^2 + c1 * x + c0 */
+static void
+solve_quadratic (double complex c2, double complex c1, double complex c0, double complex *r)
+{
+  double complex d = csqrt (c1 * c1 - 4.0 * c2 * c0);
 
-    a = cos ((w1 + w0) / 2.0) / cos ((w1 - w0) / 2.0);
-    b = tan (1.0 / 2.0) / tan ((w1 - w0) / 2.0);
+  r[0] = (-c1 + d) / (2.0 * c2);
+  r[1] = (-c1 - d) / (2.0 * c2);
+}
 
-    alpha = (2.0 * a * b) / (1.0 + b);
-    beta = (b - 1.0) / (b + 1.0);
+/* Converts a root u of the lowpass at frequency 1 (in z^-1) to the
+ * two roots in z of the bandpass by substituting z^-1 with:
+ *
+ *   -2            -1
+ * -z   + alpha * z   - beta
+ * ----------------------------
+ *         -2            -1
+ * beta * z   - alpha * z   + 1
+ *
+ * alpha = (2*a*b)/(1+b)
+ * beta = (b-1)/(b+1)
+ * a = cos((w1 + w0)/2) / cos((w1 - w0)/2)
+ * b = tan(1/2) * cot((w1 - w0)/2)
+ */
+static void
+lowpass_to_bandpass_root (double complex u, gdouble alpha, gdouble beta, double complex *z)
+{
+  double complex w[2];
+
+  solve_quadratic (u * beta + 1.0, -alpha * (u + 1.0), u + beta, w);
+
+  z[0] = 1.0 / w[0];
+  z[1] = 1.0 / w[1];
+}
+
+/* Splits four roots into two pairs of complex conjugate or
+ * real roots and returns them as 1 + c[1] * z^-1 + c[2] * z^-2 */
+static void
+pair_roots (const double complex *r, gdouble c[2][3])
+{
+  gboolean used[4] = { FALSE, };
+  gint n = 0;
 
-    d = 1.0 + beta * (y1 - beta * y2);
-
-    *a0 = (x0 + beta * (-x1 + beta * x2)) / d;
-    *a1 = (alpha * (-2.0 * x0 + x1 + beta * x1 - 2.0 * beta * x2)) / d;
-    *a2 =
-        (-x1 - beta * beta * x1 + 2.0 * beta * (x0 + x2) +
-        alpha * alpha * (x0 - x1 + x2)) / d;
-    *a3 = (alpha * (x1 + beta * (-2.0 * x0 + x1) - 2.0 * x2)) / d;
-    *a4 = (beta * (beta * x0 - x1) + x2) / d;
-    *b1 = (alpha * (2.0 + y1 + beta * y1 - 2.0 * beta * y2)) / d;
-    *b2 =
-        (-y1 - beta * beta * y1 - alpha * alpha * (1.0 + y1 - y2) +
-        2.0 * beta * (-1.0 + y2)) / d;
-    *b3 = (alpha * (y1 + beta * (2.0 + y1) - 2.0 * y2)) / d;
-    *b4 = (-beta * beta - beta * y1 + y2) / d;
+  for (gint i = 0; i < 4; i++) {
+    gint best = -1;
+    gdouble best_dist = G_MAXDOUBLE;
+
+    if (used[i])
+      continue;
+    used[i] = TRUE;
+
+    for (gint j = 0; j < 4; j++) {
+      // Complex roots go with their conjugate, real ones with another real one
+      gdouble dist = (fabs (cimag (r[i])) > 1e-9) ? cabs (r[j] - conj (r[i])) : fabs (cimag (r[j]));
+
+      if (!used[j] && dist < best_dist) {
+        best = j;
+        best_dist = dist;
+      }
+    }
+    used[best] = TRUE;
+
+    c[n][0] = 1.0;
+    c[n][1] = -creal (r[i] + r[best]);
+    c[n][2] = creal (r[i] * r[best]);
+    n++;
   }
 }
 
 static gdouble
-calculate_gain (gdouble * a, gdouble * b, gint num_a, gint num_b, gdouble zr,
-    gdouble zi)
+calculate_gain (const WhsBandpassSection *s, gdouble w)
 {
-  gdouble sum_ar, sum_ai;
-  gdouble sum_br, sum_bi;
-  gdouble gain_r, gain_i;
+  double complex z = cexp (-I * w);
+  double complex num = s->b0 + s->b1 * z + s->b2 * z * z;
+  double complex den = 1.0 + s->a1 * z + s->a2 * z * z;
 
-  gdouble sum_r_old;
-  gdouble sum_i_old;
+  return cabs (num / den);
+}
 
-  gint i;
+/* Generates the two bandpass sections for the p-th biquad of the lowpass */
+static void
+generate_sections (guint poles, gfloat ripple, guint type, gfloat min, gfloat max,
+    guint sample_rate, gint p, WhsBandpassSection *sections)
+{
+  gdouble x0, x1, x2, y1, y2;
+  gdouble alpha, beta, center;
+  double complex u[2], poles_z[4], zeros_z[4];
+  gdouble den[2][3], num[2][3];
 
-  sum_ar = 0.0;
-  sum_ai = 0.0;
-  for (i = num_a; i >= 0; i--) {
-    sum_r_old = sum_ar;
-    sum_i_old = sum_ai;
+  generate_lowpass_coefficients (poles, ripple, type, p, &x0, &x1, &x2, &y1, &y2);
 
-    sum_ar = (sum_r_old * zr - sum_i_old * zi) + a[i];
-    sum_ai = (sum_r_old * zi + sum_i_old * zr) + 0.0;
-  }
+  {
+    gdouble a, b;
+    gdouble w0 =
+        2.0 * M_PI * (min / sample_rate);
+    gdouble w1 =
+        2.0 * M_PI * (max / sample_rate);
 
-  sum_br = 0.0;
-  sum_bi = 0.0;
-  for (i = num_b; i >= 0; i--) {
-    sum_r_old = sum_br;
-    sum_i_old = sum_bi;
+    a = cos ((w1 + w0) / 2.0) / cos ((w1 - w0) / 2.0);
+    b = tan (1.0 / 2.0) / tan ((w1 - w0) / 2.0);
 
-    sum_br = (sum_r_old * zr - sum_i_old * zi) - b[i];
-    sum_bi = (sum_r_old * zi + sum_i_old * zr) - 0.0;
-  }
-  sum_br += 1.0;
-  sum_bi += 0.0;
+    alpha = (2.0 * a * b) / (1.0 + b);
+    beta = (b - 1.0) / (b + 1.0);
 
-  gain_r =
-      (sum_ar * sum_br + sum_ai * sum_bi) / (sum_br * sum_br + sum_bi * sum_bi);
-  gain_i =
-      (sum_ai * sum_br - sum_ar * sum_bi) / (sum_br * sum_br + sum_bi * sum_bi);
+    center = (w1 + w0) / 2.0;
+  }
 
-  return (sqrt (gain_r * gain_r + gain_i * gain_i));
+  // Every pole and zero of the lowpass becomes two of the bandpass
+  solve_quadratic (-y2, -y1, 1.0, u);
+  lowpass_to_bandpass_root (u[0], alpha, beta, &poles_z[0]);
+  lowpass_to_bandpass_root (u[1], alpha, beta, &poles_z[2]);
+
+  solve_quadratic (x2, x1, x0, u);
+  lowpass_to_bandpass_root (u[0], alpha, beta, &zeros_z[0]);
+  lowpass_to_bandpass_root (u[1], alpha, beta, &zeros_z[2]);
+
+  pair_roots (poles_z, den);
+  pair_roots (zeros_z, num);
+
+  for (gint i = 0; i < 2; i++) {
+    WhsBandpassSection *s = &sections[i];
+    gdouble gain;
+
+    s->b0 = num[i][0];
+    s->b1 = num[i][1];
+    s->b2 = num[i][2];
+    s->a1 = den[i][1];
+    s->a2 = den[i][2];
+
+    /* Normalize to unity gain at band center frequency */
+    gain = calculate_gain (s, center);
+    s->b0 /= gain;
+    s->b1 /= gain;
+    s->b2 /= gain;
+  }
 }
 
 WhsBandpass *
-whs_bandpass_new_full (guint sample_rate, guint type, guint poles, gfloat ripple, guint channels, guint min, guint max)
+whs_bandpass_new_full (guint sample_rate, guint type, guint poles, gfloat ripple,
+    WhsBandpassPrecision precision, guint channels, guint min, guint max)
 {
   g_return_val_if_fail (sample_rate > 0, NULL);
   g_return_val_if_fail (channels > 0, NULL);
+  g_return_val_if_fail (poles >= 4 && poles % 4 == 0 && poles <= 2 * MAX_SECTIONS, NULL);
   g_return_val_if_fail (min < max, NULL);
   g_return_val_if_fail (max <= sample_rate / 2, NULL);
 
   WhsBandpass *self = g_slice_new0 (WhsBandpass);
 
   self->nchannels = channels;
+  self->precision = precision;
+
+  /* Calculate coefficients for the chebyshev filter,
+   * every pole pair of the lowpass gives two sections */
+  self->nsections = poles / 2;
+  self->sections = g_new0 (WhsBandpassSection, self->nsections);
+
+  for (gint p = 1; p <= poles / 4; p++)
+    generate_sections (poles, ripple, type, min, max, sample_rate, p, &self->sections[2 * (p - 1)]);
+
+  if (precision == WHS_BANDPASS_PRECISION_FLOAT) {
+    self->sections_f = g_new0 (WhsBandpassSectionF, self->nsections);
+    for (gint i = 0; i < self->nsections; i++) {
+      self->sections_f[i].b0 = self->sections[i].b0;
+      self->sections_f[i].b1 = self->sections[i].b1;
+      self->sections_f[i].b2 = self->sections[i].b2;
+      self->sections_f[i].a1 = self->sections[i].a1;
+      self->sections_f[i].a2 = self->sections[i].a2;
+    }
+    self->state_f = g_new0 (gfloat, 2 * self->nsections * channels);
+  } else {
+    self->state = g_new0 (gdouble, 2 * self->nsections * channels);
+  }
 
-  /* Calculate coefficients for the chebyshev filter */
-  {
-    gdouble *a, *b;
-    gint i, p;
-
-    self->num_a = poles + 1;
-    self->a = a = g_new0 (gdouble, poles + 5);
-    self->num_b = poles + 1;
-    self->b = b = g_new0 (gdouble, poles + 5);
+  return self;
+}
 
-    self->channels = g_new0 (WhsBandpassChannelCtx, channels);
-    for (i = 0; i < channels; i++) {
-      WhsBandpassChannelCtx *ctx = &self->channels[i];
+WhsBandpass *
+whs_bandpass_new (guint sample_rate, guint channels, guint min, guint max)
+{
+  return whs_bandpass_new_full (sample_rate, 1, 8, 0.0, WHS_BANDPASS_PRECISION_DOUBLE, channels, min, max);
+}
 
-      ctx->x = g_new0 (gdouble, poles + 1);
-      ctx->y = g_new0 (gdouble, poles + 1);
+/* Runs one section after another over the samples so the
+ * coefficients and state of the section can stay in registers */
+static void
+process_float (const WhsBandpassSectionF *sections, guint nsections, gfloat *state,
+    gfloat *in, guint len)
+{
+  for (guint i = 0; i < nsections; i++) {
+    const gfloat b0 = sections[i].b0, b1 = sections[i].b1, b2 = sections[i].b2;
+    const gfloat a1 = sections[i].a1, a2 = sections[i].a2;
+    gfloat s1 = state[2 * i], s2 = state[2 * i + 1];
+
+    for (guint j = 0; j < len; j++) {
+      gfloat x = in[j];
+      gfloat y = b0 * x + s1;
+
+      s1 = b1 * x - a1 * y + s2;
+      s2 = b2 * x - a2 * y;
+      in[j] = y;
     }
 
-    /* Calculate transfer function coefficients */
-    a[4] = 1.0;
-    b[4] = 1.0;
-
-    for (p = 1; p <= poles / 4; p++) {
-      gdouble a0, a1, a2, a3, a4, b1, b2, b3, b4;
-      gdouble *ta = g_new0 (gdouble, poles + 5);
-      gdouble *tb = g_new0 (gdouble, poles + 5);
-
-      generate_biquad_coefficients (self, poles, ripple, type, min, max, sample_rate, p, &a0, &a1, &a2, &a3, &a4, &b1,
-          &b2, &b3, &b4);
-
-      memcpy (ta, a, sizeof (gdouble) * (poles + 5));
-      memcpy (tb, b, sizeof (gdouble) * (poles + 5));
-
-      /* add the new coefficients for the new two poles
-       * to the cascade by multiplication of the transfer
-       * functions */
-      for (i = 4; i < poles + 5; i++) {
-        a[i] =
-            a0 * ta[i] + a1 * ta[i - 1] + a2 * ta[i - 2] + a3 * ta[i - 3] +
-            a4 * ta[i - 4];
-        b[i] =
-            tb[i] - b1 * tb[i - 1] - b2 * tb[i - 2] - b3 * tb[i - 3] -
-            b4 * tb[i - 4];
+    state[2 * i] = s1;
+    state[2 * i + 1] = s2;
+  }
+}
+
+#define BLOCK_SIZE (256)
+
+static void
+process_double (const WhsBandpassSection *sections, guint nsections, gdouble *state,
+    gfloat *in, guint len)
+{
+  gdouble tmp[BLOCK_SIZE];
+
+  // Keep double precision between the sections
+  while (len > 0) {
+    guint n = MIN (len, BLOCK_SIZE);
+
+    for (guint j = 0; j < n; j++)
+      tmp[j] = in[j];
+
+    for (guint i = 0; i < nsections; i++) {
+      const gdouble b0 = sections[i].b0, b1 = sections[i].b1, b2 = sections[i].b2;
+      const gdouble a1 = sections[i].a1, a2 = sections[i].a2;
+      gdouble s1 = state[2 * i], s2 = state[2 * i + 1];
+
+      for (guint j = 0; j < n; j++) {
+        gdouble x = tmp[j];
+        gdouble y = b0 * x + s1;
+
+        s1 = b1 * x - a1 * y + s2;
+        s2 = b2 * x - a2 * y;
+        tmp[j] = y;
       }
-      g_free (ta);
-      g_free (tb);
-    }
 
-    /* Move coefficients to the beginning of the array
-     * and multiply the b coefficients with -1 to move from
-     * the transfer function's coefficients to the difference
-     * equation's coefficients */
-    b[4] = 0.0;
-    for (i = 0; i <= poles; i++) {
-      a[i] = a[i + 4];
-      b[i] = -b[i + 4];
+      state[2 * i] = s1;
+      state[2 * i + 1] = s2;
     }
 
-    /* Normalize to unity gain at band center frequency/
-     * gain is H(wc), wc = center frequency */
-    gdouble w1 =
-        2.0 * M_PI * (((gfloat) min) / ((gfloat) sample_rate));
-    gdouble w2 =
-        2.0 * M_PI * (((gfloat) max) / ((gfloat) sample_rate));
-    gdouble w0 = (w2 + w1) / 2.0;
-    gdouble zr = cos (w0), zi = sin (w0);
-    gdouble gain = calculate_gain (a, b, poles, poles, zr, zi);
-
-    for (i = 0; i <= poles; i++) {
-      a[i] /= gain;
-    }
-  }
+    for (guint j = 0; j < n; j++)
+      in[j] = tmp[j];
 
-  return self;
+    in += n;
+    len -= n;
+  }
 }
 
-WhsBandpass *
-whs_bandpass_new (guint sample_rate, guint channels, guint min, guint max)
+void
+whs_bandpass_process_channel (WhsBandpass *self, guint channel, gfloat *in, guint len)
 {
-  return whs_bandpass_new_full (sample_rate, 1, 8, 0.0, channels, min, max);
+  g_return_if_fail (channel < self->nchannels);
+
+  if (self->precision == WHS_BANDPASS_PRECISION_FLOAT)
+    process_float (self->sections_f, self->nsections,
+        &self->state_f[2 * self->nsections * channel], in, len);
+  else
+    process_double (self->sections, self->nsections,
+        &self->state[2 * self->nsections * channel], in, len);
+}
+
+/* Interleaved input is filtered for several channels at once with
+ * one vector lane per channel. Missing lanes of the last group of
+ * channels are filled with zeros and thrown away afterwards */
+typedef gdouble WhsBandpassV2D __attribute__ ((vector_size (16)));
+typedef gfloat WhsBandpassV4F __attribute__ ((vector_size (16)));
+
+#define DEFINE_PROCESS_INTERLEAVED(name, vtype, ctype, stype, width, sections_field, state_field) \
+static void \
+name (WhsBandpass *self, const gfloat *in, guint nchannels, guint first, \
+    gfloat **out, guint len) \
+{ \
+  const stype *sections = self->sections_field; \
+  ctype *state = self->state_field; \
+  guint nsections = self->nsections; \
+  guint lanes = MIN (width, nchannels - first); \
+  vtype b0[MAX_SECTIONS], b1[MAX_SECTIONS], b2[MAX_SECTIONS]; \
+  vtype a1[MAX_SECTIONS], a2[MAX_SECTIONS]; \
+  vtype s1[MAX_SECTIONS], s2[MAX_SECTIONS]; \
+  \
+  for (guint i = 0; i < nsections; i++) { \
+    b0[i] = b1[i] = b2[i] = a1[i] = a2[i] = s1[i] = s2[i] = (vtype) { 0, }; \
+    for (guint c = 0; c < width; c++) { \
+      b0[i][c] = sections[i].b0; \
+      b1[i][c] = sections[i].b1; \
+      b2[i][c] = sections[i].b2; \
+      a1[i][c] = sections[i].a1; \
+      a2[i][c] = sections[i].a2; \
+    } \
+    for (guint c = 0; c < lanes; c++) { \
+      s1[i][c] = state[2 * nsections * (first + c) + 2 * i]; \
+      s2[i][c] = state[2 * nsections * (first + c) + 2 * i + 1]; \
+    } \
+  } \
+  \
+  for (guint j = 0; j < len; j++) { \
+    vtype x = { 0, }; \
+    \
+    for (guint c = 0; c < lanes; c++) \
+      x[c] = in[j * nchannels + first + c]; \
+    \
+    for (guint i = 0; i < nsections; i++) { \
+      vtype y = b0[i] * x + s1[i]; \
+      \
+      s1[i] = b1[i] * x - a1[i] * y + s2[i]; \
+      s2[i] = b2[i] * x - a2[i] * y; \
+      x = y; \
+    } \
+    \
+    for (guint c = 0; c < lanes; c++) \
+      out[first + c][j] = x[c]; \
+  } \
+  \
+  for (guint i = 0; i < nsections; i++) { \
+    for (guint c = 0; c < lanes; c++) { \
+      state[2 * nsections * (first + c) + 2 * i] = s1[i][c]; \
+      state[2 * nsections * (first + c) + 2 * i + 1] = s2[i][c]; \
+    } \
+  } \
 }
 
+DEFINE_PROCESS_INTERLEAVED (process_interleaved_double, WhsBandpassV2D, gdouble, WhsBandpassSection, 2, sections, state);
+DEFINE_PROCESS_INTERLEAVED (process_interleaved_float, WhsBandpassV4F, gfloat, WhsBandpassSectionF, 4, sections_f, state_f);
+
 void
-whs_bandpass_process (WhsBandpass *self, gfloat **in, guint len)
+whs_bandpass_process_interleaved (WhsBandpass *self, const gfloat *in, guint nchannels,
+    gfloat **out, guint len)
 {
-  for (gint i = 0; i < self->nchannels; i++) {
-    for (gint j = 0; j < len; j++) {
-      in[i][j] = process (self, &self->channels[i], in[i][j]);
-    }
+  g_return_if_fail (nchannels <= self->nchannels);
+
+  if (self->precision == WHS_BANDPASS_PRECISION_FLOAT) {
+    for (guint c = 0; c < nchannels; c += 4)
+      process_interleaved_float (self, in, nchannels, c, out, len);
+  } else {
+    for (guint c = 0; c < nchannels; c += 2)
+      process_interleaved_double (self, in, nchannels, c, out, len);
   }
 }
 
+/* Forgets the past input of channel, as if it was just created */
 void
-whs_bandpass_free (WhsBandpass *self)
+whs_bandpass_reset_channel (WhsBandpass *self, guint channel)
 {
-  if (self->channels) {
-    WhsBandpassChannelCtx *ctx;
-    gint i;
-
-    for (i = 0; i < self->nchannels; i++) {
-      ctx = &self->channels[i];
-      g_free (ctx->x);
-      g_free (ctx->y);
-    }
+  g_return_if_fail (channel < self->nchannels);
 
-    g_free (self->channels);
-    self->channels = NULL;
-  }
+  if (self->precision == WHS_BANDPASS_PRECISION_FLOAT)
+    memset (&self->state_f[2 * self->nsections * channel], 0, 2 * self->nsections * sizeof (gfloat));
+  else
+    memset (&self->state[2 * self->nsections * channel], 0, 2 * self->nsections * sizeof (gdouble));
+}
 
-  if (self->a) {
-    g_free (self->a);
-    self->a = NULL;
-  }
+void
+whs_bandpass_process (WhsBandpass *self, gfloat **in, guint len)
+{
+  for (gint i = 0; i < self->nchannels; i++)
+    whs_bandpass_process_channel (self, i, in[i], len);
+}
 
-  if (self->b) {
-    g_free (self->b);
-    self->b = NULL;
-  }
+void
+whs_bandpass_free (WhsBandpass *self)
+{
+  g_free (self->sections);
+  self->sections = NULL;
+  g_free (self->sections_f);
+  self->sections_f = NULL;
+  g_free (self->state);
+  self->state = NULL;
+  g_free (self->state_f);
+  self->state_f = NULL;
 
   g_slice_free (WhsBandpass, self);
 }
-
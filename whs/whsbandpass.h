@@ -23,12 +23,24 @@
 
 typedef struct _WhsBandpass WhsBandpass;
 
+typedef enum {
+  WHS_BANDPASS_PRECISION_DOUBLE,
+  WHS_BANDPASS_PRECISION_FLOAT
+} WhsBandpassPrecision;
+
 G_GNUC_INTERNAL WhsBandpass *whs_bandpass_new (guint sample_rate, guint channels, guint min, guint max) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
 
-G_GNUC_INTERNAL WhsBandpass *whs_bandpass_new_full (guint sample_rate, guint type, guint poles, gfloat ripple, guint channels, guint min, guint max) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+G_GNUC_INTERNAL WhsBandpass *whs_bandpass_new_full (guint sample_rate, guint type, guint poles, gfloat ripple, WhsBandpassPrecision precision, guint channels, guint min, guint max) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
 
 G_GNUC_INTERNAL void whs_bandpass_process (WhsBandpass *self, gfloat **in, guint len);
 
+G_GNUC_INTERNAL void whs_bandpass_process_channel (WhsBandpass *self, guint channel, gfloat *in, guint len);
+
+/* Filters the first nchannels channels of the interleaved input, the output is planar */
+G_GNUC_INTERNAL void whs_bandpass_process_interleaved (WhsBandpass *self, const gfloat *in, guint nchannels, gfloat **out, guint len);
+
+G_GNUC_INTERNAL void whs_bandpass_reset_channel (WhsBandpass *self, guint channel);
+
 G_GNUC_INTERNAL void whs_bandpass_free (WhsBandpass *self);
 
 #endif /* __WHS_BANDPASS_H__ */
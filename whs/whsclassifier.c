@@ -75,13 +75,19 @@ whs_classifier_new (const gchar *classifier, WhsPattern *pattern)
   g_return_val_if_fail (pattern == NULL || WHS_IS_PATTERN (pattern), NULL);
   g_return_val_if_fail (classifier != NULL && *classifier != '\0', NULL);
 
-  GType type = g_type_from_name (classifier);
+  // "Name:args" passes args to the constructor of Name
+  const gchar *args = strchr (classifier, ':');
+  gchar *name = (args) ? g_strndup (classifier, args - classifier) : g_strdup (classifier);
+
+  GType type = g_type_from_name (name);
+  g_free (name);
   g_return_val_if_fail (type != G_TYPE_INVALID  && g_type_is_a (type, WHS_TYPE_CLASSIFIER), NULL);
 
   WhsClassifierClass *klass = WHS_CLASSIFIER_CLASS (g_type_class_ref (type));
 
-  WhsClassifier *self = klass->constructor (pattern);
-  self->pattern = (pattern) ? WHS_PATTERN_CAST (whs_object_ref (pattern)) : NULL;
+  WhsClassifier *self = klass->constructor (pattern, (args) ? args + 1 : NULL);
+  if (self)
+    self->pattern = (pattern) ? WHS_PATTERN_CAST (whs_object_ref (pattern)) : NULL;
 
   g_type_class_unref (klass);
 
@@ -98,15 +104,80 @@ whs_classifier_process (WhsClassifier *self, const WhsFeatureVector *vec, WhsRes
   WHS_CLASSIFIER_GET_CLASS (self)->process (self, vec, res); 
 }
 
+void
+whs_classifier_process_batch (WhsClassifier *self, const WhsFeatureVector *vecs, guint n, WhsResult *res)
+{
+  g_return_if_fail (WHS_IS_CLASSIFIER (self));
+  g_return_if_fail (vecs != NULL || n == 0);
+  g_return_if_fail (res != NULL || n == 0);
+
+  WhsClassifierClass *klass = WHS_CLASSIFIER_GET_CLASS (self);
+
+  if (klass->process_batch) {
+    klass->process_batch (self, vecs, n, res);
+  } else {
+    for (guint i = 0; i < n; i++)
+      klass->process (self, &vecs[i], &res[i]);
+  }
+}
+
+/* Compares a result with the label of a learned vector, the label is
+ * the index of the expected class or non-zero for any whistle if the
+ * classifier has a single output. Adds the squared error to error and
+ * returns TRUE if the vector was classified correctly */
+gboolean
+whs_classifier_rate (const WhsResult *res, gint32 label, gdouble *error)
+{
+  g_return_val_if_fail (res != NULL, FALSE);
+  g_return_val_if_fail (label >= 0, FALSE);
+
+  if (res->n_classes == 0) {
+    gfloat target = (label > 0) ? 1.0f : 0.0f;
+
+    *error += (res->result - target) * (res->result - target);
+
+    return (target == 0.0f) ? res->result < 0.5f : res->result >= 0.5f;
+  }
+
+  guint best = 0;
+
+  for (guint c = 0; c < res->n_classes; c++) {
+    gfloat target = (c == label) ? 1.0f : 0.0f;
+
+    *error += (res->scores[c] - target) * (res->scores[c] - target);
+    if (res->scores[c] > res->scores[best])
+      best = c;
+  }
+
+  return best == label;
+}
+
 WhsPattern *
-whs_classifier_learn (WhsClassifier *self, const GList *values, gint count, gfloat rate)
+whs_classifier_learn (WhsClassifier *self, const WhsFeatureStore *store, const WhsTrainOptions *options)
 {
   g_return_val_if_fail (WHS_IS_CLASSIFIER (self), NULL);
-  g_return_val_if_fail (values != NULL && count > 0, NULL);
-  g_return_val_if_fail (rate >= 0.0 && rate <= 1.0, NULL);
+  g_return_val_if_fail (store != NULL && store->n > 0, NULL);
+  g_return_val_if_fail (options != NULL, NULL);
+  g_return_val_if_fail (options->rate >= 0.0 && options->rate <= 1.0, NULL);
+  g_return_val_if_fail (options->validation >= 0.0 && options->validation < 1.0, NULL);
+  g_return_val_if_fail (options->optimizer <= WHS_OPTIMIZER_ADAM, NULL);
 
-  WhsPattern *ret = WHS_CLASSIFIER_GET_CLASS (self)->learn (self, values, count, rate); 
+  WhsPattern *ret = WHS_CLASSIFIER_GET_CLASS (self)->learn (self, store, options); 
 
   return ret;
 }
 
+WhsPattern *
+whs_classifier_quantize (WhsClassifier *self)
+{
+  g_return_val_if_fail (WHS_IS_CLASSIFIER (self), NULL);
+
+  WhsClassifierClass *klass = WHS_CLASSIFIER_GET_CLASS (self);
+
+  if (!klass->quantize) {
+    g_warning ("%s can't be quantized", g_type_name (G_TYPE_FROM_INSTANCE (self)));
+    return NULL;
+  }
+
+  return klass->quantize (self);
+}
@@ -23,6 +23,8 @@
 #include "whs.h"
 #include "whsobject.h"
 #include "whspattern.h"
+#include "whslearner.h"
+#include "whsfeaturestore.h"
 
 #include "whsprivate.h"
 
@@ -45,23 +47,35 @@ struct _WhsClassifier
   WhsObject parent;
 
   WhsPattern *pattern;
+
+  /* Number of output classes, 0 if only a single result is given */
+  guint n_classes;
 };
 
 struct _WhsClassifierClass
 {
   WhsObjectClass parent;
 
-  WhsClassifier * (*constructor) (WhsPattern *pattern);
+  /* args are the options given after a ':' in the classifier name, or NULL */
+  WhsClassifier * (*constructor) (WhsPattern *pattern, const gchar *args);
   void (*process) (WhsClassifier *self, const WhsFeatureVector *vec, WhsResult *res);
-  WhsPattern * (*learn) (WhsClassifier *self, const GList *values, gint count, gfloat rate);
+  /* Optional, classifies n vectors at once. Only sets the results */
+  void (*process_batch) (WhsClassifier *self, const WhsFeatureVector *vecs, guint n, WhsResult *res);
+  WhsPattern * (*learn) (WhsClassifier *self, const WhsFeatureStore *store, const WhsTrainOptions *options);
+  /* Optional, returns a pattern for a smaller and faster variant of the classifier */
+  WhsPattern * (*quantize) (WhsClassifier *self);
 };
 
 G_GNUC_INTERNAL GType whs_classifier_get_type (void);
 
 G_GNUC_INTERNAL WhsClassifier *whs_classifier_new (const gchar *classifier, WhsPattern *pattern) G_GNUC_WARN_UNUSED_RESULT G_GNUC_MALLOC;
 G_GNUC_INTERNAL void whs_classifier_process (WhsClassifier *self, const WhsFeatureVector *vec, WhsResult *res);
+G_GNUC_INTERNAL void whs_classifier_process_batch (WhsClassifier *self, const WhsFeatureVector *vecs, guint n, WhsResult *res);
+
+G_GNUC_INTERNAL gboolean whs_classifier_rate (const WhsResult *res, gint32 label, gdouble *error);
 
-G_GNUC_INTERNAL WhsPattern *whs_classifier_learn (WhsClassifier *self, const GList *values, gint count, gfloat rate) G_GNUC_WARN_UNUSED_RESULT G_GNUC_MALLOC;
+G_GNUC_INTERNAL WhsPattern *whs_classifier_learn (WhsClassifier *self, const WhsFeatureStore *store, const WhsTrainOptions *options) G_GNUC_WARN_UNUSED_RESULT G_GNUC_MALLOC;
+G_GNUC_INTERNAL WhsPattern *whs_classifier_quantize (WhsClassifier *self) G_GNUC_WARN_UNUSED_RESULT G_GNUC_MALLOC;
 
 G_END_DECLS
 
@@ -0,0 +1,859 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ *
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "whsdsp.h"
+
+#include <math.h>
+#include <float.h>
+
+#if defined (HAVE_SSE2) || defined (HAVE_AVX2)
+#include <immintrin.h>
+#endif
+
+#ifdef HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+/* All implementations use the same approximations of the logarithm
+ * and the sigmoid, but they round differently: the SIMD mel filters sum
+ * in another order and the AVX2 kernels use fused multiply-adds. The
+ * results of different implementations differ by a few units in the
+ * last place, which is about 1e-6 for the log magnitudes, a relative
+ * 1e-6 for the mel energies and 2e-7 for the sigmoid.
+ *
+ * The natural logarithm is computed as
+ *
+ * x = 2^e * m with m in [sqrt(1/2), sqrt(2)) and
+ * ln(m) = 2 * atanh(t) with t = (m - 1) / (m + 1), |t| < 0.172,
+ * which is approximated by the first four terms of its series.
+ * The relative error is below 1e-7.
+ */
+#define LN_C1 (2.0f)
+#define LN_C3 (2.0f / 3.0f)
+#define LN_C5 (2.0f / 5.0f)
+#define LN_C7 (2.0f / 7.0f)
+
+#define LOG_FLOOR (-500.0f)
+
+/* The sigmoid is computed as 1 / (1 + exp (-|x|)), mirrored for
+ * negative x, so that exp () only sees arguments in [-SIGMOID_MAX, 0]
+ * and no precision is lost in 1 - s for large |x|.
+ *
+ * exp(y) = 2^n * exp(r) with n = round(y / ln(2)) and |r| <= ln(2) / 2,
+ * where r is computed with ln(2) split in two parts and exp(r) is
+ * approximated by the polynomial of the Cephes expf(). The absolute
+ * error of the sigmoid is below 1e-7, the relative error below 2e-7.
+ * Like with expf() the result is 0 for x < -SIGMOID_MAX, otherwise
+ * saturated neurons would produce denormals during training.
+ */
+#define EXP_C1 (0.693359375f)
+#define EXP_C2 (-2.12194440e-4f)
+#define EXP_P0 (1.9875691500e-4f)
+#define EXP_P1 (1.3981999507e-3f)
+#define EXP_P2 (8.3334519073e-3f)
+#define EXP_P3 (4.1665795894e-2f)
+#define EXP_P4 (1.6666665459e-1f)
+#define EXP_P5 (5.0000001201e-1f)
+
+#define SIGMOID_MAX (87.0f)
+
+static inline gfloat
+fast_ln (gfloat x)
+{
+  union
+  {
+    guint32 i;
+    gfloat f;
+  } u;
+  gint e;
+  gfloat m, t, t2;
+
+  u.f = x;
+  e = (gint) ((u.i >> 23) & 0xff) - 127;
+  u.i = (u.i & 0x007fffff) | 0x3f800000;
+  m = u.f;
+
+  if (m > (gfloat) M_SQRT2) {
+    m *= 0.5f;
+    e++;
+  }
+
+  t = (m - 1.0f) / (m + 1.0f);
+  t2 = t * t;
+
+  return e * (gfloat) M_LN2 + t * (LN_C1 + t2 * (LN_C3 + t2 * (LN_C5 + t2 * LN_C7)));
+}
+
+static inline gfloat
+log_magnitude (gfloat x, gfloat bias)
+{
+  gfloat ret;
+
+  if (x <= 0.0f)
+    return LOG_FLOOR;
+
+  // log10 (sqrt (x / (n * n))) = 0.5 * log10 (x) - log10 (n)
+  ret = fast_ln (MAX (x, FLT_MIN)) * (gfloat) (0.5 / M_LN10) - bias;
+
+  return MAX (ret, LOG_FLOOR);
+}
+
+static inline gfloat
+fast_sigmoid (gfloat x)
+{
+  union
+  {
+    guint32 i;
+    gfloat f;
+  } u;
+  gint n;
+  gfloat y, r, p, e, s;
+
+  y = -MIN (fabsf (x), SIGMOID_MAX);
+
+  // y <= 0, so the truncation rounds to the nearest integer
+  n = (gint) (y * (gfloat) M_LOG2E - 0.5f);
+  r = (y - n * EXP_C1) - n * EXP_C2;
+
+  p = EXP_P0;
+  p = p * r + EXP_P1;
+  p = p * r + EXP_P2;
+  p = p * r + EXP_P3;
+  p = p * r + EXP_P4;
+  p = p * r + EXP_P5;
+  p = p * (r * r) + r + 1.0f;
+
+  u.i = (guint32) (n + 127) << 23;
+  e = p * u.f;
+  s = 1.0f / (1.0f + e);
+
+  if (x >= 0.0f)
+    return s;
+
+  return (x >= -SIGMOID_MAX) ? e * s : 0.0f;
+}
+
+/* Generic C implementation */
+
+static void
+window_c (gfloat *out, const gfloat *in, const gfloat *window, guint n)
+{
+  for (guint i = 0; i < n; i++)
+    out[i] = in[i] * window[i];
+}
+
+static void
+power_spectrum_c (gfloat *out, const gfloat *in, guint n)
+{
+  out[0] = in[0] * in[0];
+  out[n / 2] = in[1] * in[1];
+
+  for (guint i = 1; i < n / 2; i++)
+    out[i] = in[2 * i] * in[2 * i] + in[2 * i + 1] * in[2 * i + 1];
+}
+
+static void
+log_magnitude_c (gfloat *data, guint n, guint frame_length)
+{
+  gfloat bias = log10 (frame_length);
+
+  for (guint i = 0; i < n; i++)
+    data[i] = log_magnitude (data[i], bias);
+}
+
+static void
+mel_c (gfloat *out, const gfloat *in, const guint *start, const guint *length,
+    const guint *offset, const gfloat *weights, guint nbins)
+{
+  for (guint bin = 0; bin < nbins; bin++) {
+    const gfloat *x = &in[start[bin]];
+    const gfloat *w = &weights[offset[bin]];
+    gfloat sum = 0.0f;
+
+    for (guint k = 0; k < length[bin]; k++)
+      sum += w[k] * x[k];
+
+    out[bin] = sum;
+  }
+}
+
+static void
+sigmoid_c (gfloat *data, guint n)
+{
+  for (guint i = 0; i < n; i++)
+    data[i] = fast_sigmoid (data[i]);
+}
+
+static void
+dot_s8_c (gint32 *out, const gint8 *weights, const gint8 *in, guint stride, guint n)
+{
+  for (guint i = 0; i < n; i++) {
+    const gint8 *w = weights + i * stride;
+    gint32 sum = 0;
+
+    for (guint j = 0; j < stride; j++)
+      sum += w[j] * in[j];
+
+    out[i] = sum;
+  }
+}
+
+static const WhsDspFunctions dsp_c = {
+  "c",
+  window_c,
+  power_spectrum_c,
+  log_magnitude_c,
+  mel_c,
+  sigmoid_c,
+  dot_s8_c
+};
+
+#ifdef HAVE_SSE2
+
+#define SSE2 __attribute__ ((target ("sse2")))
+
+SSE2 static void
+window_sse2 (gfloat *out, const gfloat *in, const gfloat *window, guint n)
+{
+  guint i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+    _mm_storeu_ps (&out[i], _mm_mul_ps (_mm_loadu_ps (&in[i]), _mm_loadu_ps (&window[i])));
+
+  for (; i < n; i++)
+    out[i] = in[i] * window[i];
+}
+
+SSE2 static void
+power_spectrum_sse2 (gfloat *out, const gfloat *in, guint n)
+{
+  guint i;
+
+  out[0] = in[0] * in[0];
+  out[n / 2] = in[1] * in[1];
+
+  for (i = 1; i + 4 <= n / 2; i += 4) {
+    __m128 a = _mm_loadu_ps (&in[2 * i]);
+    __m128 b = _mm_loadu_ps (&in[2 * i + 4]);
+
+    a = _mm_mul_ps (a, a);
+    b = _mm_mul_ps (b, b);
+
+    // Add real and imaginary parts
+    _mm_storeu_ps (&out[i], _mm_add_ps (_mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0)),
+          _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1))));
+  }
+
+  for (; i < n / 2; i++)
+    out[i] = in[2 * i] * in[2 * i] + in[2 * i + 1] * in[2 * i + 1];
+}
+
+SSE2 static void
+log_magnitude_sse2 (gfloat *data, guint n, guint frame_length)
+{
+  gfloat b = log10 (frame_length);
+  const __m128 bias = _mm_set1_ps (b);
+  const __m128 scale = _mm_set1_ps (0.5 / M_LN10);
+  const __m128 ln2 = _mm_set1_ps (M_LN2);
+  const __m128 sqrt2 = _mm_set1_ps (M_SQRT2);
+  const __m128 one = _mm_set1_ps (1.0f);
+  const __m128 half = _mm_set1_ps (0.5f);
+  const __m128 floor = _mm_set1_ps (LOG_FLOOR);
+  const __m128 min = _mm_set1_ps (FLT_MIN);
+  const __m128i mantissa = _mm_set1_epi32 (0x007fffff);
+  const __m128i exponent = _mm_set1_epi32 (0x3f800000);
+  const __m128i bias_e = _mm_set1_epi32 (127);
+  guint i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m128 x = _mm_loadu_ps (&data[i]);
+    __m128 zero = _mm_cmple_ps (x, _mm_setzero_ps ());
+    __m128i xi, e;
+    __m128 m, big, t, t2, r;
+
+    x = _mm_max_ps (x, min);
+    xi = _mm_castps_si128 (x);
+    e = _mm_sub_epi32 (_mm_srli_epi32 (xi, 23), bias_e);
+    m = _mm_castsi128_ps (_mm_or_si128 (_mm_and_si128 (xi, mantissa), exponent));
+
+    big = _mm_cmpgt_ps (m, sqrt2);
+    m = _mm_sub_ps (m, _mm_and_ps (big, _mm_mul_ps (m, half)));
+    e = _mm_sub_epi32 (e, _mm_castps_si128 (big));
+
+    t = _mm_div_ps (_mm_sub_ps (m, one), _mm_add_ps (m, one));
+    t2 = _mm_mul_ps (t, t);
+
+    r = _mm_add_ps (_mm_set1_ps (LN_C5), _mm_mul_ps (t2, _mm_set1_ps (LN_C7)));
+    r = _mm_add_ps (_mm_set1_ps (LN_C3), _mm_mul_ps (t2, r));
+    r = _mm_add_ps (_mm_set1_ps (LN_C1), _mm_mul_ps (t2, r));
+    r = _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (e), ln2), _mm_mul_ps (t, r));
+
+    r = _mm_max_ps (_mm_sub_ps (_mm_mul_ps (r, scale), bias), floor);
+    r = _mm_or_ps (_mm_and_ps (zero, floor), _mm_andnot_ps (zero, r));
+
+    _mm_storeu_ps (&data[i], r);
+  }
+
+  for (; i < n; i++)
+    data[i] = log_magnitude (data[i], b);
+}
+
+SSE2 static void
+mel_sse2 (gfloat *out, const gfloat *in, const guint *start, const guint *length,
+    const guint *offset, const gfloat *weights, guint nbins)
+{
+  for (guint bin = 0; bin < nbins; bin++) {
+    const gfloat *x = &in[start[bin]];
+    const gfloat *w = &weights[offset[bin]];
+    __m128 acc = _mm_setzero_ps ();
+    gfloat tmp[4], sum;
+    guint k;
+
+    for (k = 0; k + 4 <= length[bin]; k += 4)
+      acc = _mm_add_ps (acc, _mm_mul_ps (_mm_loadu_ps (&w[k]), _mm_loadu_ps (&x[k])));
+
+    _mm_storeu_ps (tmp, acc);
+    sum = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+
+    for (; k < length[bin]; k++)
+      sum += w[k] * x[k];
+
+    out[bin] = sum;
+  }
+}
+
+SSE2 static void
+sigmoid_sse2 (gfloat *data, guint n)
+{
+  const __m128 sign = _mm_set1_ps (-0.0f);
+  const __m128 max = _mm_set1_ps (SIGMOID_MAX);
+  const __m128 log2e = _mm_set1_ps (M_LOG2E);
+  const __m128 half = _mm_set1_ps (0.5f);
+  const __m128 one = _mm_set1_ps (1.0f);
+  const __m128 c1 = _mm_set1_ps (EXP_C1);
+  const __m128 c2 = _mm_set1_ps (EXP_C2);
+  const __m128i bias_e = _mm_set1_epi32 (127);
+  guint i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m128 x = _mm_loadu_ps (&data[i]);
+    __m128 pos = _mm_cmpge_ps (x, _mm_setzero_ps ());
+    __m128 range = _mm_cmpge_ps (x, _mm_sub_ps (_mm_setzero_ps (), max));
+    __m128 y, fn, r, p, e, s;
+    __m128i ni;
+
+    y = _mm_or_ps (_mm_min_ps (_mm_andnot_ps (sign, x), max), sign);
+
+    ni = _mm_cvttps_epi32 (_mm_sub_ps (_mm_mul_ps (y, log2e), half));
+    fn = _mm_cvtepi32_ps (ni);
+    r = _mm_sub_ps (_mm_sub_ps (y, _mm_mul_ps (fn, c1)), _mm_mul_ps (fn, c2));
+
+    p = _mm_add_ps (_mm_mul_ps (_mm_set1_ps (EXP_P0), r), _mm_set1_ps (EXP_P1));
+    p = _mm_add_ps (_mm_mul_ps (p, r), _mm_set1_ps (EXP_P2));
+    p = _mm_add_ps (_mm_mul_ps (p, r), _mm_set1_ps (EXP_P3));
+    p = _mm_add_ps (_mm_mul_ps (p, r), _mm_set1_ps (EXP_P4));
+    p = _mm_add_ps (_mm_mul_ps (p, r), _mm_set1_ps (EXP_P5));
+    p = _mm_add_ps (_mm_add_ps (_mm_mul_ps (p, _mm_mul_ps (r, r)), r), one);
+
+    e = _mm_mul_ps (p, _mm_castsi128_ps (_mm_slli_epi32 (_mm_add_epi32 (ni, bias_e), 23)));
+    s = _mm_div_ps (one, _mm_add_ps (one, e));
+    e = _mm_and_ps (range, e);
+    s = _mm_or_ps (_mm_and_ps (pos, s), _mm_andnot_ps (pos, _mm_mul_ps (e, s)));
+
+    _mm_storeu_ps (&data[i], s);
+  }
+
+  for (; i < n; i++)
+    data[i] = fast_sigmoid (data[i]);
+}
+
+SSE2 static void
+dot_s8_sse2 (gint32 *out, const gint8 *weights, const gint8 *in, guint stride, guint n)
+{
+  for (guint i = 0; i < n; i++) {
+    const gint8 *w = weights + i * stride;
+    __m128i acc = _mm_setzero_si128 ();
+
+    for (guint j = 0; j < stride; j += 16) {
+      __m128i a = _mm_loadu_si128 ((const __m128i *) (w + j));
+      __m128i b = _mm_loadu_si128 ((const __m128i *) (in + j));
+
+      // Sign extension to 16 bit by unpacking into the high bytes
+      acc = _mm_add_epi32 (acc, _mm_madd_epi16 (_mm_srai_epi16 (_mm_unpacklo_epi8 (a, a), 8),
+              _mm_srai_epi16 (_mm_unpacklo_epi8 (b, b), 8)));
+      acc = _mm_add_epi32 (acc, _mm_madd_epi16 (_mm_srai_epi16 (_mm_unpackhi_epi8 (a, a), 8),
+              _mm_srai_epi16 (_mm_unpackhi_epi8 (b, b), 8)));
+    }
+
+    acc = _mm_add_epi32 (acc, _mm_shuffle_epi32 (acc, 0x4e));
+    acc = _mm_add_epi32 (acc, _mm_shuffle_epi32 (acc, 0xb1));
+    out[i] = _mm_cvtsi128_si32 (acc);
+  }
+}
+
+static const WhsDspFunctions dsp_sse2 = {
+  "sse2",
+  window_sse2,
+  power_spectrum_sse2,
+  log_magnitude_sse2,
+  mel_sse2,
+  sigmoid_sse2,
+  dot_s8_sse2
+};
+
+#endif /* HAVE_SSE2 */
+
+#ifdef HAVE_AVX2
+
+#define AVX2 __attribute__ ((target ("avx2,fma")))
+
+AVX2 static void
+window_avx2 (gfloat *out, const gfloat *in, const gfloat *window, guint n)
+{
+  guint i;
+
+  for (i = 0; i + 8 <= n; i += 8)
+    _mm256_storeu_ps (&out[i], _mm256_mul_ps (_mm256_loadu_ps (&in[i]), _mm256_loadu_ps (&window[i])));
+
+  for (; i < n; i++)
+    out[i] = in[i] * window[i];
+}
+
+AVX2 static void
+power_spectrum_avx2 (gfloat *out, const gfloat *in, guint n)
+{
+  guint i;
+
+  out[0] = in[0] * in[0];
+  out[n / 2] = in[1] * in[1];
+
+  for (i = 1; i + 8 <= n / 2; i += 8) {
+    __m256 a = _mm256_loadu_ps (&in[2 * i]);
+    __m256 b = _mm256_loadu_ps (&in[2 * i + 8]);
+    __m256 re, im;
+
+    a = _mm256_mul_ps (a, a);
+    b = _mm256_mul_ps (b, b);
+
+    // The shuffles work per 128 bit lane, restore the order afterwards
+    re = _mm256_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+    im = _mm256_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+    re = _mm256_castpd_ps (_mm256_permute4x64_pd (_mm256_castps_pd (_mm256_add_ps (re, im)), _MM_SHUFFLE (3, 1, 2, 0)));
+
+    _mm256_storeu_ps (&out[i], re);
+  }
+
+  for (; i < n / 2; i++)
+    out[i] = in[2 * i] * in[2 * i] + in[2 * i + 1] * in[2 * i + 1];
+}
+
+AVX2 static void
+log_magnitude_avx2 (gfloat *data, guint n, guint frame_length)
+{
+  gfloat b = log10 (frame_length);
+  const __m256 bias = _mm256_set1_ps (b);
+  const __m256 scale = _mm256_set1_ps (0.5 / M_LN10);
+  const __m256 ln2 = _mm256_set1_ps (M_LN2);
+  const __m256 sqrt2 = _mm256_set1_ps (M_SQRT2);
+  const __m256 one = _mm256_set1_ps (1.0f);
+  const __m256 half = _mm256_set1_ps (0.5f);
+  const __m256 floor = _mm256_set1_ps (LOG_FLOOR);
+  const __m256 min = _mm256_set1_ps (FLT_MIN);
+  const __m256i mantissa = _mm256_set1_epi32 (0x007fffff);
+  const __m256i exponent = _mm256_set1_epi32 (0x3f800000);
+  const __m256i bias_e = _mm256_set1_epi32 (127);
+  guint i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_loadu_ps (&data[i]);
+    __m256 zero = _mm256_cmp_ps (x, _mm256_setzero_ps (), _CMP_LE_OQ);
+    __m256i xi, e;
+    __m256 m, big, t, t2, r;
+
+    x = _mm256_max_ps (x, min);
+    xi = _mm256_castps_si256 (x);
+    e = _mm256_sub_epi32 (_mm256_srli_epi32 (xi, 23), bias_e);
+    m = _mm256_castsi256_ps (_mm256_or_si256 (_mm256_and_si256 (xi, mantissa), exponent));
+
+    big = _mm256_cmp_ps (m, sqrt2, _CMP_GT_OQ);
+    m = _mm256_blendv_ps (m, _mm256_mul_ps (m, half), big);
+    e = _mm256_sub_epi32 (e, _mm256_castps_si256 (big));
+
+    t = _mm256_div_ps (_mm256_sub_ps (m, one), _mm256_add_ps (m, one));
+    t2 = _mm256_mul_ps (t, t);
+
+    r = _mm256_fmadd_ps (t2, _mm256_set1_ps (LN_C7), _mm256_set1_ps (LN_C5));
+    r = _mm256_fmadd_ps (t2, r, _mm256_set1_ps (LN_C3));
+    r = _mm256_fmadd_ps (t2, r, _mm256_set1_ps (LN_C1));
+    r = _mm256_fmadd_ps (_mm256_cvtepi32_ps (e), ln2, _mm256_mul_ps (t, r));
+
+    r = _mm256_max_ps (_mm256_fmsub_ps (r, scale, bias), floor);
+    r = _mm256_blendv_ps (r, floor, zero);
+
+    _mm256_storeu_ps (&data[i], r);
+  }
+
+  for (; i < n; i++)
+    data[i] = log_magnitude (data[i], b);
+}
+
+AVX2 static void
+mel_avx2 (gfloat *out, const gfloat *in, const guint *start, const guint *length,
+    const guint *offset, const gfloat *weights, guint nbins)
+{
+  for (guint bin = 0; bin < nbins; bin++) {
+    const gfloat *x = &in[start[bin]];
+    const gfloat *w = &weights[offset[bin]];
+    __m256 acc = _mm256_setzero_ps ();
+    __m128 acc4;
+    gfloat tmp[4], sum;
+    guint k;
+
+    for (k = 0; k + 8 <= length[bin]; k += 8)
+      acc = _mm256_fmadd_ps (_mm256_loadu_ps (&w[k]), _mm256_loadu_ps (&x[k]), acc);
+
+    acc4 = _mm_add_ps (_mm256_castps256_ps128 (acc), _mm256_extractf128_ps (acc, 1));
+    for (; k + 4 <= length[bin]; k += 4)
+      acc4 = _mm_fmadd_ps (_mm_loadu_ps (&w[k]), _mm_loadu_ps (&x[k]), acc4);
+
+    _mm_storeu_ps (tmp, acc4);
+    sum = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+
+    for (; k < length[bin]; k++)
+      sum += w[k] * x[k];
+
+    out[bin] = sum;
+  }
+}
+
+AVX2 static void
+sigmoid_avx2 (gfloat *data, guint n)
+{
+  const __m256 sign = _mm256_set1_ps (-0.0f);
+  const __m256 max = _mm256_set1_ps (SIGMOID_MAX);
+  const __m256 log2e = _mm256_set1_ps (M_LOG2E);
+  const __m256 half = _mm256_set1_ps (0.5f);
+  const __m256 one = _mm256_set1_ps (1.0f);
+  const __m256 c1 = _mm256_set1_ps (EXP_C1);
+  const __m256 c2 = _mm256_set1_ps (EXP_C2);
+  const __m256i bias_e = _mm256_set1_epi32 (127);
+  guint i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_loadu_ps (&data[i]);
+    __m256 neg = _mm256_cmp_ps (x, _mm256_setzero_ps (), _CMP_LT_OQ);
+    __m256 range = _mm256_cmp_ps (x, _mm256_sub_ps (_mm256_setzero_ps (), max), _CMP_GE_OQ);
+    __m256 y, fn, r, p, e, s;
+    __m256i ni;
+
+    y = _mm256_or_ps (_mm256_min_ps (_mm256_andnot_ps (sign, x), max), sign);
+
+    ni = _mm256_cvttps_epi32 (_mm256_fmsub_ps (y, log2e, half));
+    fn = _mm256_cvtepi32_ps (ni);
+    r = _mm256_fnmadd_ps (fn, c2, _mm256_fnmadd_ps (fn, c1, y));
+
+    p = _mm256_fmadd_ps (_mm256_set1_ps (EXP_P0), r, _mm256_set1_ps (EXP_P1));
+    p = _mm256_fmadd_ps (p, r, _mm256_set1_ps (EXP_P2));
+    p = _mm256_fmadd_ps (p, r, _mm256_set1_ps (EXP_P3));
+    p = _mm256_fmadd_ps (p, r, _mm256_set1_ps (EXP_P4));
+    p = _mm256_fmadd_ps (p, r, _mm256_set1_ps (EXP_P5));
+    p = _mm256_add_ps (_mm256_fmadd_ps (p, _mm256_mul_ps (r, r), r), one);
+
+    e = _mm256_mul_ps (p, _mm256_castsi256_ps (_mm256_slli_epi32 (_mm256_add_epi32 (ni, bias_e), 23)));
+    s = _mm256_div_ps (one, _mm256_add_ps (one, e));
+    e = _mm256_and_ps (range, e);
+    s = _mm256_blendv_ps (s, _mm256_mul_ps (e, s), neg);
+
+    _mm256_storeu_ps (&data[i], s);
+  }
+
+  for (; i < n; i++)
+    data[i] = fast_sigmoid (data[i]);
+}
+
+AVX2 static void
+dot_s8_avx2 (gint32 *out, const gint8 *weights, const gint8 *in, guint stride, guint n)
+{
+  for (guint i = 0; i < n; i++) {
+    const gint8 *w = weights + i * stride;
+    __m256i acc = _mm256_setzero_si256 ();
+    __m128i acc4;
+
+    for (guint j = 0; j < stride; j += 16) {
+      __m256i a = _mm256_cvtepi8_epi16 (_mm_loadu_si128 ((const __m128i *) (w + j)));
+      __m256i b = _mm256_cvtepi8_epi16 (_mm_loadu_si128 ((const __m128i *) (in + j)));
+
+      acc = _mm256_add_epi32 (acc, _mm256_madd_epi16 (a, b));
+    }
+
+    acc4 = _mm_add_epi32 (_mm256_castsi256_si128 (acc), _mm256_extracti128_si256 (acc, 1));
+    acc4 = _mm_add_epi32 (acc4, _mm_shuffle_epi32 (acc4, 0x4e));
+    acc4 = _mm_add_epi32 (acc4, _mm_shuffle_epi32 (acc4, 0xb1));
+    out[i] = _mm_cvtsi128_si32 (acc4);
+  }
+}
+
+static const WhsDspFunctions dsp_avx2 = {
+  "avx2",
+  window_avx2,
+  power_spectrum_avx2,
+  log_magnitude_avx2,
+  mel_avx2,
+  sigmoid_avx2,
+  dot_s8_avx2
+};
+
+#endif /* HAVE_AVX2 */
+
+#ifdef HAVE_NEON
+
+static void
+window_neon (gfloat *out, const gfloat *in, const gfloat *window, guint n)
+{
+  guint i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+    vst1q_f32 (&out[i], vmulq_f32 (vld1q_f32 (&in[i]), vld1q_f32 (&window[i])));
+
+  for (; i < n; i++)
+    out[i] = in[i] * window[i];
+}
+
+static void
+power_spectrum_neon (gfloat *out, const gfloat *in, guint n)
+{
+  guint i;
+
+  out[0] = in[0] * in[0];
+  out[n / 2] = in[1] * in[1];
+
+  for (i = 1; i + 4 <= n / 2; i += 4) {
+    float32x4x2_t v = vld2q_f32 (&in[2 * i]);
+
+    vst1q_f32 (&out[i], vmlaq_f32 (vmulq_f32 (v.val[0], v.val[0]), v.val[1], v.val[1]));
+  }
+
+  for (; i < n / 2; i++)
+    out[i] = in[2 * i] * in[2 * i] + in[2 * i + 1] * in[2 * i + 1];
+}
+
+static void
+log_magnitude_neon (gfloat *data, guint n, guint frame_length)
+{
+  gfloat b = log10 (frame_length);
+  const float32x4_t bias = vdupq_n_f32 (b);
+  const float32x4_t scale = vdupq_n_f32 (0.5 / M_LN10);
+  const float32x4_t ln2 = vdupq_n_f32 (M_LN2);
+  const float32x4_t sqrt2 = vdupq_n_f32 (M_SQRT2);
+  const float32x4_t one = vdupq_n_f32 (1.0f);
+  const float32x4_t half = vdupq_n_f32 (0.5f);
+  const float32x4_t floor = vdupq_n_f32 (LOG_FLOOR);
+  const float32x4_t min = vdupq_n_f32 (FLT_MIN);
+  const uint32x4_t mantissa = vdupq_n_u32 (0x007fffff);
+  const uint32x4_t exponent = vdupq_n_u32 (0x3f800000);
+  const int32x4_t bias_e = vdupq_n_s32 (127);
+  guint i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    float32x4_t x = vld1q_f32 (&data[i]);
+    uint32x4_t zero = vcleq_f32 (x, vdupq_n_f32 (0.0f));
+    uint32x4_t xi, big;
+    int32x4_t e;
+    float32x4_t m, t, t2, r;
+
+    x = vmaxq_f32 (x, min);
+    xi = vreinterpretq_u32_f32 (x);
+    e = vsubq_s32 (vreinterpretq_s32_u32 (vshrq_n_u32 (xi, 23)), bias_e);
+    m = vreinterpretq_f32_u32 (vorrq_u32 (vandq_u32 (xi, mantissa), exponent));
+
+    big = vcgtq_f32 (m, sqrt2);
+    m = vbslq_f32 (big, vmulq_f32 (m, half), m);
+    e = vsubq_s32 (e, vreinterpretq_s32_u32 (big));
+
+    t = vdivq_f32 (vsubq_f32 (m, one), vaddq_f32 (m, one));
+    t2 = vmulq_f32 (t, t);
+
+    r = vmlaq_f32 (vdupq_n_f32 (LN_C5), t2, vdupq_n_f32 (LN_C7));
+    r = vmlaq_f32 (vdupq_n_f32 (LN_C3), t2, r);
+    r = vmlaq_f32 (vdupq_n_f32 (LN_C1), t2, r);
+    r = vmlaq_f32 (vmulq_f32 (t, r), vcvtq_f32_s32 (e), ln2);
+
+    r = vmaxq_f32 (vsubq_f32 (vmulq_f32 (r, scale), bias), floor);
+    r = vbslq_f32 (zero, floor, r);
+
+    vst1q_f32 (&data[i], r);
+  }
+
+  for (; i < n; i++)
+    data[i] = log_magnitude (data[i], b);
+}
+
+static void
+mel_neon (gfloat *out, const gfloat *in, const guint *start, const guint *length,
+    const guint *offset, const gfloat *weights, guint nbins)
+{
+  for (guint bin = 0; bin < nbins; bin++) {
+    const gfloat *x = &in[start[bin]];
+    const gfloat *w = &weights[offset[bin]];
+    float32x4_t acc = vdupq_n_f32 (0.0f);
+    gfloat sum;
+    guint k;
+
+    for (k = 0; k + 4 <= length[bin]; k += 4)
+      acc = vmlaq_f32 (acc, vld1q_f32 (&w[k]), vld1q_f32 (&x[k]));
+
+    sum = (vgetq_lane_f32 (acc, 0) + vgetq_lane_f32 (acc, 1)) +
+        (vgetq_lane_f32 (acc, 2) + vgetq_lane_f32 (acc, 3));
+
+    for (; k < length[bin]; k++)
+      sum += w[k] * x[k];
+
+    out[bin] = sum;
+  }
+}
+
+static void
+sigmoid_neon (gfloat *data, guint n)
+{
+  const float32x4_t max = vdupq_n_f32 (SIGMOID_MAX);
+  const float32x4_t log2e = vdupq_n_f32 (M_LOG2E);
+  const float32x4_t half = vdupq_n_f32 (0.5f);
+  const float32x4_t one = vdupq_n_f32 (1.0f);
+  const float32x4_t c1 = vdupq_n_f32 (EXP_C1);
+  const float32x4_t c2 = vdupq_n_f32 (EXP_C2);
+  const int32x4_t bias_e = vdupq_n_s32 (127);
+  guint i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    float32x4_t x = vld1q_f32 (&data[i]);
+    uint32x4_t pos = vcgeq_f32 (x, vdupq_n_f32 (0.0f));
+    uint32x4_t range = vcgeq_f32 (x, vnegq_f32 (max));
+    float32x4_t y, fn, r, p, e, s;
+    int32x4_t ni;
+
+    y = vnegq_f32 (vminq_f32 (vabsq_f32 (x), max));
+
+    ni = vcvtq_s32_f32 (vsubq_f32 (vmulq_f32 (y, log2e), half));
+    fn = vcvtq_f32_s32 (ni);
+    r = vmlsq_f32 (vmlsq_f32 (y, fn, c1), fn, c2);
+
+    p = vmlaq_f32 (vdupq_n_f32 (EXP_P1), vdupq_n_f32 (EXP_P0), r);
+    p = vmlaq_f32 (vdupq_n_f32 (EXP_P2), p, r);
+    p = vmlaq_f32 (vdupq_n_f32 (EXP_P3), p, r);
+    p = vmlaq_f32 (vdupq_n_f32 (EXP_P4), p, r);
+    p = vmlaq_f32 (vdupq_n_f32 (EXP_P5), p, r);
+    p = vaddq_f32 (vmlaq_f32 (r, p, vmulq_f32 (r, r)), one);
+
+    e = vmulq_f32 (p, vreinterpretq_f32_s32 (vshlq_n_s32 (vaddq_s32 (ni, bias_e), 23)));
+    s = vdivq_f32 (one, vaddq_f32 (one, e));
+    e = vreinterpretq_f32_u32 (vandq_u32 (range, vreinterpretq_u32_f32 (e)));
+    s = vbslq_f32 (pos, s, vmulq_f32 (e, s));
+
+    vst1q_f32 (&data[i], s);
+  }
+
+  for (; i < n; i++)
+    data[i] = fast_sigmoid (data[i]);
+}
+
+static void
+dot_s8_neon (gint32 *out, const gint8 *weights, const gint8 *in, guint stride, guint n)
+{
+  for (guint i = 0; i < n; i++) {
+    const gint8 *w = weights + i * stride;
+    int32x4_t acc = vdupq_n_s32 (0);
+
+    for (guint j = 0; j < stride; j += 16) {
+      int8x16_t a = vld1q_s8 (w + j);
+      int8x16_t b = vld1q_s8 (in + j);
+      // 2 * 127 * 127 still fits into 16 bit
+      int16x8_t p = vmull_s8 (vget_low_s8 (a), vget_low_s8 (b));
+
+      p = vmlal_s8 (p, vget_high_s8 (a), vget_high_s8 (b));
+      acc = vpadalq_s16 (acc, p);
+    }
+
+    out[i] = vaddvq_s32 (acc);
+  }
+}
+
+static const WhsDspFunctions dsp_neon = {
+  "neon",
+  window_neon,
+  power_spectrum_neon,
+  log_magnitude_neon,
+  mel_neon,
+  sigmoid_neon,
+  dot_s8_neon
+};
+
+#endif /* HAVE_NEON */
+
+/* All implementations the CPU supports, from the slowest to the fastest */
+const WhsDspFunctions * const *
+whs_dsp_get_implementations (void)
+{
+  static volatile gsize initialized = 0;
+  static const WhsDspFunctions *implementations[5];
+
+  if (g_once_init_enter (&initialized)) {
+    guint n = 0;
+
+    implementations[n++] = &dsp_c;
+
+#if defined (HAVE_SSE2) || defined (HAVE_AVX2)
+    __builtin_cpu_init ();
+#endif
+
+#ifdef HAVE_SSE2
+    if (__builtin_cpu_supports ("sse2"))
+      implementations[n++] = &dsp_sse2;
+#endif
+
+#ifdef HAVE_AVX2
+    if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma"))
+      implementations[n++] = &dsp_avx2;
+#endif
+
+#ifdef HAVE_NEON
+    implementations[n++] = &dsp_neon;
+#endif
+
+    implementations[n] = NULL;
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return implementations;
+}
+
+const WhsDspFunctions *
+whs_dsp_get_functions (void)
+{
+  const WhsDspFunctions * const *implementations = whs_dsp_get_implementations ();
+  guint n = 0;
+
+  while (implementations[n + 1])
+    n++;
+
+  return implementations[n];
+}
@@ -0,0 +1,62 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ *
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WHS_DSP_H__
+#define __WHS_DSP_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _WhsDspFunctions WhsDspFunctions;
+
+/* Single precision kernels of the feature extraction, the
+ * best implementation for the current CPU is selected at runtime */
+struct _WhsDspFunctions
+{
+  const gchar *name;
+
+  /* out[i] = in[i] * window[i] */
+  void (*window) (gfloat *out, const gfloat *in, const gfloat *window, guint n);
+
+  /* Converts the output of rdftf() for n samples to the power
+   * spectrum out[0...n/2], the nyquist frequency is stored in out[n/2] */
+  void (*power_spectrum) (gfloat *out, const gfloat *in, guint n);
+
+  /* data[i] = log10 (sqrt (data[i] / (frame_length * frame_length)))
+   * clamped to -500.0 */
+  void (*log_magnitude) (gfloat *data, guint n, guint frame_length);
+
+  /* out[i] = sum (weights[offset[i] + k] * in[start[i] + k]) for k < length[i] */
+  void (*mel) (gfloat *out, const gfloat *in, const guint *start, const guint *length,
+      const guint *offset, const gfloat *weights, guint nbins);
+
+  /* data[i] = 1 / (1 + exp (-data[i])) */
+  void (*sigmoid) (gfloat *data, guint n);
+
+  /* out[i] = sum (weights[i * stride + j] * in[j]) for j < stride and i < n.
+   * stride has to be a multiple of 16, all values in [-127, 127] */
+  void (*dot_s8) (gint32 *out, const gint8 *weights, const gint8 *in, guint stride, guint n);
+};
+
+G_GNUC_INTERNAL const WhsDspFunctions * whs_dsp_get_functions (void) G_GNUC_PURE;
+G_GNUC_INTERNAL const WhsDspFunctions * const * whs_dsp_get_implementations (void) G_GNUC_PURE;
+
+G_END_DECLS
+
+#endif /* __WHS_DSP_H__ */
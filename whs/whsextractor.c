@@ -22,6 +22,7 @@
 #endif
 
 #include "whsextractor.h"
+#include "whsdsp.h"
 #include "fft.h"
 
 #include <math.h>
@@ -31,16 +32,38 @@ struct _WhsExtractorPrivate
 {
   /* FFT data */
   struct {
-    gdouble *freqdata;
+    gfloat *freqdata;
+    gfloat *spectrum;
+    gfloat *w;
     gint *ip;
-    gdouble *w;
   } fft;
   struct {
     gdouble *freqdata;
     gint *ip;
     gdouble *w;
   } dct;
-  gdouble *cos;
+
+  gfloat *cos;
+  const WhsDspFunctions *dsp;
+
+  /* Buffers of the double precision reference implementation,
+   * which is used instead of the kernels if dsp is NULL */
+  struct {
+    gdouble *freqdata;
+    gdouble *w;
+    gdouble *cos;
+    gdouble *weights;
+  } reference;
+
+  /* Mel filterbank: bin i is the weighted sum of the
+   * spectrum values start[i] ... start[i] + length[i] - 1
+   * with the weights starting at weights[offset[i]] */
+  struct {
+    guint start[32];
+    guint length[32];
+    guint offset[32];
+    gfloat *weights;
+  } mel;
 };
 
 static inline gdouble
@@ -49,34 +72,6 @@ mel (double f)
   return 1127.014048 * log (1 + f / 700.0);
 } G_GNUC_CONST
 
-static inline gdouble
-mel_inv (double f)
-{
-  return 700.0 * (exp (f / 1127.0140489) - 1.0);
-} G_GNUC_CONST
-
-static inline gdouble
-triangle (gdouble start, gdouble stop, gdouble pos)
-{
-  g_assert (stop >= start);
-
-  if (start == stop)
-    return 1.0;
-
-  if (pos <= start || pos >= stop)
-    return 0.0;
-
-  if (start == 0.0 && pos <= (stop-start)/2.0)
-    return 1.0;
-
-  /* Not really a triangular window but bartlett window (zero at the end points) */
-
-  gdouble len = stop - start;
-  gdouble ret = (2.0 / (len - 1.0)) * ((len-1.0)/2.0 - fabs ((pos - start) - (len - 1.0)/2.0));
-
-  return CLAMP (ret, 0.0, 1.0);
-} G_GNUC_CONST
-
 #define WHS_EXTRACTOR_GET_PRIVATE(obj)  \
     (G_TYPE_INSTANCE_GET_PRIVATE ((obj), WHS_TYPE_EXTRACTOR, WhsExtractorPrivate))
 
@@ -117,6 +112,8 @@ whs_extractor_finalize (WhsObject *object)
   self->priv->fft.ip = NULL;
   g_free (self->priv->fft.w);
   self->priv->fft.w = NULL;
+  g_free (self->priv->fft.spectrum);
+  self->priv->fft.spectrum = NULL;
 
   g_free (self->priv->dct.freqdata);
   self->priv->dct.freqdata = NULL;
@@ -126,12 +123,69 @@ whs_extractor_finalize (WhsObject *object)
   self->priv->dct.w = NULL;
 
   g_free (self->priv->cos);
+  self->priv->cos = NULL;
+
+  g_free (self->priv->mel.weights);
+  self->priv->mel.weights = NULL;
+
+  g_free (self->priv->reference.freqdata);
+  self->priv->reference.freqdata = NULL;
+  g_free (self->priv->reference.w);
+  self->priv->reference.w = NULL;
+  g_free (self->priv->reference.cos);
+  self->priv->reference.cos = NULL;
+  g_free (self->priv->reference.weights);
+  self->priv->reference.weights = NULL;
 
   WHS_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+/* The bin boundaries only depend on the sample rate, frame length
+ * and frequency band, so walk them once here instead of calling
+ * mel() for every spectrum value of every frame */
+static void
+whs_extractor_init_filterbank (WhsExtractor *self)
+{
+  gint i, j = 0, bin = 0;
+  gint start_m = (self->min_freq > 0) ? mel (CLAMP (self->min_freq - (self->sample_rate / self->frame_length), 0, self->sample_rate / 2)) : 0;
+  gint stop_m = (self->max_freq > 0) ? mel (CLAMP (self->max_freq + (self->sample_rate / self->frame_length), 0, self->sample_rate / 2)) : mel (self->sample_rate / 2);
+  gint step = (stop_m - start_m) / 32; // 32 bins
+  guint offset = 0;
+
+  self->priv->mel.weights = g_malloc0 (sizeof (self->priv->mel.weights[0]) * (self->frame_length / 2 + 1));
+  if (!self->priv->dsp)
+    self->priv->reference.weights = g_new0 (gdouble, self->frame_length / 2 + 1);
+
+  for (bin = i = 0; bin < 32; bin++, i += j) {
+    for (j = 0; (i + j) <= self->frame_length / 2 && mel (((i + j) * (self->sample_rate / 2)) / (self->frame_length / 2)) <= start_m + step * (bin + 1); j++);
+
+    self->priv->mel.start[bin] = i;
+    self->priv->mel.length[bin] = j;
+    self->priv->mel.offset[bin] = offset;
+
+    // Average over all values of the bin
+    for (gint k = 0; k < j; k++)
+      self->priv->mel.weights[offset + k] = 1.0 / j;
+    if (self->priv->reference.weights)
+      for (gint k = 0; k < j; k++)
+        self->priv->reference.weights[offset + k] = 1.0 / j;
+
+    offset += j;
+  }
+}
+
 WhsExtractor *
 whs_extractor_new (guint sample_rate, guint frame_length, guint min_freq, guint max_freq)
+{
+  return whs_extractor_new_full (sample_rate, frame_length, min_freq, max_freq, whs_dsp_get_functions ());
+}
+
+/* Like whs_extractor_new() but with the kernels of dsp, or the double
+ * precision reference implementation if dsp is NULL. The reference is
+ * slower and only meant for checking the kernels */
+WhsExtractor *
+whs_extractor_new_full (guint sample_rate, guint frame_length, guint min_freq, guint max_freq,
+    const WhsDspFunctions *dsp)
 {
   g_return_val_if_fail (frame_length > 0, NULL);
   g_return_val_if_fail (sample_rate > 0, NULL);
@@ -142,51 +196,55 @@ whs_extractor_new (guint sample_rate, guint frame_length, guint min_freq, guint
   self->min_freq = min_freq;
   self->max_freq = max_freq;
 
-  self->priv->fft.freqdata = g_new0 (gdouble, frame_length);
+  self->priv->fft.freqdata = g_new0 (gfloat, frame_length);
+  self->priv->fft.spectrum = g_new0 (gfloat, frame_length / 2 + 1);
+  self->priv->fft.w = g_new0 (gfloat, frame_length / 2 + 1);
+  self->priv->cos = g_new (gfloat, frame_length);
+  self->priv->dsp = dsp;
   self->priv->fft.ip = g_new0 (gint, 3 + sqrt (frame_length / 2));
-  self->priv->fft.w = g_new0 (gdouble, frame_length / 2 + 1);
+
+  if (!dsp) {
+    self->priv->reference.freqdata = g_new0 (gdouble, frame_length);
+    self->priv->reference.w = g_new0 (gdouble, frame_length / 2 + 1);
+    self->priv->reference.cos = g_new (gdouble, frame_length);
+  }
 
   self->priv->dct.freqdata = NULL;
   self->priv->dct.ip = g_new0 (gint, 3 + sqrt (32 / 2));
   self->priv->dct.w = g_new0 (gdouble, 1 + (32 * 5 + 3) / 4); // dct on 32 bins
 
-  self->priv->cos = g_new (gdouble, frame_length);
-  
-  for (gint i = 0; i < self->frame_length; i++)
-    self->priv->cos[i] = 0.53836 - 0.46164 * cos (2.0 * M_PI * i / (self->frame_length-1));
+  for (gint i = 0; i < self->frame_length; i++) {
+    gdouble c = 0.53836 - 0.46164 * cos (2.0 * M_PI * i / (self->frame_length-1));
+
+    self->priv->cos[i] = c;
+    if (!dsp)
+      self->priv->reference.cos[i] = c;
+  }
+
+  whs_extractor_init_filterbank (self);
 
   return self;
 }
 
-void
-whs_extractor_process (WhsExtractor *self, const gfloat *in, WhsFeatureVector *ret)
+static void
+whs_extractor_process_reference (WhsExtractor *self, const gfloat *in, WhsFeatureVector *ret)
 {
+  gdouble *freqdata = self->priv->reference.freqdata;
+  gdouble bins[32];
   gdouble tmp;
 
-  // Calculate MFCC
-  // http://de.wikipedia.org/wiki/MFCC
-
-  // Copy to our temporary array and apply hamming window
-  
-  gdouble *freqdata = self->priv->fft.freqdata;
-
-  for (gint i = 0; i < self->frame_length; i++) {
-    freqdata[i] = in[i] * self->priv->cos[i];
-  }
+  // Apply hamming window
+  for (gint i = 0; i < self->frame_length; i++)
+    freqdata[i] = in[i] * self->priv->reference.cos[i];
 
   // Take FFT
-  rdft (self->frame_length, 1, freqdata, self->priv->fft.ip, self->priv->fft.w);
-
-  // Store magnitude spectrum in freqdata[0...n/2]
-  for (guint i = 0; i < self->frame_length; i += 2) {
-    gdouble cur;
-    if (i == 0) {
-      freqdata[0] = freqdata[0] * freqdata[0];
-      freqdata[1] = freqdata[1] * freqdata[1];
-    } else {
-      cur = freqdata[i / 2 + 1] = freqdata[i] * freqdata[i] + freqdata[i+1] * freqdata[i+1];
-    }
-  }
+  rdft (self->frame_length, 1, freqdata, self->priv->fft.ip, self->priv->reference.w);
+
+  // Store power spectrum in freqdata[0...n/2]
+  freqdata[0] = freqdata[0] * freqdata[0];
+  freqdata[1] = freqdata[1] * freqdata[1];
+  for (guint i = 2; i < self->frame_length; i += 2)
+    freqdata[i / 2 + 1] = freqdata[i] * freqdata[i] + freqdata[i + 1] * freqdata[i + 1];
 
   // Move freqdata[1] to the end, it's for the nyquist frequency!
   tmp = freqdata[1];
@@ -196,65 +254,65 @@ whs_extractor_process (WhsExtractor *self, const gfloat *in, WhsFeatureVector *r
   // Take logarithms
   for (gint i = 0; i < self->frame_length / 2 + 1; i++) {
     if (freqdata[i] != 0.0)
-      freqdata[i] = CLAMP (log10 (sqrt (freqdata[i]/(self->frame_length*self->frame_length))), -500.0, G_MAXDOUBLE);
+      freqdata[i] = CLAMP (log10 (sqrt (freqdata[i] / (self->frame_length * self->frame_length))), -500.0, G_MAXDOUBLE);
     else
       freqdata[i] = -500.0;
   }
 
   // Convert to mel spectrum
-  gdouble bins[32];
+  for (gint bin = 0; bin < 32; bin++) {
+    const gdouble *x = &freqdata[self->priv->mel.start[bin]];
+    const gdouble *w = &self->priv->reference.weights[self->priv->mel.offset[bin]];
+    guint len = self->priv->mel.length[bin];
+    gdouble sum = 0.0;
+
+    for (guint k = 0; k < len; k++)
+      sum += w[k] * x[k];
 
-#if 0
-  {
-    gint bin = 0;
-    gint step = mel (self->sample_rate / 2) / 32; // 32 bins
-
-    for (bin = 0; bin < 32; bin++) {
-      gint i;
-      bins[bin] = 0.0;
-      
-      // Fill bin from 'start' to 'stop' with triangular weighting
-      gdouble start = (bin > 0) ? bin * step - 0.5 * step : 0;
-      gdouble stop = (bin < 31) ? (bin + 1) * step + 0.5 * step : (bin + 1) * step;
-
-      for (i = 0; i < self->frame_length / 2 + 1; i++) {
-        gdouble f = (((gfloat) i) / ((gfloat) (self->frame_length))) * self->sample_rate;
-        bins[bin] += triangle (start, stop, mel (f)) * freqdata[i];
-      }
-    }
+    bins[bin] = sum;
   }
-#else
-  {
-#if 1
-    gint i, j = 0, bin = 0;
-    gint start_m = (self->min_freq > 0) ? mel (CLAMP (self->min_freq - (self->sample_rate / self->frame_length), 0, self->sample_rate / 2)) : 0;
-    gint stop_m = (self->max_freq > 0) ? mel (CLAMP (self->max_freq + (self->sample_rate / self->frame_length), 0, self->sample_rate / 2)) : mel (self->sample_rate / 2);
-    gint step = (stop_m - start_m) / 32; // 32 bins
-
-#else
-    gint i, j = 0, bin = 0;
-    gint start_m = 0;
-    gint step =  mel (self->sample_rate / 2) / 32; // 32 bins
 
-#endif
+  // Calculate DCT
+  ddct (32, -1, bins, self->priv->dct.ip, self->priv->dct.w);
 
-    for (bin = i = 0; bin < 32; bin++, i += j) {
-      bins[bin] = 0.0;
-      
-      // Fill bin
-      for (j = 0; (i + j) <= self->frame_length / 2 && mel (((i + j) * (self->sample_rate / 2)) / (self->frame_length / 2)) <= start_m + step * (bin + 1); j++) {
-        bins[bin] += freqdata[i+j];
-      }
-
-      // Normalize bin
-      if (j != 0)
-        bins[bin] /= j;
-    }
+  for (gint i = 0; i < 32; i++)
+    ret->mfcc[i] = bins[i];
+}
+
+void
+whs_extractor_process (WhsExtractor *self, const gfloat *in, WhsFeatureVector *ret)
+{
+  const WhsDspFunctions *dsp = self->priv->dsp;
+  gfloat *freqdata = self->priv->fft.freqdata;
+  gfloat *spectrum = self->priv->fft.spectrum;
+  gfloat mel_bins[32];
+  gdouble bins[32];
+
+  // Calculate MFCC
+  // http://de.wikipedia.org/wiki/MFCC
+
+  if (!dsp) {
+    whs_extractor_process_reference (self, in, ret);
+    return;
   }
-#endif
 
+  // Apply hamming window
+  dsp->window (freqdata, in, self->priv->cos, self->frame_length);
 
-  // Calculate DCT
+  // Take FFT
+  rdftf (self->frame_length, 1, freqdata, self->priv->fft.ip, self->priv->fft.w);
+
+  // Store power spectrum in spectrum[0...n/2] and take logarithms
+  dsp->power_spectrum (spectrum, freqdata, self->frame_length);
+  dsp->log_magnitude (spectrum, self->frame_length / 2 + 1, self->frame_length);
+
+  // Convert to mel spectrum
+  dsp->mel (mel_bins, spectrum, self->priv->mel.start, self->priv->mel.length,
+      self->priv->mel.offset, self->priv->mel.weights, 32);
+
+  // Calculate DCT, only 32 values so do it in double precision
+  for (gint i = 0; i < 32; i++)
+    bins[i] = mel_bins[i];
 
   ddct (32, -1, bins, self->priv->dct.ip, self->priv->dct.w);
 
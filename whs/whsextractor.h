@@ -23,6 +23,7 @@
 #include "whs.h"
 #include "whsobject.h"
 #include "whsprivate.h"
+#include "whsdsp.h"
 
 G_BEGIN_DECLS
 
@@ -57,6 +58,8 @@ struct _WhsExtractorClass
 G_GNUC_INTERNAL GType whs_extractor_get_type (void);
 
 G_GNUC_INTERNAL WhsExtractor *whs_extractor_new (guint sample_rate, guint frame_length, guint min_freq, guint max_freq) G_GNUC_WARN_UNUSED_RESULT G_GNUC_MALLOC;
+G_GNUC_INTERNAL WhsExtractor *whs_extractor_new_full (guint sample_rate, guint frame_length, guint min_freq, guint max_freq,
+    const WhsDspFunctions *dsp) G_GNUC_WARN_UNUSED_RESULT G_GNUC_MALLOC;
 
 G_GNUC_INTERNAL void whs_extractor_process (WhsExtractor *self, const gfloat *in, WhsFeatureVector *vec);
 
@@ -0,0 +1,198 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "whsfeaturestore.h"
+
+#define MIN_SIZE (1024)
+
+WhsFeatureStore *
+whs_feature_store_new (void)
+{
+  return g_new0 (WhsFeatureStore, 1);
+}
+
+/* Creates a store whose segments point into file, it takes ownership */
+WhsFeatureStore *
+whs_feature_store_new_mapped (GMappedFile *file)
+{
+  g_return_val_if_fail (file != NULL, NULL);
+
+  WhsFeatureStore *self = g_new0 (WhsFeatureStore, 1);
+
+  self->file = file;
+
+  return self;
+}
+
+void
+whs_feature_store_free (WhsFeatureStore *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_free (self->labels);
+  g_free (self->vecs);
+  g_free (self->ends);
+  g_free (self->segments);
+
+  if (self->file)
+    g_mapped_file_free (self->file);
+
+  g_free (self);
+}
+
+/* Adds n rows that are used in place, which has to be done before
+ * any rows are added in memory. The arrays must stay valid as long
+ * as the store exists */
+void
+whs_feature_store_add_segment (WhsFeatureStore *self, const gint32 *labels,
+    const WhsFeatureVector *vecs, guint n)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->n == self->n_mapped);
+  g_return_if_fail (n <= G_MAXUINT - self->n);
+
+  if (n == 0)
+    return;
+
+  self->segments = g_renew (WhsFeatureSegment, self->segments, self->n_segments + 1);
+  self->segments[self->n_segments].start = self->n;
+  self->segments[self->n_segments].n = n;
+  self->segments[self->n_segments].labels = labels;
+  self->segments[self->n_segments].vecs = vecs;
+  self->n_segments++;
+
+  self->n += n;
+  self->n_mapped = self->n;
+}
+
+/* Returns how many rows from row start on are contiguous in memory
+ * and points labels and vecs at the first of them */
+guint
+whs_feature_store_get_run (const WhsFeatureStore *self, guint start,
+    const gint32 **labels, const WhsFeatureVector **vecs)
+{
+  g_return_val_if_fail (self != NULL, 0);
+  g_return_val_if_fail (start < self->n, 0);
+
+  if (start >= self->n_mapped) {
+    *labels = self->labels + (start - self->n_mapped);
+    *vecs = self->vecs + (start - self->n_mapped);
+    return self->n - start;
+  }
+
+  guint lo = 0, hi = self->n_segments;
+
+  while (hi - lo > 1) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (self->segments[mid].start <= start)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  const WhsFeatureSegment *segment = &self->segments[lo];
+  guint offset = start - segment->start;
+
+  *labels = segment->labels + offset;
+  *vecs = segment->vecs + offset;
+
+  return segment->n - offset;
+}
+
+/* Makes room for at least n more rows */
+void
+whs_feature_store_reserve (WhsFeatureStore *self, guint n)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (n <= G_MAXUINT - self->n);
+
+  guint used = self->n - self->n_mapped;
+
+  if (used + n <= self->size)
+    return;
+
+  guint size = MAX (self->size, MIN_SIZE);
+
+  while (size < used + n)
+    size = (size <= G_MAXUINT / 2) ? size * 2 : G_MAXUINT;
+
+  self->labels = g_renew (gint32, self->labels, size);
+  self->vecs = g_renew (WhsFeatureVector, self->vecs, size);
+  self->size = size;
+}
+
+/* Adds n rows that are filled in by the caller and returns the
+ * index of the first one, in memory it is that minus n_mapped */
+guint
+whs_feature_store_extend (WhsFeatureStore *self, guint n)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  whs_feature_store_reserve (self, n);
+  self->n += n;
+
+  return self->n - n;
+}
+
+/* Adds a row with the given label and returns its
+ * vector, which is valid until the next row is added */
+WhsFeatureVector *
+whs_feature_store_append (WhsFeatureStore *self, gint32 label)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  whs_feature_store_reserve (self, 1);
+
+  guint i = self->n++ - self->n_mapped;
+
+  self->labels[i] = label;
+
+  return &self->vecs[i];
+}
+
+/* Ends a sequence at row end, does nothing if it is empty */
+void
+whs_feature_store_end_sequence (WhsFeatureStore *self, guint end)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (end <= self->n);
+
+  if (end == 0 || (self->n_sequences > 0 && self->ends[self->n_sequences - 1] >= end))
+    return;
+
+  if (self->n_sequences == self->sequences_size) {
+    self->sequences_size = MAX (self->sequences_size * 2, 16);
+    self->ends = g_renew (guint, self->ends, self->sequences_size);
+  }
+
+  self->ends[self->n_sequences++] = end;
+}
+
+/* Ends the current sequence, does nothing if it is empty */
+void
+whs_feature_store_finish_sequence (WhsFeatureStore *self)
+{
+  g_return_if_fail (self != NULL);
+
+  whs_feature_store_end_sequence (self, self->n);
+}
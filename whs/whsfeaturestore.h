@@ -0,0 +1,76 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WHS_FEATURE_STORE_H__
+#define __WHS_FEATURE_STORE_H__
+
+#include <glib.h>
+#include "whsprivate.h"
+
+G_BEGIN_DECLS
+
+typedef struct _WhsFeatureStore WhsFeatureStore;
+typedef struct _WhsFeatureSegment WhsFeatureSegment;
+
+/* Rows that are used in place, starting at row start */
+struct _WhsFeatureSegment
+{
+  guint start, n;
+  const gint32 *labels;
+  const WhsFeatureVector *vecs;
+};
+
+/* Growable store of labelled feature vectors in the order they were
+ * learned. The first n_mapped rows can be segments of a mapped state
+ * file, the rows after them are one contiguous row-major matrix of
+ * 32 floats per row and a parallel label array. Rows are read with
+ * whs_feature_store_get_run (). ends are the row offsets at which
+ * the sequences end, ascending */
+struct _WhsFeatureStore
+{
+  guint n;
+  gint32 *labels;
+  WhsFeatureVector *vecs;
+
+  GMappedFile *file;
+  WhsFeatureSegment *segments;
+  guint n_segments, n_mapped;
+
+  guint n_sequences;
+  guint *ends;
+
+  /* Allocated rows and sequences */
+  guint size, sequences_size;
+};
+
+G_GNUC_INTERNAL WhsFeatureStore * whs_feature_store_new (void) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+G_GNUC_INTERNAL WhsFeatureStore * whs_feature_store_new_mapped (GMappedFile *file) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+G_GNUC_INTERNAL void whs_feature_store_free (WhsFeatureStore *self);
+
+G_GNUC_INTERNAL void whs_feature_store_add_segment (WhsFeatureStore *self, const gint32 *labels, const WhsFeatureVector *vecs, guint n);
+G_GNUC_INTERNAL guint whs_feature_store_get_run (const WhsFeatureStore *self, guint start, const gint32 **labels, const WhsFeatureVector **vecs);
+
+G_GNUC_INTERNAL void whs_feature_store_reserve (WhsFeatureStore *self, guint n);
+G_GNUC_INTERNAL WhsFeatureVector * whs_feature_store_append (WhsFeatureStore *self, gint32 label);
+G_GNUC_INTERNAL guint whs_feature_store_extend (WhsFeatureStore *self, guint n);
+G_GNUC_INTERNAL void whs_feature_store_end_sequence (WhsFeatureStore *self, guint end);
+G_GNUC_INTERNAL void whs_feature_store_finish_sequence (WhsFeatureStore *self);
+
+G_END_DECLS
+
+#endif /* __WHS_FEATURE_STORE_H__ */
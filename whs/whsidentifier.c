@@ -22,6 +22,7 @@
 #endif
 
 #include "whsidentifier.h"
+#include "whsidentifierprivate.h"
 #include "whsextractor.h"
 #include "whslocalizer.h"
 #include "whsclassifier.h"
@@ -30,19 +31,99 @@
 #include "whsprivate.h"
 
 #include <math.h>
+#include <string.h>
+
+/* Every sample is stored twice, at pos and pos + length, so that
+ * the last n <= length samples are always contiguous in memory */
+typedef struct
+{
+  gfloat *data;
+  guint length;
+  guint pos;
+} WhsIdentifierRing;
+
+/* Minimum number of hops that are collected, filtered and classified at once */
+#define WHS_IDENTIFIER_BATCH_SIZE (32)
 
 struct _WhsIdentifierPrivate
 {
-  gfloat **input, *mono;
+  /* Deinterleaved input, up to n_batch hops (at least one frame)
+   * are collected and filtered at once */
+  gfloat **block, *block_mono;
+  guint block_length, fill;
+  WhsIdentifierMode block_mode;
+  gdouble *block_energy;
+  guint n_batch;
+
+  /* Features and results (n_classifiers per hop) of the hops of the
+   * current block, all non-silent frames are classified together */
+  WhsFeatureVector *batch_vecs;
+  WhsResult *batch_res, *batch_classified;
+  gboolean *batch_valid;
+  guint *batch_index;
+
+  /* Stream position of the next hop */
+  guint64 offset;
+
+  /* The last 2 frames of every channel for the localizer
+   * and the last frame of the mono signal */
+  WhsIdentifierRing *input;
+  WhsIdentifierRing mono;
+
+  /* Energy of the unfiltered mono signal for every hop of the current frame */
+  gdouble *energy;
+  guint n_energy, energy_pos;
+
   WhsExtractor *extractor;
   WhsLocalizer *localizer;
-  WhsClassifier *classifier;
-  WhsBandpass *bandpass[2];
-
-  gfloat last_results[10];
-  gfloat last_locations[10];
+  /* One classifier per pattern, all patterns
+   * share the sample rate and frequency band */
+  WhsClassifier **classifiers;
+  guint n_classifiers;
+  /* One filter context per channel and one for
+   * the mono signal if only that is filtered */
+  WhsBandpass *bandpass;
+  guint bandpass_mono;
+
+  /* n_last results of every classifier and n_last rows of
+   * n_scores class scores of every multi-class classifier */
+  gfloat *last_results;
+  gfloat *last_scores;
+  gfloat *last_locations;
+  guint n_last, last_pos;
+  guint n_scores;
 };
 
+static inline void
+whs_identifier_ring_init (WhsIdentifierRing *ring, guint length)
+{
+  ring->data = g_new0 (gfloat, 2 * length);
+  ring->length = length;
+  ring->pos = 0;
+}
+
+/* len must divide the length of the ring */
+static inline void
+whs_identifier_ring_write (WhsIdentifierRing *ring, const gfloat *in, guint len)
+{
+  memcpy (&ring->data[ring->pos], in, len * sizeof (gfloat));
+  memcpy (&ring->data[ring->pos + ring->length], in, len * sizeof (gfloat));
+  ring->pos = (ring->pos + len) % ring->length;
+}
+
+static inline void
+whs_identifier_ring_clear (WhsIdentifierRing *ring)
+{
+  memset (ring->data, 0, 2 * ring->length * sizeof (gfloat));
+  ring->pos = 0;
+}
+
+static inline const gfloat *
+whs_identifier_ring_get (const WhsIdentifierRing *ring, guint len)
+{
+  return &ring->data[ring->pos + ring->length - len];
+}
+
 #define WHS_IDENTIFIER_GET_PRIVATE(obj)  \
     (G_TYPE_INSTANCE_GET_PRIVATE ((obj), WHS_TYPE_IDENTIFIER, WhsIdentifierPrivate))
 
@@ -87,89 +168,268 @@ whs_identifier_finalize (WhsObject *object)
     self->priv->localizer = NULL;
   }
 
-  if (self->priv->classifier) {
-    whs_object_unref (self->priv->classifier);
-    self->priv->classifier = NULL;
+  if (self->priv->classifiers) {
+    for (gint i = 0; i < self->priv->n_classifiers; i++)
+      if (self->priv->classifiers[i])
+        whs_object_unref (self->priv->classifiers[i]);
+    g_free (self->priv->classifiers);
+    self->priv->classifiers = NULL;
   }
 
+  if (self->priv->block)
+    for (gint i = 0; i < self->nchannels; i++)
+      g_free (self->priv->block[i]);
+
   if (self->priv->input)
     for (gint i = 0; i < self->nchannels; i++)
-      g_free (self->priv->input[i]);
+      g_free (self->priv->input[i].data);
 
-  if (self->priv->bandpass[0]) {
-    whs_bandpass_free (self->priv->bandpass[0]);
-    self->priv->bandpass[0] = NULL;
-  }
-  if (self->priv->bandpass[1]) {
-    whs_bandpass_free (self->priv->bandpass[1]);
-    self->priv->bandpass[1] = NULL;
+  if (self->priv->bandpass) {
+    whs_bandpass_free (self->priv->bandpass);
+    self->priv->bandpass = NULL;
   }
 
+  g_free (self->priv->block);
+  self->priv->block = NULL;
+  g_free (self->priv->block_mono);
+  self->priv->block_mono = NULL;
+  g_free (self->priv->block_energy);
+  self->priv->block_energy = NULL;
+  g_free (self->priv->batch_vecs);
+  self->priv->batch_vecs = NULL;
+  g_free (self->priv->batch_res);
+  self->priv->batch_res = NULL;
+  g_free (self->priv->batch_classified);
+  self->priv->batch_classified = NULL;
+  g_free (self->priv->batch_valid);
+  self->priv->batch_valid = NULL;
+  g_free (self->priv->batch_index);
+  self->priv->batch_index = NULL;
   g_free (self->priv->input);
   self->priv->input = NULL;
-  g_free (self->priv->mono);
-  self->priv->mono = NULL;
+  g_free (self->priv->mono.data);
+  self->priv->mono.data = NULL;
+  g_free (self->priv->energy);
+  self->priv->energy = NULL;
+  g_free (self->priv->last_results);
+  self->priv->last_results = NULL;
+  g_free (self->priv->last_scores);
+  self->priv->last_scores = NULL;
+  g_free (self->priv->last_locations);
+  self->priv->last_locations = NULL;
 
   WHS_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+/* Sets the results that are smoothed over for the given modes back
+ * to neutral values */
+static void
+whs_identifier_reset_history (WhsIdentifier *self, WhsIdentifierMode mode)
+{
+  WhsIdentifierPrivate *priv = self->priv;
+
+  if (mode & WHS_IDENTIFIER_MODE_CLASSIFY) {
+    for (gint i = 0; i < priv->n_last * priv->n_classifiers; i++)
+      priv->last_results[i] = 0.5;
+
+    for (gint c = 0; c < priv->n_classifiers; c++) {
+      guint n_classes = priv->classifiers[c]->n_classes;
+      gfloat *last_scores = &priv->last_scores[c * priv->n_last * priv->n_scores];
+
+      for (gint i = 0; i < priv->n_last; i++)
+        for (gint k = 0; k < n_classes; k++)
+          last_scores[i * priv->n_scores + k] = 1.0 / n_classes;
+    }
+  }
+
+  if (mode & WHS_IDENTIFIER_MODE_LOCALIZE) {
+    for (gint i = 0; i < priv->n_last; i++)
+      priv->last_locations[i] = 0.0;
+  }
+}
+
+/* Creates an identifier that classifies the same features with the
+ * classifiers of all n patterns, which must have the same frequency
+ * band. Every result passed to the callbacks is followed by those of
+ * the other patterns */
 WhsIdentifier *
-whs_identifier_new (guint sample_rate, guint frame_length, guint nchannels, guint distance, WhsPattern *pattern)
+whs_identifier_new_group (guint sample_rate, guint frame_length, guint hop_length,
+    guint nchannels, guint distance, WhsPattern **patterns, guint n)
 {
   g_return_val_if_fail (frame_length > 0, NULL);
+  g_return_val_if_fail (hop_length > 0 && frame_length % hop_length == 0, NULL);
   g_return_val_if_fail (sample_rate > 0, NULL);
   g_return_val_if_fail (nchannels > 0, NULL);
-  g_return_val_if_fail (WHS_IS_PATTERN (pattern), NULL);
+  g_return_val_if_fail (patterns != NULL && n > 0, NULL);
+
+  guint min_freq, max_freq;
+
+  whs_pattern_get_frequency_band (patterns[0], &min_freq, &max_freq);
+
+  for (gint i = 0; i < n; i++) {
+    guint min, max;
+
+    g_return_val_if_fail (WHS_IS_PATTERN (patterns[i]), NULL);
+
+    if (whs_pattern_get_sample_rate (patterns[i]) != sample_rate) {
+      g_warning ("Incompatible sampling rate");
+      return NULL;
+    }
+
+    whs_pattern_get_frequency_band (patterns[i], &min, &max);
+    if (min != min_freq || max != max_freq) {
+      g_warning ("Patterns have different frequency bands");
+      return NULL;
+    }
+  }
 
   WhsIdentifier *self = WHS_IDENTIFIER_CAST (g_type_create_instance (WHS_TYPE_IDENTIFIER));
   self->sample_rate = sample_rate;
   self->frame_length = frame_length;
+  self->hop_length = hop_length;
   self->nchannels = nchannels;
 
-  guint min_freq, max_freq, sr;
-  whs_pattern_get_frequency_band (pattern, &min_freq, &max_freq);
+  // Localization is only possible with two channels, the
+  // separate channels are not needed for anything else
+  if (nchannels == 2)
+    self->priv->localizer = whs_localizer_new (sample_rate, frame_length, nchannels, distance);
+
   if (min_freq != 0 && max_freq != 0) {
-    self->priv->bandpass[0] = whs_bandpass_new (sample_rate, nchannels, min_freq, max_freq);
-    self->priv->bandpass[1] = whs_bandpass_new (sample_rate, 1, min_freq, max_freq);
+    self->priv->bandpass_mono = (self->priv->localizer) ? nchannels : 0;
+    self->priv->bandpass = whs_bandpass_new (sample_rate, self->priv->bandpass_mono + 1, min_freq, max_freq);
   }
 
-  sr = whs_pattern_get_sample_rate (pattern);
-  if (sr != sample_rate) {
-    whs_object_unref (self);
-    g_warning ("Incompatible sampling rate");
-    return NULL;
+  self->priv->extractor = whs_extractor_new (sample_rate, frame_length, min_freq, max_freq);
+
+  self->priv->n_classifiers = n;
+  self->priv->classifiers = g_new0 (WhsClassifier *, n);
+  for (gint i = 0; i < n; i++) {
+    self->priv->classifiers[i] = whs_classifier_new (whs_pattern_get_classifier_name (patterns[i]), patterns[i]);
+    if (!self->priv->classifiers[i]) {
+      g_warning ("Can't create classifier %s", whs_pattern_get_classifier_name (patterns[i]));
+      whs_object_unref (self);
+      return NULL;
+    }
+    self->priv->n_scores = MAX (self->priv->n_scores, self->priv->classifiers[i]->n_classes);
   }
 
-  self->priv->extractor = whs_extractor_new (sample_rate, frame_length, min_freq, max_freq);
-  self->priv->localizer = whs_localizer_new (sample_rate, frame_length, nchannels, distance);
-  self->priv->classifier = whs_classifier_new (whs_pattern_get_classifier_name (pattern), pattern);
+  self->priv->n_energy = frame_length / hop_length;
+  self->priv->n_batch = MAX (WHS_IDENTIFIER_BATCH_SIZE, self->priv->n_energy);
+  self->priv->block_length = self->priv->n_batch * hop_length;
 
-  self->priv->input = g_new0 (gfloat *, nchannels);
-  for (gint i = 0; i < nchannels; i++)
-    self->priv->input[i] = g_new0 (gfloat, frame_length);
+  if (self->priv->localizer) {
+    self->priv->block = g_new0 (gfloat *, nchannels);
+    self->priv->input = g_new0 (WhsIdentifierRing, nchannels);
+    for (gint i = 0; i < nchannels; i++) {
+      self->priv->block[i] = g_new0 (gfloat, self->priv->block_length);
+      whs_identifier_ring_init (&self->priv->input[i], 2 * frame_length);
+    }
+  }
   
-  self->priv->mono = g_new0 (gfloat, frame_length);
-
-  for (gint i = 0; i < 10; i++)
-    self->priv->last_results[i] = 0.5;
+  self->priv->block_mono = g_new0 (gfloat, self->priv->block_length);
+  whs_identifier_ring_init (&self->priv->mono, frame_length);
+
+  self->priv->energy = g_new0 (gdouble, self->priv->n_energy);
+  self->priv->block_energy = g_new0 (gdouble, self->priv->n_batch);
+
+  self->priv->batch_vecs = g_new0 (WhsFeatureVector, self->priv->n_batch);
+  self->priv->batch_res = g_new0 (WhsResult, self->priv->n_batch * n);
+  self->priv->batch_classified = g_new0 (WhsResult, self->priv->n_batch);
+  self->priv->batch_valid = g_new0 (gboolean, self->priv->n_batch);
+  self->priv->batch_index = g_new0 (guint, self->priv->n_batch);
+
+  // Average over the results of the last 10 frames
+  self->priv->n_last = 10 * (frame_length / hop_length);
+  self->priv->last_results = g_new (gfloat, self->priv->n_last * n);
+  self->priv->last_locations = g_new0 (gfloat, self->priv->n_last);
+  if (self->priv->n_scores > 0)
+    self->priv->last_scores = g_new0 (gfloat, self->priv->n_last * n * self->priv->n_scores);
+  whs_identifier_reset_history (self, WHS_IDENTIFIER_MODE_CLASSIFY | WHS_IDENTIFIER_MODE_LOCALIZE);
 
   return self;
 }
 
-static gboolean
-whs_identifier_preprocess (WhsIdentifier *self, const gfloat *in)
+WhsIdentifier *
+whs_identifier_new_full (guint sample_rate, guint frame_length, guint hop_length,
+    guint nchannels, guint distance, WhsPattern *pattern)
 {
-  gdouble rms = 0.0;
+  g_return_val_if_fail (WHS_IS_PATTERN (pattern), NULL);
 
-  for (gint i = 0; i < self->frame_length; i++) {
-    self->priv->mono[i] = 0.0;
-    for (gint j = 0; j < self->nchannels; j++) {
-      self->priv->input[j][i] = in[i * self->nchannels + j];
-      self->priv->mono[i] += in[i * self->nchannels + j];
+  return whs_identifier_new_group (sample_rate, frame_length, hop_length, nchannels, distance, &pattern, 1);
+}
+
+WhsIdentifier *
+whs_identifier_new (guint sample_rate, guint frame_length, guint nchannels, guint distance, WhsPattern *pattern)
+{
+  return whs_identifier_new_full (sample_rate, frame_length, frame_length, nchannels, distance, pattern);
+}
+
+/* Smoothes the results of all classifiers for one frame */
+static void
+whs_identifier_postprocess (WhsIdentifier *self, WhsIdentifierMode mode, WhsResult *res)
+{
+  WhsIdentifierPrivate *priv = self->priv;
+  gfloat average;
+
+  // Only smooth what was calculated for this frame
+  if (mode & WHS_IDENTIFIER_MODE_CLASSIFY) {
+    for (gint c = 0; c < priv->n_classifiers; c++) {
+      gfloat *last_results = &priv->last_results[c * priv->n_last];
+
+      last_results[priv->last_pos] = res[c].result;
+
+      average = 0.0;
+      for (gint i = 0; i < priv->n_last; i++)
+        average += last_results[i];
+      average /= priv->n_last;
+      res[c].result = average;
+
+      guint n_classes = res[c].n_classes;
+      if (n_classes == 0)
+        continue;
+
+      gfloat *last_scores = &priv->last_scores[c * priv->n_last * priv->n_scores];
+
+      memcpy (&last_scores[priv->last_pos * priv->n_scores], res[c].scores, n_classes * sizeof (gfloat));
+
+      for (gint k = 0; k < n_classes; k++)
+        res[c].scores[k] = 0.0;
+      for (gint i = 0; i < priv->n_last; i++)
+        for (gint k = 0; k < n_classes; k++)
+          res[c].scores[k] += last_scores[i * priv->n_scores + k];
+      for (gint k = 0; k < n_classes; k++)
+        res[c].scores[k] /= priv->n_last;
     }
-    self->priv->mono[i] /= self->nchannels;
-    rms += self->priv->mono[i] * self->priv->mono[i];
   }
+
+  if (mode & WHS_IDENTIFIER_MODE_LOCALIZE) {
+    priv->last_locations[priv->last_pos] = res[0].location;
+
+    average = 0.0;
+    for (gint i = 0; i < priv->n_last; i++)
+      average += priv->last_locations[i];
+    average /= priv->n_last;
+
+    for (gint c = 0; c < priv->n_classifiers; c++)
+      res[c].location = average;
+  }
+
+  priv->last_pos = (priv->last_pos + 1) % priv->n_last;
+}
+
+/* Extracts the features of and localizes the frame that ends with the
+ * last complete hop. Returns FALSE if the frame is silent, the result
+ * is left at zero then and the frame isn't classified */
+static gboolean
+whs_identifier_analyze (WhsIdentifier *self, WhsIdentifierMode mode, WhsFeatureVector *vec, WhsResult *res)
+{
+  WhsIdentifierPrivate *priv = self->priv;
+  gdouble rms = 0.0;
+
+  memset (res, 0, sizeof (WhsResult));
+
+  for (gint i = 0; i < priv->n_energy; i++)
+    rms += priv->energy[i];
   rms /= self->frame_length;
   rms = sqrt (rms);
 
@@ -177,70 +437,286 @@ whs_identifier_preprocess (WhsIdentifier *self, const gfloat *in)
   if (rms <= 0.0001)
     return FALSE;
 
-  if (self->priv->bandpass[0] && self->priv->bandpass[1]) {
-    whs_bandpass_process (self->priv->bandpass[0], self->priv->input, self->frame_length);
-    whs_bandpass_process (self->priv->bandpass[1], &self->priv->mono, self->frame_length);
+  //FIXME: maybe use the channel with largest RMS after preprocessing
+
+  if (mode & WHS_IDENTIFIER_MODE_CLASSIFY)
+    whs_extractor_process (priv->extractor, whs_identifier_ring_get (&priv->mono, self->frame_length), vec);
+
+  if (mode & WHS_IDENTIFIER_MODE_LOCALIZE) {
+    const gfloat *input[self->nchannels];
+
+    for (gint i = 0; i < self->nchannels; i++)
+      input[i] = whs_identifier_ring_get (&priv->input[i], 2 * self->frame_length);
+
+    whs_localizer_process (priv->localizer, input, vec, res);
   }
 
   return TRUE;
 }
 
+/* Filters all complete hops of the current block and analyzes them one
+ * after another. The features of all of them are classified in one batch
+ * afterwards, the incomplete rest is kept for the next block */
 static void
-whs_identifier_postprocess (WhsIdentifier *self, WhsResult *res)
+whs_identifier_process_block (WhsIdentifier *self, WhsIdentifierMode mode,
+    WhsIdentifierResultFunc func, gpointer user_data)
 {
-  for (gint i = 0; i < 9; i++)
-    self->priv->last_results[i] = self->priv->last_results[i+1];
-  self->priv->last_results[9] = res->result;
+  WhsIdentifierPrivate *priv = self->priv;
+  guint hop_length = self->hop_length;
+  guint n_hops = priv->fill / hop_length;
+  guint len = n_hops * hop_length;
+
+  if (n_hops == 0)
+    return;
+
+  // The channels were already filtered when deinterleaving them. The filter
+  // is linear, so the mono signal can be mixed from them afterwards
+  if (mode & WHS_IDENTIFIER_MODE_LOCALIZE) {
+    if (mode & WHS_IDENTIFIER_MODE_CLASSIFY) {
+      for (gint i = 0; i < len; i++) {
+        gfloat mono = 0.0;
+
+        for (gint j = 0; j < self->nchannels; j++)
+          mono += priv->block[j][i];
+        priv->block_mono[i] = mono / self->nchannels;
+      }
+    }
+  } else if (priv->bandpass) {
+    whs_bandpass_process_channel (priv->bandpass, priv->bandpass_mono, priv->block_mono, len);
+  }
 
-  gfloat average = 0.0;
-  for (gint i = 0; i < 10; i++)
-    average += self->priv->last_results[i];
-  average /= 10.0;
-  res->result = average;
+  guint n_classifiers = priv->n_classifiers;
+  guint n_classify = 0;
 
-  for (gint i = 0; i < 9; i++)
-    self->priv->last_locations[i] = self->priv->last_locations[i+1];
-  self->priv->last_locations[9] = res->location;
+  for (gint i = 0; i < n_hops; i++) {
+    if (mode & WHS_IDENTIFIER_MODE_LOCALIZE)
+      for (gint j = 0; j < self->nchannels; j++)
+        whs_identifier_ring_write (&priv->input[j], &priv->block[j][i * hop_length], hop_length);
+    if (mode & WHS_IDENTIFIER_MODE_CLASSIFY)
+      whs_identifier_ring_write (&priv->mono, &priv->block_mono[i * hop_length], hop_length);
 
-  average = 0.0;
-  for (gint i = 0; i < 10; i++)
-    average += self->priv->last_locations[i];
-  average /= 10.0;
-  res->location = average;
+    priv->energy[priv->energy_pos] = priv->block_energy[i];
+    priv->energy_pos = (priv->energy_pos + 1) % priv->n_energy;
+
+    WhsResult *res = &priv->batch_res[i * n_classifiers];
+
+    priv->batch_valid[i] = whs_identifier_analyze (self, mode, &priv->batch_vecs[n_classify], res);
+    for (gint c = 0; c < n_classifiers; c++) {
+      if (c > 0)
+        res[c] = res[0];
+      res[c].n_classes = priv->classifiers[c]->n_classes;
+    }
+
+    if (priv->batch_valid[i] && (mode & WHS_IDENTIFIER_MODE_CLASSIFY))
+      priv->batch_index[n_classify++] = i;
+  }
+
+  for (gint c = 0; c < n_classifiers && n_classify > 0; c++) {
+    whs_classifier_process_batch (priv->classifiers[c], priv->batch_vecs, n_classify, priv->batch_classified);
+    for (gint i = 0; i < n_classify; i++) {
+      WhsResult *res = &priv->batch_res[priv->batch_index[i] * n_classifiers + c];
+
+      res->result = priv->batch_classified[i].result;
+      memcpy (res->scores, priv->batch_classified[i].scores, res->n_classes * sizeof (gfloat));
+    }
+  }
+
+  for (gint i = 0; i < n_hops; i++) {
+    if (priv->batch_valid[i])
+      whs_identifier_postprocess (self, mode, &priv->batch_res[i * n_classifiers]);
+
+    if (func)
+      func (self, &priv->batch_res[i * n_classifiers], priv->offset, user_data);
+    priv->offset += hop_length;
+  }
+
+  priv->fill -= len;
+  if (priv->fill > 0) {
+    if (mode & WHS_IDENTIFIER_MODE_LOCALIZE) {
+      for (gint j = 0; j < self->nchannels; j++)
+        g_memmove (priv->block[j], &priv->block[j][len], priv->fill * sizeof (gfloat));
+    } else {
+      g_memmove (priv->block_mono, &priv->block_mono[len], priv->fill * sizeof (gfloat));
+    }
+    priv->block_energy[0] = priv->block_energy[n_hops];
+  } else {
+    priv->block_energy[0] = 0.0;
+  }
+
+  for (gint i = 1; i < priv->n_batch; i++)
+    priv->block_energy[i] = 0.0;
 }
 
-WhsResult *
-whs_identifier_process (WhsIdentifier *self, const gfloat *in,
-    WhsIdentifierMode mode)
+/* The inputs, filter contexts and results of the parts that weren't used
+ * in the previous mode are from before they were last used */
+static void
+whs_identifier_change_mode (WhsIdentifier *self, WhsIdentifierMode mode)
 {
-  g_return_val_if_fail (WHS_IS_IDENTIFIER (self), NULL);
-  g_return_val_if_fail (in != NULL, NULL);
-  g_return_val_if_fail ((mode & WHS_IDENTIFIER_MODE_CLASSIFY)
-      && (mode & WHS_IDENTIFIER_MODE_LOCALIZE), NULL);
+  WhsIdentifierPrivate *priv = self->priv;
+  WhsIdentifierMode enabled = mode & ~priv->block_mode;
 
-  //TODO: use overlapping windows, overlap by 1/2 or 1/4 on each side maybe
+  if (enabled & WHS_IDENTIFIER_MODE_LOCALIZE) {
+    for (gint j = 0; j < self->nchannels; j++) {
+      whs_identifier_ring_clear (&priv->input[j]);
+      if (priv->bandpass)
+        whs_bandpass_reset_channel (priv->bandpass, j);
+    }
+  }
 
-  WhsResult *res = g_new0 (WhsResult, 1);
+  if (enabled & WHS_IDENTIFIER_MODE_CLASSIFY)
+    whs_identifier_ring_clear (&priv->mono);
 
-  // Fast path if the current frame doesn't contain anything useful
-  if (!whs_identifier_preprocess (self, in))
-    return res;
+  // The mono signal is only filtered on its own without localization
+  if (priv->bandpass && (priv->block_mode & WHS_IDENTIFIER_MODE_LOCALIZE) &&
+      !(mode & WHS_IDENTIFIER_MODE_LOCALIZE))
+    whs_bandpass_reset_channel (priv->bandpass, priv->bandpass_mono);
 
-  //FIXME: maybe use the channel with largest RMS after preprocessing
+  whs_identifier_reset_history (self, enabled);
 
-  WhsFeatureVector vec = { .mfcc = {0.0,}, };
-  
-  whs_extractor_process (self->priv->extractor, self->priv->mono, &vec);
-  if (mode & WHS_IDENTIFIER_MODE_CLASSIFY) {
-    whs_classifier_process (self->priv->classifier, &vec, res);
-  }
+  priv->block_mode = mode;
+}
 
-  if (mode & WHS_IDENTIFIER_MODE_LOCALIZE) {
-    whs_localizer_process (self->priv->localizer, (const gfloat **) self->priv->input, &vec, res);
+/* An incomplete hop is kept as filtered channels when localizing and as
+ * unfiltered mono signal otherwise, which is only filtered once the hop
+ * is complete. So the mode may only change once all frames pushed so far
+ * add up to whole hops. Whatever the newly enabled parts kept from before
+ * is thrown away then, so their first frame only contains the new input */
+void
+whs_identifier_push (WhsIdentifier *self, const gfloat *in, guint n_frames,
+    WhsIdentifierMode mode, WhsIdentifierResultFunc func, gpointer user_data)
+{
+  g_return_if_fail (WHS_IS_IDENTIFIER (self));
+  g_return_if_fail (in != NULL || n_frames == 0);
+  g_return_if_fail (WHS_IDENTIFIER_MODE_IS_VALID (mode));
+  g_return_if_fail (!(mode & WHS_IDENTIFIER_MODE_LOCALIZE) || self->priv->localizer);
+  g_return_if_fail (self->priv->fill == 0 || mode == self->priv->block_mode);
+
+  WhsIdentifierPrivate *priv = self->priv;
+  guint nchannels = self->nchannels;
+
+  if (mode != priv->block_mode)
+    whs_identifier_change_mode (self, mode);
+
+  while (n_frames > 0) {
+    guint n = MIN (n_frames, priv->block_length - priv->fill);
+
+    // The channels themselves are only needed for localization, otherwise
+    // only mix down to mono. The fast path needs the energy before filtering
+    if (mode & WHS_IDENTIFIER_MODE_LOCALIZE) {
+      for (gint i = 0; i < n; i++) {
+        gfloat mono = 0.0;
+
+        for (gint j = 0; j < nchannels; j++)
+          mono += in[i * nchannels + j];
+        mono /= nchannels;
+        priv->block_energy[(priv->fill + i) / self->hop_length] += mono * mono;
+      }
+
+      // Filter straight from the interleaved input into the channel buffers
+      if (priv->bandpass) {
+        gfloat *out[nchannels];
+
+        for (gint j = 0; j < nchannels; j++)
+          out[j] = &priv->block[j][priv->fill];
+        whs_bandpass_process_interleaved (priv->bandpass, in, nchannels, out, n);
+      } else {
+        for (gint i = 0; i < n; i++)
+          for (gint j = 0; j < nchannels; j++)
+            priv->block[j][priv->fill + i] = in[i * nchannels + j];
+      }
+    } else {
+      for (gint i = 0; i < n; i++) {
+        gfloat mono = 0.0;
+
+        for (gint j = 0; j < nchannels; j++)
+          mono += in[i * nchannels + j];
+        mono /= nchannels;
+        priv->block_mono[priv->fill + i] = mono;
+        priv->block_energy[(priv->fill + i) / self->hop_length] += mono * mono;
+      }
+    }
+
+    priv->fill += n;
+    in += n * nchannels;
+    n_frames -= n;
+
+    whs_identifier_process_block (self, mode, func, user_data);
   }
+}
 
-  whs_identifier_postprocess (self, res);
+guint
+whs_identifier_get_n_results (WhsIdentifier *self, guint n_frames)
+{
+  g_return_val_if_fail (WHS_IS_IDENTIFIER (self), 0);
 
-  return res;
+  return (self->priv->fill + n_frames) / self->hop_length;
+}
+
+typedef struct
+{
+  WhsResult *res;
+  guint64 *offsets;
+  guint n;
+} WhsIdentifierResults;
+
+static void
+whs_identifier_store_results (WhsIdentifier *self, const WhsResult *res,
+    guint64 offset, gpointer user_data)
+{
+  WhsIdentifierResults *results = user_data;
+  guint n_classifiers = self->priv->n_classifiers;
+
+  memcpy (&results->res[results->n * n_classifiers], res, n_classifiers * sizeof (WhsResult));
+  if (results->offsets)
+    results->offsets[results->n] = offset;
+  results->n++;
+}
+
+guint
+whs_identifier_push_into (WhsIdentifier *self, const gfloat *in, guint n_frames,
+    WhsIdentifierMode mode, WhsResult *res, guint64 *offsets)
+{
+  WhsIdentifierResults results = { res, offsets, 0 };
+
+  g_return_val_if_fail (WHS_IS_IDENTIFIER (self), 0);
+  g_return_val_if_fail (res != NULL || whs_identifier_get_n_results (self, n_frames) == 0, 0);
+
+  whs_identifier_push (self, in, n_frames, mode, whs_identifier_store_results, &results);
+
+  return results.n;
+}
+
+void
+whs_identifier_process_bulk (WhsIdentifier *self, const gfloat *in, guint n,
+    WhsIdentifierMode mode, WhsResult *res)
+{
+  g_return_if_fail (WHS_IS_IDENTIFIER (self));
+  g_return_if_fail (in != NULL || n == 0);
+  g_return_if_fail (res != NULL || n == 0);
+  g_return_if_fail (WHS_IDENTIFIER_MODE_IS_VALID (mode));
+
+  // Every hop_length new samples complete exactly one hop
+  whs_identifier_push_into (self, in, n * self->hop_length, mode, res, NULL);
 }
 
+void
+whs_identifier_process_into (WhsIdentifier *self, const gfloat *in,
+    WhsIdentifierMode mode, WhsResult *res)
+{
+  whs_identifier_process_bulk (self, in, 1, mode, res);
+}
+
+WhsResult *
+whs_identifier_process (WhsIdentifier *self, const gfloat *in,
+    WhsIdentifierMode mode)
+{
+  g_return_val_if_fail (WHS_IS_IDENTIFIER (self), NULL);
+  g_return_val_if_fail (in != NULL, NULL);
+  g_return_val_if_fail (WHS_IDENTIFIER_MODE_IS_VALID (mode), NULL);
+
+  WhsResult *res = g_new0 (WhsResult, 1);
+
+  whs_identifier_process_into (self, in, mode, res);
+
+  return res;
+}
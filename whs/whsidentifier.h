@@ -31,6 +31,9 @@ typedef enum {
   WHS_IDENTIFIER_MODE_LOCALIZE = 1 << 1
 } WhsIdentifierMode;
 
+#define WHS_IDENTIFIER_MODE_IS_VALID(mode) \
+    ((mode) != 0 && ((mode) & ~(WHS_IDENTIFIER_MODE_CLASSIFY | WHS_IDENTIFIER_MODE_LOCALIZE)) == 0)
+
 #define WHS_TYPE_IDENTIFIER          (whs_identifier_get_type())
 #define WHS_IS_IDENTIFIER(obj)       (G_TYPE_CHECK_INSTANCE_TYPE ((obj), WHS_TYPE_IDENTIFIER))
 #define WHS_IS_IDENTIFIER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), WHS_TYPE_IDENTIFIER))
@@ -43,12 +46,18 @@ typedef struct _WhsIdentifier WhsIdentifier;
 typedef struct _WhsIdentifierClass WhsIdentifierClass;
 typedef struct _WhsIdentifierPrivate WhsIdentifierPrivate;
 
+/* offset is the stream position of the first sample of the
+ * hop that completed the analyzed frame */
+typedef void (*WhsIdentifierResultFunc) (WhsIdentifier *self, const WhsResult *res,
+    guint64 offset, gpointer user_data);
+
 struct _WhsIdentifier
 {
   WhsObject parent;
 
   guint sample_rate;
   guint frame_length;
+  guint hop_length;
   guint nchannels;
   WhsIdentifierPrivate *priv;
 };
@@ -62,8 +71,19 @@ GType whs_identifier_get_type (void);
 
 WhsIdentifier * whs_identifier_new (guint sample_rate, guint frame_length,
     guint nchannels, guint distance, WhsPattern *pattern) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+WhsIdentifier * whs_identifier_new_full (guint sample_rate, guint frame_length,
+    guint hop_length, guint nchannels, guint distance, WhsPattern *pattern) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
 WhsResult * whs_identifier_process (WhsIdentifier *self, const gfloat *in,
     WhsIdentifierMode mode) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+void whs_identifier_process_into (WhsIdentifier *self, const gfloat *in,
+    WhsIdentifierMode mode, WhsResult *res);
+void whs_identifier_process_bulk (WhsIdentifier *self, const gfloat *in, guint n,
+    WhsIdentifierMode mode, WhsResult *res);
+void whs_identifier_push (WhsIdentifier *self, const gfloat *in, guint n_frames,
+    WhsIdentifierMode mode, WhsIdentifierResultFunc func, gpointer user_data);
+guint whs_identifier_push_into (WhsIdentifier *self, const gfloat *in, guint n_frames,
+    WhsIdentifierMode mode, WhsResult *res, guint64 *offsets);
+guint whs_identifier_get_n_results (WhsIdentifier *self, guint n_frames);
 
 G_END_DECLS
 
@@ -27,6 +27,8 @@
 #include "classifier.h"
 #include "whsbandpass.h"
 #include "whsutils.h"
+#include "whsfeaturestore.h"
+#include "whsstatefile.h"
 #include "whspatternprivate.h"
 #include "whsprivate.h"
 
@@ -41,12 +43,21 @@ struct _WhsLearnerPrivate
 
   gfloat *in;
 
-  GList *vals;
-  gint count;
+  WhsFeatureStore *store;
+
+  /* Rows and sequences that are already in the state file, only
+   * the newer ones are appended when it is saved again */
+  gchar *state_file;
+  guint saved_n, saved_sequences;
+  /* Encoding of the last save */
+  WhsStateEncoding encoding;
 
   guint min_freq, max_freq;
 };
 
+/* Number of vectors classified at once by whs_learner_evaluate() */
+#define EVALUATE_BATCH (64)
+
 #define WHS_LEARNER_GET_PRIVATE(obj)  \
     (G_TYPE_INSTANCE_GET_PRIVATE ((obj), WHS_TYPE_LEARNER, WhsLearnerPrivate))
 
@@ -76,12 +87,6 @@ whs_learner_init (WhsLearner * self)
   self->priv = WHS_LEARNER_GET_PRIVATE (self);
 }
 
-static void
-_result_free (WhsResultValue *res)
-{
-  g_slice_free (WhsResultValue, res);
-}
-
 static void
 whs_learner_finalize (WhsObject *object)
 {
@@ -92,13 +97,19 @@ whs_learner_finalize (WhsObject *object)
     self->priv->extractor = NULL;
   }
 
-  if (self->priv->vals) {
-    g_list_foreach (self->priv->vals, (GFunc) _result_free, NULL);
-    g_list_free (self->priv->vals);
-    self->priv->vals = NULL;
-    self->priv->count = 0;
+  if (self->priv->classifier) {
+    whs_object_unref (self->priv->classifier);
+    self->priv->classifier = NULL;
+  }
+
+  if (self->priv->store) {
+    whs_feature_store_free (self->priv->store);
+    self->priv->store = NULL;
   }
 
+  g_free (self->priv->state_file);
+  self->priv->state_file = NULL;
+
   if (self->priv->bandpass) {
     whs_bandpass_free (self->priv->bandpass);
     self->priv->bandpass = NULL;
@@ -155,6 +166,11 @@ whs_learner_new (const gchar *classifier, guint sample_rate, guint frame_length,
 
   self->priv->extractor = whs_extractor_new (sample_rate, frame_length, min_freq, max_freq);
   self->priv->classifier = whs_classifier_new (classifier, pattern);
+  if (!self->priv->classifier) {
+    g_warning ("Can't create classifier %s", classifier);
+    whs_object_unref (self);
+    return NULL;
+  }
 
   self->priv->min_freq = CLAMP (min_freq, 0, G_MAXUINT32);
   self->priv->max_freq = CLAMP (max_freq, 0, G_MAXUINT32);
@@ -163,6 +179,7 @@ whs_learner_new (const gchar *classifier, guint sample_rate, guint frame_length,
     self->priv->bandpass = whs_bandpass_new (sample_rate, 1, min_freq, max_freq);
 
   self->priv->in = g_new (gfloat, frame_length);
+  self->priv->store = whs_feature_store_new ();
 
   return self;
 }
@@ -187,27 +204,46 @@ whs_learner_process (WhsLearner *self, gint result, const gfloat *in)
 
   whs_learner_preprocess (self, in);
 
-  WhsResultValue *res = g_slice_new (WhsResultValue);
-  
-  res->result = result;
-  whs_extractor_process (self->priv->extractor, self->priv->in, &res->vec);
-
-  self->priv->vals = g_list_prepend (self->priv->vals, res);
-  self->priv->count++;
+  whs_extractor_process (self->priv->extractor, self->priv->in, whs_feature_store_append (self->priv->store, result));
 
   return TRUE;
 }
 
+void
+whs_train_options_init (WhsTrainOptions *options, gfloat rate)
+{
+  g_return_if_fail (options != NULL);
+
+  memset (options, 0, sizeof (WhsTrainOptions));
+  options->rate = rate;
+  options->optimizer = WHS_OPTIMIZER_MOMENTUM;
+}
+
 WhsPattern *
 whs_learner_generate_pattern (WhsLearner *self, gfloat rate)
+{
+  WhsTrainOptions options;
+
+  whs_train_options_init (&options, rate);
+
+  return whs_learner_generate_pattern_full (self, &options);
+}
+
+WhsPattern *
+whs_learner_generate_pattern_full (WhsLearner *self, const WhsTrainOptions *options)
 {
   g_return_val_if_fail (WHS_IS_LEARNER (self), NULL);
+  g_return_val_if_fail (options != NULL, NULL);
 
-  self->priv->vals = g_list_reverse (self->priv->vals);
+  if (self->priv->store->n == 0) {
+    g_warning ("Nothing learned");
+    return NULL;
+  }
 
-  WhsPattern *ret = whs_classifier_learn (self->priv->classifier, self->priv->vals, self->priv->count, rate);
-  
-  self->priv->vals = g_list_reverse (self->priv->vals);
+  WhsPattern *ret = whs_classifier_learn (self->priv->classifier, self->priv->store, options);
+
+  if (!ret)
+    return NULL;
 
   whs_pattern_set_frequency_band (ret, self->priv->min_freq, self->priv->max_freq);
   whs_pattern_set_sample_rate (ret, self->sample_rate);
@@ -220,139 +256,68 @@ whs_learner_finish_sequence (WhsLearner *self)
 {
   g_return_if_fail (WHS_IS_LEARNER (self));
 
-  WhsResultValue *res = g_slice_new0 (WhsResultValue);
-  
-  res->result = G_MININT32;
-  self->priv->vals = g_list_prepend (self->priv->vals, res);
-  self->priv->count++;
+  whs_feature_store_finish_sequence (self->priv->store);
 }
 
+/* Saving to the file the learner was loaded from or last saved to
+ * only appends the sequences that were learned since then */
 gboolean
 whs_learner_save_state (WhsLearner *self, const gchar *filename)
 {
   g_return_val_if_fail (WHS_IS_LEARNER (self), FALSE);
   g_return_val_if_fail (filename != NULL && *filename != '\0', FALSE);
 
-
-  // Prepend dummy value to detect where one sequence ends and another one starts
   // Assumes that the learner is saved after each sequence
   whs_learner_finish_sequence (self);
 
-  guint32 tmp;
-  FILE *f = g_fopen (filename, "wb");
-  size_t ret;
+  const WhsFeatureStore *store = self->priv->store;
 
-  if (!f) {
-    g_warning ("Can't open file");
-    return FALSE;
-  }
+  if (!self->priv->state_file || strcmp (self->priv->state_file, filename) != 0 ||
+      !whs_state_file_append (filename, self->priv->min_freq, self->priv->max_freq, self->sample_rate,
+          store, self->priv->saved_n, self->priv->saved_sequences, self->priv->encoding))
+    return whs_learner_save_state_full (self, filename, self->priv->encoding);
 
-  // Header
-  if ((ret = fwrite ("WHSL", 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Wrote only %d of 4 bytes", ret);
-    else
-      g_warning ("Write failed: %s", strerror (ret));
+  self->priv->saved_n = store->n;
+  self->priv->saved_sequences = store->n_sequences;
 
-    fclose (f);
-    return FALSE;
-  }
-
-  // Min and max frequency
-  tmp = GUINT32_TO_BE (self->priv->min_freq);
-  if ((ret = fwrite (&tmp, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Wrote only %d of 4 bytes", ret);
-    else
-      g_warning ("Write failed: %s", strerror (ret));
-
-    fclose (f);
-    return FALSE;
-  }
+  return TRUE;
+}
 
-  tmp = GUINT32_TO_BE (self->priv->max_freq);
-  if ((ret = fwrite (&tmp, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Wrote only %d of 4 bytes", ret);
-    else
-      g_warning ("Write failed: %s", strerror (ret));
+/* Always writes the whole file with all vectors stored with encoding,
+ * even if it is the file the learner was loaded from. Later
+ * whs_learner_save_state() calls append with the same encoding */
+gboolean
+whs_learner_save_state_full (WhsLearner *self, const gchar *filename, WhsStateEncoding encoding)
+{
+  g_return_val_if_fail (WHS_IS_LEARNER (self), FALSE);
+  g_return_val_if_fail (filename != NULL && *filename != '\0', FALSE);
+  g_return_val_if_fail (encoding == WHS_STATE_ENCODING_PLAIN || encoding == WHS_STATE_ENCODING_HALF ||
+      encoding == WHS_STATE_ENCODING_Q8, FALSE);
 
-    fclose (f);
-    return FALSE;
-  }
+  whs_learner_finish_sequence (self);
 
-  // Sample rate
-  tmp = GUINT32_TO_BE (self->sample_rate);
-  if ((ret = fwrite (&tmp, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Wrote only %d of 4 bytes", ret);
-    else
-      g_warning ("Write failed: %s", strerror (ret));
+  const WhsFeatureStore *store = self->priv->store;
 
-    fclose (f);
+  if (!whs_state_file_write (filename, self->priv->min_freq, self->priv->max_freq, self->sample_rate, store, encoding))
     return FALSE;
-  }
-  
-  // Data size
-  tmp = self->priv->count * (sizeof (gint32) + 32 * sizeof (gfloat));
-  tmp = GUINT32_TO_BE (tmp);
-  if ((ret = fwrite (&tmp, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Wrote only %d of 4 bytes", ret);
-    else
-      g_warning ("Write failed: %s", strerror (ret));
-
-    fclose (f);
-    return FALSE;
-  }
-
-  // Data
-  for (GList *l = self->priv->vals; l != NULL; l = l->next) {
-    WhsResultValue *res = (WhsResultValue *) l->data;
-    gint32 result = GINT32_TO_BE (res->result);
-
-    if ((ret = fwrite (&result, 1, 4, f)) < 4) {
-      if (ret >= 0)
-        g_warning ("Wrote only %d of 4 bytes", ret);
-      else
-        g_warning ("Write failed: %s", strerror (ret));
-      fclose (f);
-      return FALSE;
-    }
 
-    for (gint i = 0; i < 32; i++) {
-      gfloat mfcc = GFLOAT_TO_BE (res->vec.mfcc[i]);
-      
-      if ((ret = fwrite (&mfcc, 1, 4, f)) < 4) {
-        if (ret >= 0)
-	  g_warning ("Wrote only %d of 4 bytes", ret);
-	else
-	  g_warning ("Write failed: %s", strerror (ret));
-        fclose (f);
-        return FALSE;
-      }
-    }
-  }
+  self->priv->encoding = encoding;
+  g_free (self->priv->state_file);
+  self->priv->state_file = g_strdup (filename);
+  self->priv->saved_n = store->n;
+  self->priv->saved_sequences = store->n_sequences;
 
-  fclose (f);
   return TRUE;
 }
 
-WhsLearner *
-whs_learner_new_from_state (const gchar *classifier, guint sample_rate, guint frame_length, const gchar *filename, WhsPattern *pattern)
+static WhsLearner *
+whs_learner_new_from_state_file (const gchar *classifier, guint sample_rate, guint frame_length, const gchar *filename, WhsPattern *pattern, gboolean map)
 {
   g_return_val_if_fail (filename != NULL && *filename != '\0', NULL);
   g_return_val_if_fail (frame_length > 0, NULL);
   g_return_val_if_fail (sample_rate >= 0, NULL);
   g_return_val_if_fail (pattern == NULL || WHS_IS_PATTERN (pattern), NULL);
 
-  FILE *f = g_fopen (filename, "rb");
-
-  if (!f) {
-    g_warning ("Can't open file");
-    return NULL;
-  }
-
   guint min_freq = 0, max_freq = 0, sr = 0;
 
   if (pattern != NULL) {
@@ -375,135 +340,120 @@ whs_learner_new_from_state (const gchar *classifier, guint sample_rate, guint fr
     }
   }
 
-  size_t ret;
-  
-  // Header
-  gchar header[4];
-  if ((ret = fread (&header, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Read only %d of 4 bytes", ret);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
-    fclose (f);
-    return NULL;
-  }
-
-  if (strncmp (header, "WHSL", 4) != 0) {
-    g_warning ("Not a valid learner state file");
-    fclose (f);
-    return NULL;
-  }
+  guint file_min_freq, file_max_freq, file_sample_rate;
+  WhsFeatureStore *store = map ? whs_state_file_map (filename, &file_min_freq, &file_max_freq, &file_sample_rate) :
+      whs_state_file_read (filename, &file_min_freq, &file_max_freq, &file_sample_rate);
 
-  // Min and max frequency
-  guint32 tmp;
-  if ((ret = fread (&tmp, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Read only %d of 4 bytes", ret);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
-    fclose (f);
+  if (!store)
     return NULL;
-  }
 
-  if (pattern != NULL && min_freq != GUINT32_FROM_BE (tmp)) {
+  if (pattern != NULL && min_freq != file_min_freq) {
     g_warning ("Incompatible minimum frequency given");
+    whs_feature_store_free (store);
     return NULL;
-  } else if (pattern == NULL) {
-    min_freq = GUINT32_FROM_BE (tmp);
-  }
-
-  if ((ret = fread (&tmp, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Read only %d of 4 bytes", ret);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
-    fclose (f);
-    return NULL;
-  }
-
-  if (pattern != NULL && max_freq != GUINT32_FROM_BE (tmp)) {
+  } else if (pattern != NULL && max_freq != file_max_freq) {
     g_warning ("Incompatible maximum frequency given");
+    whs_feature_store_free (store);
     return NULL;
-  } else if (pattern == NULL) {
-    max_freq = GUINT32_FROM_BE (tmp);
-  }
-
-  // Sample rate
-  if ((ret = fread (&tmp, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Read only %d of 4 bytes", ret);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
-    fclose (f);
-    return NULL;
-  }
-
-  if (pattern != NULL && sample_rate != GUINT32_FROM_BE (tmp)) {
+  } else if (pattern != NULL && sample_rate != file_sample_rate) {
     g_warning ("Incompatible sampling rate given");
+    whs_feature_store_free (store);
     return NULL;
-  } else if (pattern == NULL) {
-    sample_rate = GUINT32_FROM_BE (tmp);
   }
 
-  // Data size
-  guint32 size;
-  if ((ret = fread (&size, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Read only %d of 4 bytes", ret);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
-    fclose (f);
+  WhsLearner *self = whs_learner_new (classifier, file_sample_rate, frame_length, file_min_freq, file_max_freq, pattern);
+  if (!self) {
+    whs_feature_store_free (store);
     return NULL;
   }
-  size = GUINT32_FROM_BE (size);
 
-  if (size % (4 + 32 * 4) != 0) {
-    g_warning ("Invalid size");
-    fclose (f);
-    return NULL;
-  }
+  whs_feature_store_free (self->priv->store);
+  self->priv->store = store;
 
-  WhsLearner *self = whs_learner_new (classifier, sample_rate, frame_length, min_freq, max_freq, pattern);
+  self->priv->state_file = g_strdup (filename);
+  self->priv->saved_n = store->n;
+  self->priv->saved_sequences = store->n_sequences;
 
-  // Data
-  gint nresults = size / (4 + 32 * 4);
+  return self;
+}
 
-  for (gint i = 0; i < nresults; i++) {
-    WhsResultValue *res = g_slice_new (WhsResultValue);
+WhsLearner *
+whs_learner_new_from_state (const gchar *classifier, guint sample_rate, guint frame_length, const gchar *filename, WhsPattern *pattern)
+{
+  return whs_learner_new_from_state_file (classifier, sample_rate, frame_length, filename, pattern, FALSE);
+}
 
-    if ((ret = fread (&res->result, 1, 4, f)) < 4) {
-      if (ret >= 0)
-        g_warning ("Read only %d of 4 bytes", ret);
-      else
-        g_warning ("Read failed: %s", strerror (ret));
-      g_slice_free (WhsResultValue, res);
-      fclose (f);
-      whs_object_unref (self);
-      return NULL;
+/* Like whs_learner_new_from_state(), but uses the rows of the file in
+ * place instead of reading them into memory, so it can be larger than
+ * the memory. Files with encoded vectors are still decoded into memory.
+ * The file must not be overwritten while the learner exists, saving
+ * the state to it again only appends to it */
+WhsLearner *
+whs_learner_map_state (const gchar *classifier, guint sample_rate, guint frame_length, const gchar *filename, WhsPattern *pattern)
+{
+  return whs_learner_new_from_state_file (classifier, sample_rate, frame_length, filename, pattern, TRUE);
+}
+
+/* Classifies the learned vectors with pattern, or the classifier of
+ * the learner if pattern is NULL. rate is set to the fraction of
+ * correctly classified vectors and mse to the mean squared error */
+gboolean
+whs_learner_evaluate (WhsLearner *self, WhsPattern *pattern, gdouble *rate, gdouble *mse)
+{
+  g_return_val_if_fail (WHS_IS_LEARNER (self), FALSE);
+  g_return_val_if_fail (pattern == NULL || WHS_IS_PATTERN (pattern), FALSE);
+
+  WhsClassifier *classifier;
+
+  if (pattern) {
+    guint min, max;
+
+    whs_pattern_get_frequency_band (pattern, &min, &max);
+    if (min != self->priv->min_freq || max != self->priv->max_freq ||
+        whs_pattern_get_sample_rate (pattern) != self->sample_rate) {
+      g_warning ("Pattern doesn't match the learned values");
+      return FALSE;
     }
-    res->result = GINT32_FROM_BE (res->result);
-
-    for (gint j = 0; j < 32; j++) {
-      if ((ret = fread (&res->vec.mfcc[j], 1, 4, f)) < 4) {
-        if (ret >= 0)
-	  g_warning ("Read only %d of 4 bytes", ret);
-	else
-	  g_warning ("Read failed: %s", strerror (ret));
-        fclose (f);
-        g_slice_free (WhsResultValue, res);
-        whs_object_unref (self);
-        return NULL;
-      }
-      res->vec.mfcc[j] = GFLOAT_FROM_BE (res->vec.mfcc[j]);
+
+    classifier = whs_classifier_new (whs_pattern_get_classifier_name (pattern), pattern);
+    if (!classifier) {
+      g_warning ("Can't create classifier %s", whs_pattern_get_classifier_name (pattern));
+      return FALSE;
+    }
+  } else {
+    classifier = WHS_CLASSIFIER_CAST (whs_object_ref (self->priv->classifier));
+  }
+
+  const WhsFeatureStore *store = self->priv->store;
+  WhsResult res[EVALUATE_BATCH];
+  gint n = 0, correct = 0;
+  gdouble sum = 0.0;
+
+  for (guint i = 0; i < store->n; ) {
+    const gint32 *labels;
+    const WhsFeatureVector *vecs;
+    guint len = MIN (EVALUATE_BATCH, whs_feature_store_get_run (store, i, &labels, &vecs));
+
+    whs_classifier_process_batch (classifier, vecs, len, res);
+
+    for (guint b = 0; b < len; b++) {
+      if (labels[b] < 0)
+        continue;
+
+      if (whs_classifier_rate (&res[b], labels[b], &sum))
+        correct++;
+      n++;
     }
 
-    self->priv->vals = g_list_prepend (self->priv->vals, res);
+    i += len;
   }
-  self->priv->vals = g_list_reverse (self->priv->vals);
-  self->priv->count = nresults;
 
-  fclose (f);
- 
-  return self;
-}
+  whs_object_unref (classifier);
 
+  if (rate)
+    *rate = (n > 0) ? ((gdouble) correct) / n : 0.0;
+  if (mse)
+    *mse = (n > 0) ? sum / n : 0.0;
+
+  return TRUE;
+}
@@ -36,6 +36,50 @@ G_BEGIN_DECLS
 typedef struct _WhsLearner WhsLearner;
 typedef struct _WhsLearnerClass WhsLearnerClass;
 typedef struct _WhsLearnerPrivate WhsLearnerPrivate;
+typedef struct _WhsTrainOptions WhsTrainOptions;
+
+typedef enum {
+  WHS_OPTIMIZER_MOMENTUM = 0,
+  WHS_OPTIMIZER_RPROP = 1,
+  WHS_OPTIMIZER_ADAM = 2
+} WhsOptimizer;
+
+/* Encoding of the feature vectors in learner state files. HALF stores
+ * them as half precision floats and Q8 with 8 bits per coefficient,
+ * both are lossy */
+typedef enum {
+  WHS_STATE_ENCODING_PLAIN = 0,
+  WHS_STATE_ENCODING_HALF = 1,
+  WHS_STATE_ENCODING_Q8 = 2
+} WhsStateEncoding;
+
+/* Options for generating a pattern, initialized to the defaults by
+ * whs_train_options_init(). Training stops as soon as rate of the values
+ * is classified correctly, when one of the limits is reached or when the
+ * validation error didn't improve for patience epochs. The best weights
+ * are kept in the latter cases, by the validation error if a fraction of
+ * the values is held out for validation */
+struct _WhsTrainOptions
+{
+  gfloat rate;
+
+  WhsOptimizer optimizer;
+  /* Step size, 0 for the default of the optimizer */
+  gfloat learn_rate;
+
+  /* 0 for no limit */
+  guint max_epochs;
+  gdouble max_time;
+
+  /* Fraction of the values that is only used for validation */
+  gfloat validation;
+  /* 0 to never stop early */
+  guint patience;
+
+  /* Fraction of the training values that is used in each epoch,
+   * a different random selection of chunks every time. 0 for all */
+  gfloat sample;
+};
 
 struct _WhsLearner
 {
@@ -59,10 +103,16 @@ gboolean whs_learner_process (WhsLearner *self, gint result, const gfloat *in);
 
 void whs_learner_finish_sequence (WhsLearner *self);
 
+void whs_train_options_init (WhsTrainOptions *options, gfloat rate);
+
 WhsPattern * whs_learner_generate_pattern (WhsLearner *self, gfloat rate) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+WhsPattern * whs_learner_generate_pattern_full (WhsLearner *self, const WhsTrainOptions *options) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+gboolean whs_learner_evaluate (WhsLearner *self, WhsPattern *pattern, gdouble *rate, gdouble *mse);
 
 gboolean whs_learner_save_state (WhsLearner *self, const gchar *filename);
+gboolean whs_learner_save_state_full (WhsLearner *self, const gchar *filename, WhsStateEncoding encoding);
 WhsLearner * whs_learner_new_from_state (const gchar *classifier, guint sample_rate, guint frame_length, const gchar *filename, WhsPattern *pattern) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+WhsLearner * whs_learner_map_state (const gchar *classifier, guint sample_rate, guint frame_length, const gchar *filename, WhsPattern *pattern) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
 
 G_END_DECLS
 
@@ -32,6 +32,10 @@
 //#define WHS_LOCALIZER_PHASE_DELAY
 #define V_SOUND (34400.0)
 
+// WHS_LOCALIZER_METHOD_AUTO uses GCC-PHAT instead of the time domain cross
+// correlation if 2 * max_range is larger than this times log2 (2 * frame_length)
+#define WHS_LOCALIZER_PHAT_FACTOR (8)
+
 struct _WhsLocalizerPrivate
 {
   #ifdef WHS_LOCALIZER_PHASE_DELAY
@@ -41,7 +45,14 @@ struct _WhsLocalizerPrivate
 
   gfloat *cos;
   #else
-  gfloat **input;
+  gint max_range;
+  gdouble *xcorr;
+
+  /* FFT data for GCC-PHAT */
+  gboolean phat;
+  gfloat *fft[2];
+  gint *ip;
+  gfloat *w;
   #endif
 };
 
@@ -87,9 +98,11 @@ whs_localizer_finalize (WhsObject *object)
   g_free (self->priv->w);
   g_free (self->priv->cos);
 #else
-  for (gint i = 0; i < 2; i++)
-    g_free (self->priv->input[i]);
-  g_free (self->priv->input);
+  g_free (self->priv->xcorr);
+  g_free (self->priv->fft[0]);
+  g_free (self->priv->fft[1]);
+  g_free (self->priv->ip);
+  g_free (self->priv->w);
 #endif
 
   WHS_OBJECT_CLASS (parent_class)->finalize (object);
@@ -97,9 +110,17 @@ whs_localizer_finalize (WhsObject *object)
 
 WhsLocalizer *
 whs_localizer_new (guint sample_rate, guint frame_length, guint nchannels, guint distance)
+{
+  return whs_localizer_new_full (sample_rate, frame_length, nchannels, distance, WHS_LOCALIZER_METHOD_AUTO);
+}
+
+WhsLocalizer *
+whs_localizer_new_full (guint sample_rate, guint frame_length, guint nchannels, guint distance,
+    WhsLocalizerMethod method)
 {
   g_return_val_if_fail (frame_length > 0, NULL);
   g_return_val_if_fail (sample_rate > 0, NULL);
+  g_return_val_if_fail (method <= WHS_LOCALIZER_METHOD_PHAT, NULL);
 
   g_return_val_if_fail (nchannels == 2, NULL);
 
@@ -121,24 +142,144 @@ whs_localizer_new (guint sample_rate, guint frame_length, guint nchannels, guint
   for (gint i = 0; i < frame_length; i++)
     self->priv->cos[i] = 0.53836 - 0.46164 * cos (2.0 * M_PI * i / (frame_length-1));
 #else
-  self->priv->input = g_new (gfloat *, 2);
-  for (gint i = 0; i < 2; i++)
-    self->priv->input[i] = g_new0 (gfloat, frame_length * 2);
+  // Lags beyond half a frame can't be found in the history
+  self->priv->max_range = MIN (1 + (distance * sample_rate) / V_SOUND, frame_length / 2);
+  self->priv->xcorr = g_new (gdouble, 2 * self->priv->max_range);
+
+  // The cross correlation in the time domain needs 2 * max_range * frame_length
+  // operations, in the frequency domain it's three FFTs of size 2 * frame_length
+  if (method == WHS_LOCALIZER_METHOD_AUTO)
+    self->priv->phat = 2 * self->priv->max_range > WHS_LOCALIZER_PHAT_FACTOR * log2 (2 * frame_length);
+  else
+    self->priv->phat = (method == WHS_LOCALIZER_METHOD_PHAT);
+
+  if (self->priv->phat) {
+    self->priv->fft[0] = g_new0 (gfloat, 2 * frame_length);
+    self->priv->fft[1] = g_new0 (gfloat, 2 * frame_length);
+    self->priv->ip = g_new0 (gint, 3 + sqrt (frame_length));
+    self->priv->w = g_new0 (gfloat, frame_length + 1);
+  }
 #endif
 
   return self;
 }
 
-/* http://www.ise.ncsu.edu/kay/msf/sound.htm */
+#ifndef WHS_LOCALIZER_PHASE_DELAY
+
+/* Refines the position of the maximum at index 0 with the
+ * parabola through the maximum and its neighbours */
+static inline gdouble
+interpolate_peak (gdouble left, gdouble center, gdouble right)
+{
+  gdouble d = left - 2.0 * center + right;
+
+  if (d >= 0.0)
+    return 0.0;
+
+  return CLAMP (0.5 * (left - right) / d, -0.5, 0.5);
+}
+
+/* Returns the delay of the second channel in samples, interpolated
+ * like for GCC-PHAT so that both give the same sub-sample delays */
+static gdouble
+whs_localizer_xcorr (WhsLocalizer *self, const gfloat **in)
+{
+  gint frame_length = self->frame_length;
+  gint max_range = self->priv->max_range;
+  gint max = G_MININT;
+  gfloat maxv = - G_MAXFLOAT;
+  gdouble *xcorr = self->priv->xcorr;
+
+  // cross correlation
+  for (gint i = - max_range; i < max_range; i++) {
+    xcorr[i + max_range] = 0.0;
+
+    for (gint j = 0; j < frame_length; j++){
+      xcorr[i + max_range] += in[0][j + frame_length / 2] * in[1][j + frame_length / 2 + i];
+    }
+ 
+    if (xcorr[i + max_range] > maxv) {
+      maxv = xcorr[i + max_range];
+      max = i;
+    }
+  }
+
+  // At the ends of the range one neighbour is missing
+  if (max == - max_range || max == max_range - 1)
+    return max;
+
+  return max + interpolate_peak (xcorr[max + max_range - 1], xcorr[max + max_range], xcorr[max + max_range + 1]);
+}
+
+/* Generalized cross correlation with phase transform, see
+ * Knapp and Carter, "The generalized correlation method for
+ * estimation of time delay", 1976.
+ *
+ * Returns the delay of the second channel in samples */
+static gdouble
+whs_localizer_gcc_phat (WhsLocalizer *self, const gfloat **in)
+{
+  gint frame_length = self->frame_length;
+  gint n = 2 * frame_length;
+  gint max_range = self->priv->max_range;
+  gfloat **fft = self->priv->fft;
+  gint max = 0;
+  gfloat maxv = - G_MAXFLOAT;
+
+  // Zero padding to twice the frame length avoids circular wrap around
+  for (gint i = 0; i < 2; i++) {
+    memcpy (fft[i], &in[i][frame_length / 2], frame_length * sizeof (gfloat));
+    memset (&fft[i][frame_length], 0, frame_length * sizeof (gfloat));
+    rdftf (n, 1, fft[i], self->priv->ip, self->priv->w);
+  }
+
+  // Cross power spectrum, normalized to unit magnitude. fft[x][0] and
+  // fft[x][1] are the real valued DC and nyquist frequency
+  fft[0][0] = (fft[0][0] * fft[1][0] >= 0.0) ? 1.0 : -1.0;
+  fft[0][1] = (fft[0][1] * fft[1][1] >= 0.0) ? 1.0 : -1.0;
+
+  for (gint i = 2; i < n; i += 2) {
+    gfloat re = fft[0][i] * fft[1][i] + fft[0][i+1] * fft[1][i+1];
+    gfloat im = fft[0][i] * fft[1][i+1] - fft[0][i+1] * fft[1][i];
+    gfloat mag = sqrt (re * re + im * im);
+
+    if (mag > 0.0) {
+      fft[0][i] = re / mag;
+      fft[0][i+1] = im / mag;
+    } else {
+      fft[0][i] = fft[0][i+1] = 0.0;
+    }
+  }
+
+  rdftf (n, -1, fft[0], self->priv->ip, self->priv->w);
+
+  // Negative lags are at the end
+  for (gint i = - max_range; i < max_range; i++) {
+    gfloat v = fft[0][(i + n) % n];
+
+    if (v > maxv) {
+      maxv = v;
+      max = i;
+    }
+  }
+
+  return max + interpolate_peak (fft[0][(max - 1 + n) % n], maxv, fft[0][(max + 1 + n) % n]);
+}
+
+#endif
+
+/* http://www.ise.ncsu.edu/kay/msf/sound.htm
+ *
+ * in[0] and in[1] point to the last 2 * frame_length samples
+ * of each channel, the current frame is the second half */
 void
 whs_localizer_process (WhsLocalizer *self, const gfloat **in, const WhsFeatureVector *vec, WhsResult *res)
 {
   g_return_if_fail (WHS_IS_LOCALIZER (self));
   g_return_if_fail (in != NULL && in[0] != NULL && in[1] != NULL);
 
-  gint frame_length = self->frame_length;
-
 #ifdef WHS_LOCALIZER_PHASE_DELAY
+  gint frame_length = self->frame_length;
   gint *ip = self->priv->ip;
   gdouble *w = self->priv->w;
   gdouble **fft = self->priv->fft;
@@ -147,8 +288,8 @@ whs_localizer_process (WhsLocalizer *self, const gfloat **in, const WhsFeatureVe
   memset (ip, 0, (int)(3 + sqrt (frame_length / 2)));
 
   for (gint i = 0; i < self->frame_length; i++) {
-    fft[0][i] = in[0][i] * self->priv->cos[i];
-    fft[1][i] = in[1][i] * self->priv->cos[i];
+    fft[0][i] = in[0][frame_length + i] * self->priv->cos[i];
+    fft[1][i] = in[1][frame_length + i] * self->priv->cos[i];
   }
   rdft (frame_length, 1, fft[0], ip, w);
   rdft (frame_length, 1, fft[1], ip, w);
@@ -184,34 +325,16 @@ whs_localizer_process (WhsLocalizer *self, const gfloat **in, const WhsFeatureVe
     if (angle[i] > maxv)
       max = (i - 90);
   }
-  res->location = (max * M_PI) / 180.0;  
+  res->location = (max * M_PI) / 180.0;
 #else
-  gint max_range = 1 + (self->distance * self->sample_rate) / V_SOUND;
-  gint max = G_MININT;
-  gfloat maxv = - G_MAXFLOAT;
-  gfloat **input = self->priv->input;
-  gdouble xcorr[max_range * 2];
+  gdouble lag;
 
-  for (gint i = 0; i < 2; i++) {
-    g_memmove (input[i], &input[i][frame_length], frame_length * sizeof (gfloat));
-    g_memmove (&input[i][frame_length], in[i], frame_length * sizeof (gfloat));
-  }
-
-  // cross correlation
-  for (gint i = - max_range; i < max_range; i++) {
-    xcorr[i + max_range] = 0.0;
+  if (self->priv->phat)
+    lag = whs_localizer_gcc_phat (self, in);
+  else
+    lag = whs_localizer_xcorr (self, in);
 
-    for (gint j = 0; j < frame_length; j++){
-      xcorr[i + max_range] += input[0][j + frame_length / 2] * input[1][j + frame_length / 2 + i];
-    }
- 
-    if (xcorr[i + max_range] > maxv) {
-      maxv = xcorr[i + max_range];
-      max = i;
-    }
-  }
- 
-  gdouble itd = ((gdouble) max) / ((gdouble) self->sample_rate);
+  gdouble itd = lag / ((gdouble) self->sample_rate);
   itd *= V_SOUND;
   itd /= self->distance;
 
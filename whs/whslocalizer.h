@@ -27,6 +27,14 @@
 
 G_BEGIN_DECLS
 
+/* How the delay between the channels is estimated. AUTO picks whichever
+ * of the time domain cross correlation and GCC-PHAT is cheaper */
+typedef enum {
+  WHS_LOCALIZER_METHOD_AUTO,
+  WHS_LOCALIZER_METHOD_XCORR,
+  WHS_LOCALIZER_METHOD_PHAT
+} WhsLocalizerMethod;
+
 #define WHS_TYPE_LOCALIZER          (whs_localizer_get_type())
 #define WHS_IS_LOCALIZER(obj)       (G_TYPE_CHECK_INSTANCE_TYPE ((obj), WHS_TYPE_LOCALIZER))
 #define WHS_IS_LOCALIZER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), WHS_TYPE_LOCALIZER))
@@ -58,6 +66,8 @@ struct _WhsLocalizerClass
 G_GNUC_INTERNAL GType whs_localizer_get_type (void);
 
 G_GNUC_INTERNAL WhsLocalizer *whs_localizer_new (guint sample_rate, guint frame_length, guint nchannels, guint distance) G_GNUC_WARN_UNUSED_RESULT G_GNUC_MALLOC;
+G_GNUC_INTERNAL WhsLocalizer *whs_localizer_new_full (guint sample_rate, guint frame_length, guint nchannels, guint distance,
+    WhsLocalizerMethod method) G_GNUC_WARN_UNUSED_RESULT G_GNUC_MALLOC;
 G_GNUC_INTERNAL void whs_localizer_process (WhsLocalizer *self, const gfloat **in, const WhsFeatureVector *vec, WhsResult *res);
 
 G_END_DECLS
@@ -0,0 +1,268 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "whsmultiidentifier.h"
+#include "whsidentifierprivate.h"
+#include "whspatternprivate.h"
+
+#include <string.h>
+
+/* Number of hops whose results are collected from all groups at once */
+#define WHS_MULTI_IDENTIFIER_CHUNK (32)
+
+struct _WhsMultiIdentifierPrivate
+{
+  /* One identifier per frequency band, group g gives the results of
+   * the patterns pattern_index[group_start[g]...group_start[g + 1] - 1] */
+  WhsIdentifier **groups;
+  guint n_groups;
+  guint *group_start;
+  guint *pattern_index;
+
+  /* Results of all patterns for up to WHS_MULTI_IDENTIFIER_CHUNK + 1 hops */
+  WhsResult *results;
+  guint64 *offsets;
+};
+
+typedef struct
+{
+  WhsMultiIdentifier *self;
+  guint group;
+  guint n;
+} WhsMultiIdentifierGroupResults;
+
+#define WHS_MULTI_IDENTIFIER_GET_PRIVATE(obj)  \
+    (G_TYPE_INSTANCE_GET_PRIVATE ((obj), WHS_TYPE_MULTI_IDENTIFIER, WhsMultiIdentifierPrivate))
+
+static void whs_multi_identifier_init (WhsMultiIdentifier * self);
+static void whs_multi_identifier_class_init (WhsMultiIdentifierClass * klass);
+static void whs_multi_identifier_finalize (WhsObject *object);
+
+G_DEFINE_TYPE (WhsMultiIdentifier, whs_multi_identifier, WHS_TYPE_OBJECT);
+
+static WhsObjectClass *parent_class = NULL;
+
+static void
+whs_multi_identifier_class_init (WhsMultiIdentifierClass * klass)
+{
+  WhsObjectClass *o_klass = (WhsObjectClass *) klass;
+
+  parent_class = WHS_OBJECT_CLASS (g_type_class_peek_parent (klass));
+
+  g_type_class_add_private (klass, sizeof (WhsMultiIdentifierPrivate));
+
+  o_klass->finalize = whs_multi_identifier_finalize;
+}
+
+static void
+whs_multi_identifier_init (WhsMultiIdentifier * self)
+{
+  self->priv = WHS_MULTI_IDENTIFIER_GET_PRIVATE (self);
+}
+
+static void
+whs_multi_identifier_finalize (WhsObject *object)
+{
+  WhsMultiIdentifier *self = WHS_MULTI_IDENTIFIER (object);
+
+  if (self->priv->groups) {
+    for (gint i = 0; i < self->priv->n_groups; i++)
+      if (self->priv->groups[i])
+        whs_object_unref (self->priv->groups[i]);
+    g_free (self->priv->groups);
+    self->priv->groups = NULL;
+  }
+
+  g_free (self->priv->group_start);
+  self->priv->group_start = NULL;
+  g_free (self->priv->pattern_index);
+  self->priv->pattern_index = NULL;
+  g_free (self->priv->results);
+  self->priv->results = NULL;
+  g_free (self->priv->offsets);
+  self->priv->offsets = NULL;
+
+  WHS_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+WhsMultiIdentifier *
+whs_multi_identifier_new (guint sample_rate, guint frame_length, guint hop_length,
+    guint nchannels, guint distance, WhsPattern **patterns, guint n_patterns)
+{
+  g_return_val_if_fail (patterns != NULL && n_patterns > 0, NULL);
+
+  for (gint i = 0; i < n_patterns; i++)
+    g_return_val_if_fail (WHS_IS_PATTERN (patterns[i]), NULL);
+
+  // The input can't be resampled, so all patterns need its sample rate
+  for (gint i = 0; i < n_patterns; i++) {
+    if (whs_pattern_get_sample_rate (patterns[i]) != sample_rate) {
+      g_warning ("Incompatible sampling rate");
+      return NULL;
+    }
+  }
+
+  WhsMultiIdentifier *self = WHS_MULTI_IDENTIFIER_CAST (g_type_create_instance (WHS_TYPE_MULTI_IDENTIFIER));
+  WhsMultiIdentifierPrivate *priv = self->priv;
+
+  self->sample_rate = sample_rate;
+  self->frame_length = frame_length;
+  self->hop_length = hop_length;
+  self->nchannels = nchannels;
+  self->n_patterns = n_patterns;
+
+  // Group the patterns by their frequency band, keeping the order
+  // of the first pattern of every group
+  gint *group = g_new (gint, n_patterns);
+  WhsPattern **group_patterns = g_new (WhsPattern *, n_patterns);
+
+  priv->group_start = g_new0 (guint, n_patterns + 1);
+  priv->pattern_index = g_new (guint, n_patterns);
+
+  for (gint i = 0; i < n_patterns; i++) {
+    guint min_i, max_i;
+
+    whs_pattern_get_frequency_band (patterns[i], &min_i, &max_i);
+
+    group[i] = -1;
+    for (gint j = 0; j < i && group[i] < 0; j++) {
+      guint min_j, max_j;
+
+      whs_pattern_get_frequency_band (patterns[j], &min_j, &max_j);
+      if (min_i == min_j && max_i == max_j)
+        group[i] = group[j];
+    }
+
+    if (group[i] < 0)
+      group[i] = priv->n_groups++;
+  }
+
+  priv->groups = g_new0 (WhsIdentifier *, priv->n_groups);
+
+  guint n = 0;
+  for (gint g = 0; g < priv->n_groups; g++) {
+    guint n_group = 0;
+
+    priv->group_start[g] = n;
+    for (gint i = 0; i < n_patterns; i++) {
+      if (group[i] == g) {
+        priv->pattern_index[n++] = i;
+        group_patterns[n_group++] = patterns[i];
+      }
+    }
+
+    priv->groups[g] = whs_identifier_new_group (sample_rate, frame_length, hop_length,
+        nchannels, distance, group_patterns, n_group);
+    if (!priv->groups[g]) {
+      g_free (group);
+      g_free (group_patterns);
+      whs_object_unref (self);
+      return NULL;
+    }
+  }
+  priv->group_start[priv->n_groups] = n;
+
+  g_free (group);
+  g_free (group_patterns);
+
+  priv->results = g_new0 (WhsResult, (WHS_MULTI_IDENTIFIER_CHUNK + 1) * n_patterns);
+  priv->offsets = g_new0 (guint64, WHS_MULTI_IDENTIFIER_CHUNK + 1);
+
+  return self;
+}
+
+guint
+whs_multi_identifier_get_n_groups (WhsMultiIdentifier *self)
+{
+  g_return_val_if_fail (WHS_IS_MULTI_IDENTIFIER (self), 0);
+
+  return self->priv->n_groups;
+}
+
+static void
+whs_multi_identifier_store_results (WhsIdentifier *identifier, const WhsResult *res,
+    guint64 offset, gpointer user_data)
+{
+  WhsMultiIdentifierGroupResults *results = user_data;
+  WhsMultiIdentifierPrivate *priv = results->self->priv;
+  WhsResult *out = &priv->results[results->n * results->self->n_patterns];
+  guint start = priv->group_start[results->group];
+  guint end = priv->group_start[results->group + 1];
+
+  for (gint i = start; i < end; i++)
+    out[priv->pattern_index[i]] = res[i - start];
+
+  priv->offsets[results->n] = offset;
+  results->n++;
+}
+
+/* All groups get the same input, so they complete the
+ * same hops and their results can be merged by hop */
+void
+whs_multi_identifier_push (WhsMultiIdentifier *self, const gfloat *in, guint n_frames,
+    WhsIdentifierMode mode, WhsMultiIdentifierResultFunc func, gpointer user_data)
+{
+  g_return_if_fail (WHS_IS_MULTI_IDENTIFIER (self));
+  g_return_if_fail (in != NULL || n_frames == 0);
+  g_return_if_fail (WHS_IDENTIFIER_MODE_IS_VALID (mode));
+
+  WhsMultiIdentifierPrivate *priv = self->priv;
+  guint chunk = WHS_MULTI_IDENTIFIER_CHUNK * self->hop_length;
+
+  while (n_frames > 0) {
+    guint n = MIN (n_frames, chunk);
+    guint n_hops = 0;
+
+    for (gint g = 0; g < priv->n_groups; g++) {
+      WhsMultiIdentifierGroupResults results = { self, g, 0 };
+
+      whs_identifier_push (priv->groups[g], in, n, mode, whs_multi_identifier_store_results, &results);
+      n_hops = results.n;
+    }
+
+    if (func)
+      for (gint i = 0; i < n_hops; i++)
+        func (self, &priv->results[i * self->n_patterns], priv->offsets[i], user_data);
+
+    in += n * self->nchannels;
+    n_frames -= n;
+  }
+}
+
+static void
+whs_multi_identifier_copy_results (WhsMultiIdentifier *self, const WhsResult *res,
+    guint64 offset, gpointer user_data)
+{
+  memcpy (user_data, res, self->n_patterns * sizeof (WhsResult));
+}
+
+/* Processes one hop, res must have space for the results of all patterns */
+void
+whs_multi_identifier_process_into (WhsMultiIdentifier *self, const gfloat *in,
+    WhsIdentifierMode mode, WhsResult *res)
+{
+  g_return_if_fail (WHS_IS_MULTI_IDENTIFIER (self));
+  g_return_if_fail (in != NULL);
+  g_return_if_fail (res != NULL);
+
+  whs_multi_identifier_push (self, in, self->hop_length, mode, whs_multi_identifier_copy_results, res);
+}
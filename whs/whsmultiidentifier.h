@@ -0,0 +1,79 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WHS_MULTI_IDENTIFIER_H__
+#define __WHS_MULTI_IDENTIFIER_H__
+
+#include <glib.h>
+#include "whs.h"
+#include "whsobject.h"
+#include "whspattern.h"
+#include "whsidentifier.h"
+
+G_BEGIN_DECLS
+
+#define WHS_TYPE_MULTI_IDENTIFIER          (whs_multi_identifier_get_type())
+#define WHS_IS_MULTI_IDENTIFIER(obj)       (G_TYPE_CHECK_INSTANCE_TYPE ((obj), WHS_TYPE_MULTI_IDENTIFIER))
+#define WHS_IS_MULTI_IDENTIFIER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), WHS_TYPE_MULTI_IDENTIFIER))
+#define WHS_MULTI_IDENTIFIER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), WHS_TYPE_MULTI_IDENTIFIER, WhsMultiIdentifierClass))
+#define WHS_MULTI_IDENTIFIER(obj)          (G_TYPE_CHECK_INSTANCE_CAST ((obj), WHS_TYPE_MULTI_IDENTIFIER, WhsMultiIdentifier))
+#define WHS_MULTI_IDENTIFIER_CLASS(klass)  (G_TYPE_CHECK_CLASS_CAST ((klass), WHS_TYPE_MULTI_IDENTIFIER, WhsMultiIdentifierClass))
+#define WHS_MULTI_IDENTIFIER_CAST(obj)     ((WhsMultiIdentifier*)(obj))
+
+typedef struct _WhsMultiIdentifier WhsMultiIdentifier;
+typedef struct _WhsMultiIdentifierClass WhsMultiIdentifierClass;
+typedef struct _WhsMultiIdentifierPrivate WhsMultiIdentifierPrivate;
+
+/* res contains one result per pattern, in the order
+ * the patterns were given to the constructor */
+typedef void (*WhsMultiIdentifierResultFunc) (WhsMultiIdentifier *self, const WhsResult *res,
+    guint64 offset, gpointer user_data);
+
+/* Identifies several patterns at once. Patterns with the same frequency
+ * band share the filtering, feature extraction and localization */
+struct _WhsMultiIdentifier
+{
+  WhsObject parent;
+
+  guint sample_rate;
+  guint frame_length;
+  guint hop_length;
+  guint nchannels;
+  guint n_patterns;
+  WhsMultiIdentifierPrivate *priv;
+};
+
+struct _WhsMultiIdentifierClass
+{
+  WhsObjectClass parent;
+};
+
+GType whs_multi_identifier_get_type (void);
+
+WhsMultiIdentifier * whs_multi_identifier_new (guint sample_rate, guint frame_length,
+    guint hop_length, guint nchannels, guint distance, WhsPattern **patterns,
+    guint n_patterns) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+guint whs_multi_identifier_get_n_groups (WhsMultiIdentifier *self);
+void whs_multi_identifier_push (WhsMultiIdentifier *self, const gfloat *in, guint n_frames,
+    WhsIdentifierMode mode, WhsMultiIdentifierResultFunc func, gpointer user_data);
+void whs_multi_identifier_process_into (WhsMultiIdentifier *self, const gfloat *in,
+    WhsIdentifierMode mode, WhsResult *res);
+
+G_END_DECLS
+
+#endif /* __WHS_MULTI_IDENTIFIER_H__ */
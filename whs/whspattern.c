@@ -23,15 +23,71 @@
 
 #include "whspattern.h"
 #include "whspatternprivate.h"
+#include "whsclassifier.h"
+#include "whsutils.h"
 
 #include <glib/gstdio.h>
+#include <errno.h>
 #include <string.h>
+#include <unistd.h>
+
+/* Pattern files start with "WHSP". Version 1 continues with big endian
+ * values:
+ *
+ *   guint32 min_freq, max_freq, sample_rate
+ *   guint32 size, gchar classifier[size]
+ *   guint32 size, guint8 data[size]
+ *
+ * Version 2 files can be used in place from a memory mapping:
+ *
+ *   guint8  version, 2. It is the high byte of the minimum frequency
+ *           in version 1 files, which is always 0
+ *   guint8  byte order of all following values, 'l' or 'B'
+ *   guint16 n_sections
+ *   guint32 min_freq, max_freq, sample_rate
+ *   guint32 reserved
+ *   WhsPatternSection sections[n_sections]
+ *
+ * Every section starts at a multiple of 64 bytes into the file. The
+ * classifier name is NUL terminated, the classifier data is native
+ * in the byte order of the file or portable */
+typedef struct
+{
+  guint32 type;
+  guint32 layout;
+  guint64 offset;
+  guint64 size;
+} WhsPatternSection;
+
+#define VERSION (2)
+#define HEADER_SIZE (24)
+#define SECTION_SIZE (24)
+#define SECTION_ALIGN(n) (((n) + 63) & ~((guint64) 63))
+
+#define SECTION_CLASSIFIER (1)
+#define SECTION_DATA (2)
+
+#define BYTE_ORDER_LITTLE ('l')
+#define BYTE_ORDER_BIG ('B')
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define BYTE_ORDER_HOST BYTE_ORDER_LITTLE
+#define BYTE_ORDER_OTHER BYTE_ORDER_BIG
+#else
+#define BYTE_ORDER_HOST BYTE_ORDER_BIG
+#define BYTE_ORDER_OTHER BYTE_ORDER_LITTLE
+#endif
 
 struct _WhsPatternPrivate
 {
   gchar *classifier;
   guint8 *classifier_data;
   gsize size;
+  WhsPatternLayout layout;
+
+  /* The classifier data points into the file if it is mapped, or
+   * into memory kept by the owner, e.g. a pattern bundle */
+  GMappedFile *file;
+  WhsObject *owner;
 
   guint32 min_freq, max_freq;
 
@@ -72,7 +128,15 @@ whs_pattern_finalize (WhsObject *object)
 {
   WhsPattern *self = WHS_PATTERN (object);
 
-  g_free (self->priv->classifier_data);
+  if (self->priv->file) {
+    g_mapped_file_free (self->priv->file);
+    self->priv->file = NULL;
+  } else if (self->priv->owner) {
+    whs_object_unref (self->priv->owner);
+    self->priv->owner = NULL;
+  } else {
+    g_free (self->priv->classifier_data);
+  }
   self->priv->classifier_data = NULL;
   self->priv->size = 0;
 
@@ -82,149 +146,245 @@ whs_pattern_finalize (WhsObject *object)
   WHS_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
-WhsPattern *
-whs_pattern_load (const gchar *filename)
+static WhsPattern *
+whs_pattern_new_from_data (gchar *classifier, const guint8 *data, gsize size, WhsPatternLayout layout,
+    guint32 min_freq, guint32 max_freq, guint32 sample_rate)
 {
-  g_return_val_if_fail (filename != NULL && *filename != '\0', NULL);
-  
-  FILE *f = g_fopen (filename, "rb");
-  size_t ret;
+  WhsPattern *self = WHS_PATTERN_CAST (g_type_create_instance (WHS_TYPE_PATTERN));
 
-  if (!f) {
-    g_warning ("Can't open file");
+  self->priv->classifier = classifier;
+  self->priv->classifier_data = (guint8 *) data;
+  self->priv->size = size;
+  self->priv->layout = layout;
+  self->priv->min_freq = min_freq;
+  self->priv->max_freq = max_freq;
+  self->priv->sample_rate = sample_rate;
+
+  return self;
+}
+
+static WhsPattern *
+whs_pattern_load_v1 (const guint8 *contents, gsize length)
+{
+  const gboolean swapped = (G_BYTE_ORDER != G_BIG_ENDIAN);
+  gsize pos = 16;
+
+  if (length < pos + 4) {
+    g_warning ("Truncated pattern file");
     return NULL;
   }
 
-  // Header
-  gchar header[4];
-  if ((ret = fread (&header, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Read only %d of 4 bytes", ret);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
-    fclose (f);
+  // Classifier name
+  guint32 size = whs_get_uint32 (contents + pos, swapped);
+  pos += 4;
+
+  if (size == 0) {
+    g_warning ("No classifier name");
     return NULL;
   }
 
-  if (strncmp (header, "WHSP", 4) != 0) {
-    g_warning ("Not a valid pattern file");
-    fclose (f);
+  if (size > length - pos || length - pos - size < 4) {
+    g_warning ("Truncated pattern file");
     return NULL;
   }
- 
-  // Min and max frequency
-  guint32 min_freq, max_freq;
-  if ((ret = fread (&min_freq, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Read only %d of 4 bytes", ret);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
-    fclose (f);
+
+  const gchar *classifier = (const gchar *) contents + pos;
+  guint32 classifier_size = size;
+  pos += size;
+
+  // Classifier data
+  size = whs_get_uint32 (contents + pos, swapped);
+  pos += 4;
+
+  if (size == 0) {
+    g_warning ("No classifier data");
     return NULL;
   }
-  min_freq = GUINT32_FROM_BE (min_freq);
 
-  if ((ret = fread (&max_freq, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Read only %d of 4 bytes", ret);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
-    fclose (f);
+  if (size > length - pos) {
+    g_warning ("Truncated pattern file");
     return NULL;
   }
-  max_freq = GUINT32_FROM_BE (max_freq);
 
-  // Sample rate
-  guint32 sample_rate;
-  if ((ret = fread (&sample_rate, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Read only %d of 4 bytes", ret);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
-    fclose (f);
+  // The data isn't aligned in the file
+  return whs_pattern_new_from_data (g_strndup (classifier, classifier_size), g_memdup (contents + pos, size), size, WHS_PATTERN_LAYOUT_PORTABLE,
+      whs_get_uint32 (contents + 4, swapped), whs_get_uint32 (contents + 8, swapped), whs_get_uint32 (contents + 12, swapped));
+}
+
+static WhsPattern *
+whs_pattern_load_v2 (const guint8 *contents, gsize length)
+{
+  if (length < HEADER_SIZE || (contents[5] != BYTE_ORDER_LITTLE && contents[5] != BYTE_ORDER_BIG)) {
+    g_warning ("Invalid pattern header");
     return NULL;
   }
-  sample_rate = GUINT32_FROM_BE (sample_rate);
 
-  // Classifier name size
-  guint32 size;
-  if ((ret = fread (&size, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Read only %d of 4 bytes", ret);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
-    fclose (f);
+  const gboolean swapped = (contents[5] != BYTE_ORDER_HOST);
+  guint n_sections = whs_get_uint16 (contents + 6, swapped);
+
+  if ((length - HEADER_SIZE) / SECTION_SIZE < n_sections) {
+    g_warning ("Truncated pattern file");
     return NULL;
   }
-  size = GUINT32_FROM_BE (size);
 
-  if (size <= 0) {
+  WhsPatternSection classifier = { 0, }, data = { 0, };
+
+  for (guint i = 0; i < n_sections; i++) {
+    const guint8 *p = contents + HEADER_SIZE + i * SECTION_SIZE;
+    WhsPatternSection section;
+
+    section.type = whs_get_uint32 (p, swapped);
+    section.layout = whs_get_uint32 (p + 4, swapped);
+    section.offset = whs_get_uint64 (p + 8, swapped);
+    section.size = whs_get_uint64 (p + 16, swapped);
+
+    if (section.offset % 64 != 0 || section.offset > length || section.size > length - section.offset) {
+      g_warning ("Invalid section %u in the pattern file", i);
+      return NULL;
+    }
+
+    // Unknown sections are skipped
+    if (section.type == SECTION_CLASSIFIER && classifier.type == 0)
+      classifier = section;
+    else if (section.type == SECTION_DATA && data.type == 0)
+      data = section;
+  }
+
+  if (classifier.size == 0) {
     g_warning ("No classifier name");
-    fclose (f);
     return NULL;
   }
 
-  // Classifier name
-  gchar *classifier = g_new0 (gchar, size);
-  if ((ret = fread (classifier, 1, size, f)) < size) {
-    if (ret >= 0)
-      g_warning ("Read only %d of %d bytes", ret, size);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
-
-    g_free (classifier);
-    fclose (f);
+  if (data.size == 0) {
+    g_warning ("No classifier data");
     return NULL;
   }
 
-  // Classifier data size
-  if ((ret = fread (&size, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Read only %d of 4 bytes", ret);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
-    g_free (classifier);
-    fclose (f);
+  WhsPatternLayout layout;
+
+  if (data.layout == WHS_PATTERN_LAYOUT_PORTABLE) {
+    layout = WHS_PATTERN_LAYOUT_PORTABLE;
+  } else if (data.layout == WHS_PATTERN_LAYOUT_NATIVE) {
+    layout = (swapped) ? WHS_PATTERN_LAYOUT_SWAPPED : WHS_PATTERN_LAYOUT_NATIVE;
+  } else {
+    g_warning ("Unknown classifier data layout %u", data.layout);
     return NULL;
   }
-  size = GUINT32_FROM_BE (size);
 
-  if (size <= 0) {
-    g_warning ("No classifier data");
-    fclose (f);
-    g_free (classifier);
+  return whs_pattern_new_from_data (g_strndup ((const gchar *) contents + classifier.offset, classifier.size),
+      contents + data.offset, data.size, layout,
+      whs_get_uint32 (contents + 8, swapped), whs_get_uint32 (contents + 12, swapped), whs_get_uint32 (contents + 16, swapped));
+}
+
+/* Creates a pattern for the version 2 pattern file in contents,
+ * which has to be aligned to 64 bytes. The classifier data is used
+ * in place and owner is kept alive while the pattern exists */
+WhsPattern *
+whs_pattern_new_from_image (const guint8 *contents, gsize length, WhsObject *owner)
+{
+  g_return_val_if_fail (contents != NULL, NULL);
+  g_return_val_if_fail (WHS_IS_OBJECT (owner), NULL);
+
+  if (length < 8 || strncmp ((const gchar *) contents, "WHSP", 4) != 0 || contents[4] != VERSION) {
+    g_warning ("Not a valid version %d pattern", VERSION);
     return NULL;
   }
 
-  // Classifier data
-  guint8 *data = g_new0 (guint8, size);
-  if ((ret = fread (data, 1, size, f)) < size) {
-    if (ret >= 0)
-      g_warning ("Read only %d of %d bytes", ret, size);
-    else
-      g_warning ("Read failed: %s", strerror (ret));
+  WhsPattern *self = whs_pattern_load_v2 (contents, length);
 
-    g_free (classifier);
-    g_free (data);
-    fclose (f);
+  if (self)
+    self->priv->owner = whs_object_ref (owner);
+
+  return self;
+}
+
+/* Version 2 files are mapped and stay mapped while the
+ * pattern or classifiers created from it exist */
+WhsPattern *
+whs_pattern_load (const gchar *filename)
+{
+  g_return_val_if_fail (filename != NULL && *filename != '\0', NULL);
+
+  GError *error = NULL;
+  GMappedFile *file = g_mapped_file_new (filename, FALSE, &error);
+
+  if (!file) {
+    g_warning ("Can't open file: %s", error->message);
+    g_error_free (error);
     return NULL;
   }
 
+  const guint8 *contents = (const guint8 *) g_mapped_file_get_contents (file);
+  gsize length = g_mapped_file_get_length (file);
+  WhsPattern *self = NULL;
 
-  WhsPattern *self = WHS_PATTERN_CAST (g_type_create_instance (WHS_TYPE_PATTERN));
-
-  self->priv->classifier = classifier;
-  self->priv->classifier_data = data;
-  self->priv->size = size;
-  self->priv->min_freq = min_freq;
-  self->priv->max_freq = max_freq;
-  self->priv->sample_rate = sample_rate;
+  if (length < 8 || strncmp ((const gchar *) contents, "WHSP", 4) != 0) {
+    g_warning ("Not a valid pattern file");
+  } else if (contents[4] == 0) {
+    self = whs_pattern_load_v1 (contents, length);
+  } else if (contents[4] == VERSION) {
+    self = whs_pattern_load_v2 (contents, length);
+    if (self) {
+      self->priv->file = file;
+      return self;
+    }
+  } else {
+    g_warning ("Unsupported pattern file version %u", contents[4]);
+  }
 
-  fclose (f);
+  g_mapped_file_free (file);
 
   return self;
 }
 
+/* Returns everything of the version 2 file of self that comes before
+ * the classifier data, which follows at offset header_size. Native
+ * classifier data is written in the byte order of the host unless it
+ * was loaded with the other one */
+guint8 *
+whs_pattern_get_image_header (WhsPattern *self, gsize *header_size)
+{
+  g_return_val_if_fail (WHS_IS_PATTERN (self), NULL);
+  g_return_val_if_fail (header_size != NULL, NULL);
+  g_return_val_if_fail (self->priv->classifier != NULL, NULL);
+
+  const gboolean swapped = (self->priv->layout == WHS_PATTERN_LAYOUT_SWAPPED);
+  const guint64 classifier_offset = SECTION_ALIGN (HEADER_SIZE + 2 * SECTION_SIZE);
+  const guint64 classifier_size = strlen (self->priv->classifier) + 1;
+  const guint64 data_offset = SECTION_ALIGN (classifier_offset + classifier_size);
+  guint8 *header = g_malloc0 (data_offset);
+  guint8 *p;
+
+  // Header
+  memcpy (header, "WHSP", 4);
+  header[4] = VERSION;
+  header[5] = (swapped) ? BYTE_ORDER_OTHER : BYTE_ORDER_HOST;
+  whs_put_uint16 (header + 6, 2, swapped);
+  whs_put_uint32 (header + 8, self->priv->min_freq, swapped);
+  whs_put_uint32 (header + 12, self->priv->max_freq, swapped);
+  whs_put_uint32 (header + 16, self->priv->sample_rate, swapped);
+
+  // Sections
+  p = header + HEADER_SIZE;
+  whs_put_uint32 (p, SECTION_CLASSIFIER, swapped);
+  whs_put_uint64 (p + 8, classifier_offset, swapped);
+  whs_put_uint64 (p + 16, classifier_size, swapped);
+
+  p += SECTION_SIZE;
+  whs_put_uint32 (p, SECTION_DATA, swapped);
+  whs_put_uint32 (p + 4, (self->priv->layout == WHS_PATTERN_LAYOUT_PORTABLE) ? WHS_PATTERN_LAYOUT_PORTABLE : WHS_PATTERN_LAYOUT_NATIVE, swapped);
+  whs_put_uint64 (p + 8, data_offset, swapped);
+  whs_put_uint64 (p + 16, self->priv->size, swapped);
+
+  // Classifier name
+  memcpy (header + classifier_offset, self->priv->classifier, classifier_size);
+
+  *header_size = data_offset;
+  return header;
+}
+
+/* Writes a version 2 pattern file. An existing file is replaced
+ * instead of overwritten, as it might be mapped by other patterns */
 gboolean
 whs_pattern_save (WhsPattern *self, const gchar *filename)
 {
@@ -233,117 +393,69 @@ whs_pattern_save (WhsPattern *self, const gchar *filename)
 
   g_return_val_if_fail (self->priv->classifier_data != NULL || self->priv->size <= 0, FALSE);
 
-  guint32 tmp;
-  FILE *f = g_fopen (filename, "wb");
+  gsize data_offset;
+  guint8 *header = whs_pattern_get_image_header (self, &data_offset);
+
+  gchar *tmp = g_strdup_printf ("%s.%d.tmp", filename, (gint) getpid ());
+  FILE *f = g_fopen (tmp, "wb");
   size_t ret;
 
   if (!f) {
     g_warning ("Can't open file");
+    g_free (header);
+    g_free (tmp);
     return FALSE;
   }
 
-  // Header
-  if ((ret = fwrite ("WHSP", 1, 4, f)) < 4) {
+  if ((ret = fwrite (header, 1, data_offset, f)) < data_offset) {
     if (ret >= 0)
-      g_warning ("Wrote only %d of 4 bytes", ret);
+      g_warning ("Wrote only %d of %d bytes", ret, (gint) data_offset);
     else
       g_warning ("Write failed: %s", strerror (ret));
 
-    fclose (f);
-    return FALSE;
-  }
-
-  // Min and max frequency
-  tmp = GUINT32_TO_BE (CLAMP (self->priv->min_freq, 0, G_MAXUINT32));
-  if ((ret = fwrite (&tmp, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Wrote only %d of 4 bytes", ret);
-    else
-      g_warning ("Write failed: %s", strerror (ret));
-
-    fclose (f);
-    return FALSE;
-  }
-
-  tmp = GUINT32_TO_BE (CLAMP (self->priv->max_freq, 0, G_MAXUINT32));
-  if ((ret = fwrite (&tmp, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Wrote only %d of 4 bytes", ret);
-    else
-      g_warning ("Write failed: %s", strerror (ret));
-
-    fclose (f);
-    return FALSE;
+    g_free (header);
+    goto error;
   }
 
-  // Sample rate
+  g_free (header);
 
-  tmp = GUINT32_TO_BE (CLAMP (self->priv->sample_rate, 0, G_MAXUINT32));
-  if ((ret = fwrite (&tmp, 1, 4, f)) < 4) {
+  // Classifier data
+  if ((ret = fwrite (self->priv->classifier_data, 1, self->priv->size, f)) < self->priv->size) {
     if (ret >= 0)
-      g_warning ("Wrote only %d of 4 bytes", ret);
+      g_warning ("Wrote only %d of %d bytes", ret, self->priv->size);
     else
       g_warning ("Write failed: %s", strerror (ret));
 
-    fclose (f);
-    return FALSE;
+    goto error;
   }
 
-  // Size of the classifier name
-  guint32 len = strlen (self->priv->classifier) + 1;
-  tmp = GUINT32_TO_BE (len);
-  if ((ret = fwrite (&tmp, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Wrote only %d of 4 bytes", ret);
-    else
-      g_warning ("Write failed: %s", strerror (ret));
-
-    fclose (f);
-    return FALSE;
+  if (fclose (f) != 0) {
+    g_warning ("Write failed: %s", strerror (errno));
+    f = NULL;
+    goto error;
   }
 
-  // Classifier name  
-  if ((ret = fwrite (self->priv->classifier, 1, len, f)) < len) {
-    if (ret >= 0)
-      g_warning ("Wrote only %d of %d bytes", ret, len);
-    else
-      g_warning ("Write failed: %s", strerror (ret));
-
-    fclose (f);
-    return FALSE;
+  if (g_rename (tmp, filename) != 0) {
+    g_warning ("Can't replace %s: %s", filename, strerror (errno));
+    f = NULL;
+    goto error;
   }
 
+  g_free (tmp);
 
-  // Size of the data
-  tmp = GUINT32_TO_BE (self->priv->size);
-  if ((ret = fwrite (&tmp, 1, 4, f)) < 4) {
-    if (ret >= 0)
-      g_warning ("Wrote only %d of 4 bytes", ret);
-    else
-      g_warning ("Write failed: %s", strerror (ret));
-
-    fclose (f);
-    return FALSE;
-  }
-  
-  // Classifier data
-  if ((ret = fwrite (self->priv->classifier_data, 1, self->priv->size, f)) < self->priv->size) {
-    if (ret >= 0)
-      g_warning ("Wrote only %d of %d bytes", ret, self->priv->size);
-    else
-      g_warning ("Write failed: %s", strerror (ret));
+  return TRUE;
 
+error:
+  if (f)
     fclose (f);
-    return FALSE;
-  }
-
-  fclose (f);
+  g_unlink (tmp);
+  g_free (tmp);
 
   return FALSE;
 }
 
 const guint8 *
-whs_pattern_get_classifier_data (WhsPattern *self, const gchar *classifier, gsize *size)
+whs_pattern_get_classifier_data (WhsPattern *self, const gchar *classifier, gsize *size, WhsPatternLayout *layout)
 {
   g_return_val_if_fail (WHS_IS_PATTERN (self), NULL);
   g_return_val_if_fail (size != NULL, NULL);
@@ -355,20 +467,24 @@ whs_pattern_get_classifier_data (WhsPattern *self, const gchar *classifier, gsiz
   }
 
   *size = self->priv->size;
+  if (layout)
+    *layout = self->priv->layout;
   return self->priv->classifier_data;
 }
 
 void
-whs_pattern_set_classifier_data (WhsPattern *self, const gchar *classifier, guint8 *data, gsize size)
+whs_pattern_set_classifier_data (WhsPattern *self, const gchar *classifier, guint8 *data, gsize size, WhsPatternLayout layout)
 {
   g_return_if_fail (WHS_IS_PATTERN (self));
   g_return_if_fail (classifier != NULL && *classifier != '\0');
+  g_return_if_fail (self->priv->file == NULL && self->priv->owner == NULL);
 
   g_free (self->priv->classifier_data);
   g_free (self->priv->classifier);
 
   self->priv->classifier_data = data;
   self->priv->size = size;
+  self->priv->layout = layout;
   self->priv->classifier = g_strdup (classifier);
 }
 
@@ -416,3 +532,27 @@ whs_pattern_get_classifier_name (WhsPattern *self)
   return self->priv->classifier;
 }
 
+/* Returns a pattern for the int8 variant of the classifier of self,
+ * or NULL if the classifier can't be quantized */
+WhsPattern *
+whs_pattern_quantize (WhsPattern *self)
+{
+  g_return_val_if_fail (WHS_IS_PATTERN (self), NULL);
+
+  WhsClassifier *classifier = whs_classifier_new (self->priv->classifier, self);
+
+  if (!classifier) {
+    g_warning ("Can't create classifier %s", self->priv->classifier);
+    return NULL;
+  }
+
+  WhsPattern *ret = whs_classifier_quantize (classifier);
+  whs_object_unref (classifier);
+
+  if (ret) {
+    whs_pattern_set_frequency_band (ret, self->priv->min_freq, self->priv->max_freq);
+    whs_pattern_set_sample_rate (ret, self->priv->sample_rate);
+  }
+
+  return ret;
+}
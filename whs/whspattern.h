@@ -55,6 +55,8 @@ gboolean whs_pattern_save (WhsPattern *self, const gchar *filename);
 
 const gchar * whs_pattern_get_classifier_name (WhsPattern *self);
 
+WhsPattern * whs_pattern_quantize (WhsPattern *self) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+
 G_END_DECLS
 
 #endif /* __WHS_PATTERN_H__ */
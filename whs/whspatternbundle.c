@@ -0,0 +1,488 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "whspatternbundle.h"
+#include "whspatternprivate.h"
+#include "whsutils.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Bundle files contain many named version 2 pattern files and start
+ * with "WHSB":
+ *
+ *   guint8  version, 1
+ *   guint8  byte order of all following values, 'l' or 'B'
+ *   guint16 reserved
+ *   guint32 n_entries
+ *   guint32 reserved
+ *   guint8  checksum[32]
+ *   guint8  reserved[16]
+ *   WhsPatternBundleEntry entries[n_entries]
+ *   gchar   names[]
+ *
+ * The checksum is the SHA-256 of the whole file without the checksum
+ * itself, so the file only has to be read once when it is loaded. The
+ * entries are sorted by name, names are NUL terminated and every
+ * pattern starts at a multiple of 64 bytes into the file */
+#define VERSION (1)
+#define HEADER_SIZE (64)
+#define ENTRY_SIZE (32)
+#define CHECKSUM_OFFSET (16)
+#define CHECKSUM_SIZE (32)
+#define PATTERN_ALIGN(n) (((n) + 63) & ~((guint64) 63))
+
+#define BYTE_ORDER_LITTLE ('l')
+#define BYTE_ORDER_BIG ('B')
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define BYTE_ORDER_HOST BYTE_ORDER_LITTLE
+#else
+#define BYTE_ORDER_HOST BYTE_ORDER_BIG
+#endif
+
+typedef struct
+{
+  // Points into the file of loaded bundles
+  gchar *name;
+
+  // Patterns added to the bundle, or the offset and size in the file
+  WhsPattern *pattern;
+  guint64 offset;
+  guint64 size;
+} WhsPatternBundleEntry;
+
+struct _WhsPatternBundlePrivate
+{
+  // Sorted by name
+  GArray *entries;
+
+  GMappedFile *file;
+};
+
+#define WHS_PATTERN_BUNDLE_GET_PRIVATE(obj)  \
+    (G_TYPE_INSTANCE_GET_PRIVATE ((obj), WHS_TYPE_PATTERN_BUNDLE, WhsPatternBundlePrivate))
+
+static void whs_pattern_bundle_init (WhsPatternBundle * self);
+static void whs_pattern_bundle_class_init (WhsPatternBundleClass * klass);
+static void whs_pattern_bundle_finalize (WhsObject *object);
+
+G_DEFINE_TYPE (WhsPatternBundle, whs_pattern_bundle, WHS_TYPE_OBJECT);
+
+static WhsObjectClass *parent_class = NULL;
+
+static void
+whs_pattern_bundle_class_init (WhsPatternBundleClass * klass)
+{
+  WhsObjectClass *o_klass = (WhsObjectClass *) klass;
+
+  parent_class = WHS_OBJECT_CLASS (g_type_class_peek_parent (klass));
+
+  g_type_class_add_private (klass, sizeof (WhsPatternBundlePrivate));
+
+  o_klass->finalize = whs_pattern_bundle_finalize;
+}
+
+static void
+whs_pattern_bundle_init (WhsPatternBundle * self)
+{
+  self->priv = WHS_PATTERN_BUNDLE_GET_PRIVATE (self);
+
+  self->priv->entries = g_array_new (FALSE, TRUE, sizeof (WhsPatternBundleEntry));
+}
+
+static void
+whs_pattern_bundle_finalize (WhsObject *object)
+{
+  WhsPatternBundle *self = WHS_PATTERN_BUNDLE (object);
+
+  if (self->priv->file) {
+    g_mapped_file_free (self->priv->file);
+    self->priv->file = NULL;
+  } else {
+    for (guint i = 0; i < self->priv->entries->len; i++) {
+      WhsPatternBundleEntry *entry = &g_array_index (self->priv->entries, WhsPatternBundleEntry, i);
+
+      g_free (entry->name);
+      whs_object_unref (entry->pattern);
+    }
+  }
+
+  g_array_free (self->priv->entries, TRUE);
+  self->priv->entries = NULL;
+
+  WHS_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+/* Returns the index of the entry for name, or where it would have
+ * to be inserted and FALSE if there is none */
+static gboolean
+whs_pattern_bundle_find (WhsPatternBundle *self, const gchar *name, guint *index)
+{
+  guint lo = 0, hi = self->priv->entries->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+    gint cmp = strcmp (name, g_array_index (self->priv->entries, WhsPatternBundleEntry, mid).name);
+
+    if (cmp == 0) {
+      *index = mid;
+      return TRUE;
+    } else if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  *index = lo;
+  return FALSE;
+}
+
+WhsPatternBundle *
+whs_pattern_bundle_new (void)
+{
+  return WHS_PATTERN_BUNDLE_CAST (g_type_create_instance (WHS_TYPE_PATTERN_BUNDLE));
+}
+
+/* Adds pattern to a bundle that is going to be saved, names
+ * have to be unique */
+gboolean
+whs_pattern_bundle_add (WhsPatternBundle *self, const gchar *name, WhsPattern *pattern)
+{
+  g_return_val_if_fail (WHS_IS_PATTERN_BUNDLE (self), FALSE);
+  g_return_val_if_fail (name != NULL && *name != '\0', FALSE);
+  g_return_val_if_fail (WHS_IS_PATTERN (pattern), FALSE);
+  g_return_val_if_fail (self->priv->file == NULL, FALSE);
+
+  guint index;
+
+  if (whs_pattern_bundle_find (self, name, &index)) {
+    g_warning ("Pattern %s is already in the bundle", name);
+    return FALSE;
+  }
+
+  WhsPatternBundleEntry entry = { 0, };
+
+  entry.name = g_strdup (name);
+  entry.pattern = WHS_PATTERN (whs_object_ref (pattern));
+  g_array_insert_val (self->priv->entries, index, entry);
+
+  return TRUE;
+}
+
+static gboolean
+whs_pattern_bundle_check (const guint8 *contents, gsize length, gboolean swapped)
+{
+  GChecksum *checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  guint8 digest[CHECKSUM_SIZE];
+  gsize digest_size = CHECKSUM_SIZE;
+
+  g_checksum_update (checksum, contents, CHECKSUM_OFFSET);
+  g_checksum_update (checksum, contents + CHECKSUM_OFFSET + CHECKSUM_SIZE, length - CHECKSUM_OFFSET - CHECKSUM_SIZE);
+  g_checksum_get_digest (checksum, digest, &digest_size);
+  g_checksum_free (checksum);
+
+  if (memcmp (digest, contents + CHECKSUM_OFFSET, CHECKSUM_SIZE) != 0) {
+    g_warning ("Checksum mismatch in the pattern bundle");
+    return FALSE;
+  }
+
+  guint n_entries = whs_get_uint32 (contents + 8, swapped);
+  const gchar *previous = NULL;
+
+  for (guint i = 0; i < n_entries; i++) {
+    const guint8 *p = contents + HEADER_SIZE + i * ENTRY_SIZE;
+    guint64 name_offset = whs_get_uint64 (p, swapped);
+    guint32 name_size = whs_get_uint32 (p + 8, swapped);
+    guint64 offset = whs_get_uint64 (p + 16, swapped);
+    guint64 size = whs_get_uint64 (p + 24, swapped);
+    const gchar *name;
+
+    if (name_offset > length || name_size < 2 || name_size > length - name_offset) {
+      g_warning ("Invalid name of entry %u in the pattern bundle", i);
+      return FALSE;
+    }
+
+    name = (const gchar *) contents + name_offset;
+    if (name[name_size - 1] != '\0' || strlen (name) != name_size - 1) {
+      g_warning ("Invalid name of entry %u in the pattern bundle", i);
+      return FALSE;
+    }
+
+    // Sorted names are unique and can be looked up in the index
+    if (previous && strcmp (previous, name) >= 0) {
+      g_warning ("Pattern bundle index isn't sorted");
+      return FALSE;
+    }
+    previous = name;
+
+    if (offset % 64 != 0 || offset > length || size > length - offset) {
+      g_warning ("Invalid pattern %s in the pattern bundle", name);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* The file is checked once and stays mapped while the bundle or
+ * patterns from it exist. The patterns themselves are only parsed
+ * when they are requested */
+WhsPatternBundle *
+whs_pattern_bundle_load (const gchar *filename)
+{
+  g_return_val_if_fail (filename != NULL && *filename != '\0', NULL);
+
+  GError *error = NULL;
+  GMappedFile *file = g_mapped_file_new (filename, FALSE, &error);
+
+  if (!file) {
+    g_warning ("Can't open file: %s", error->message);
+    g_error_free (error);
+    return NULL;
+  }
+
+  const guint8 *contents = (const guint8 *) g_mapped_file_get_contents (file);
+  gsize length = g_mapped_file_get_length (file);
+
+  if (length < HEADER_SIZE || strncmp ((const gchar *) contents, "WHSB", 4) != 0 ||
+      (contents[5] != BYTE_ORDER_LITTLE && contents[5] != BYTE_ORDER_BIG)) {
+    g_warning ("Not a valid pattern bundle");
+    g_mapped_file_free (file);
+    return NULL;
+  }
+
+  if (contents[4] != VERSION) {
+    g_warning ("Unsupported pattern bundle version %u", contents[4]);
+    g_mapped_file_free (file);
+    return NULL;
+  }
+
+  const gboolean swapped = (contents[5] != BYTE_ORDER_HOST);
+  guint n_entries = whs_get_uint32 (contents + 8, swapped);
+
+  if ((length - HEADER_SIZE) / ENTRY_SIZE < n_entries) {
+    g_warning ("Truncated pattern bundle");
+    g_mapped_file_free (file);
+    return NULL;
+  }
+
+  if (!whs_pattern_bundle_check (contents, length, swapped)) {
+    g_mapped_file_free (file);
+    return NULL;
+  }
+
+  WhsPatternBundle *self = whs_pattern_bundle_new ();
+
+  self->priv->file = file;
+  g_array_set_size (self->priv->entries, n_entries);
+
+  for (guint i = 0; i < n_entries; i++) {
+    const guint8 *p = contents + HEADER_SIZE + i * ENTRY_SIZE;
+    WhsPatternBundleEntry *entry = &g_array_index (self->priv->entries, WhsPatternBundleEntry, i);
+
+    entry->name = (gchar *) contents + whs_get_uint64 (p, swapped);
+    entry->offset = whs_get_uint64 (p + 16, swapped);
+    entry->size = whs_get_uint64 (p + 24, swapped);
+  }
+
+  return self;
+}
+
+static gboolean
+whs_pattern_bundle_write (FILE *f, GChecksum *checksum, const guint8 *data, gsize size)
+{
+  size_t ret;
+
+  if ((ret = fwrite (data, 1, size, f)) < size) {
+    g_warning ("Wrote only %d of %d bytes", (gint) ret, (gint) size);
+    return FALSE;
+  }
+
+  g_checksum_update (checksum, data, size);
+  return TRUE;
+}
+
+/* Writes all patterns of the bundle, an existing file is replaced
+ * instead of overwritten as it might be mapped by other bundles */
+gboolean
+whs_pattern_bundle_save (WhsPatternBundle *self, const gchar *filename)
+{
+  g_return_val_if_fail (WHS_IS_PATTERN_BUNDLE (self), FALSE);
+  g_return_val_if_fail (filename != NULL && *filename != '\0', FALSE);
+  g_return_val_if_fail (self->priv->file == NULL, FALSE);
+
+  const guint n_entries = self->priv->entries->len;
+  gsize *header_sizes = g_new (gsize, n_entries);
+  guint8 **headers = g_new (guint8 *, n_entries);
+  const guint8 **data = g_new (const guint8 *, n_entries);
+  gsize *data_sizes = g_new (gsize, n_entries);
+  guint64 names_size = 0;
+
+  for (guint i = 0; i < n_entries; i++) {
+    WhsPatternBundleEntry *entry = &g_array_index (self->priv->entries, WhsPatternBundleEntry, i);
+
+    headers[i] = whs_pattern_get_image_header (entry->pattern, &header_sizes[i]);
+    data[i] = whs_pattern_get_classifier_data (entry->pattern, whs_pattern_get_classifier_name (entry->pattern),
+        &data_sizes[i], NULL);
+    names_size += strlen (entry->name) + 1;
+  }
+
+  // Header and index
+  const gsize index_size = PATTERN_ALIGN (HEADER_SIZE + n_entries * ENTRY_SIZE + names_size);
+  guint8 *index = g_malloc0 (index_size);
+  guint64 name_offset = HEADER_SIZE + n_entries * ENTRY_SIZE;
+  guint64 offset = index_size;
+
+  memcpy (index, "WHSB", 4);
+  index[4] = VERSION;
+  index[5] = BYTE_ORDER_HOST;
+  whs_put_uint32 (index + 8, n_entries, FALSE);
+
+  for (guint i = 0; i < n_entries; i++) {
+    WhsPatternBundleEntry *entry = &g_array_index (self->priv->entries, WhsPatternBundleEntry, i);
+    guint8 *p = index + HEADER_SIZE + i * ENTRY_SIZE;
+    gsize name_size = strlen (entry->name) + 1;
+    gsize size = header_sizes[i] + data_sizes[i];
+
+    whs_put_uint64 (p, name_offset, FALSE);
+    whs_put_uint32 (p + 8, name_size, FALSE);
+    whs_put_uint64 (p + 16, offset, FALSE);
+    whs_put_uint64 (p + 24, size, FALSE);
+
+    memcpy (index + name_offset, entry->name, name_size);
+    name_offset += name_size;
+    offset = PATTERN_ALIGN (offset + size);
+  }
+
+  gchar *tmp = g_strdup_printf ("%s.%d.tmp", filename, (gint) getpid ());
+  FILE *f = g_fopen (tmp, "wb");
+  GChecksum *checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  const guint8 padding[64] = { 0, };
+  gboolean ret = FALSE;
+
+  if (!f) {
+    g_warning ("Can't open file");
+    goto done;
+  }
+
+  // The checksum is written last
+  g_checksum_update (checksum, index, CHECKSUM_OFFSET);
+  if (fwrite (index, 1, index_size, f) < index_size) {
+    g_warning ("Write failed: %s", strerror (errno));
+    goto done;
+  }
+  g_checksum_update (checksum, index + CHECKSUM_OFFSET + CHECKSUM_SIZE, index_size - CHECKSUM_OFFSET - CHECKSUM_SIZE);
+
+  // Patterns
+  for (guint i = 0; i < n_entries; i++) {
+    gsize size = header_sizes[i] + data_sizes[i];
+
+    if (!whs_pattern_bundle_write (f, checksum, headers[i], header_sizes[i]) ||
+        !whs_pattern_bundle_write (f, checksum, data[i], data_sizes[i]) ||
+        !whs_pattern_bundle_write (f, checksum, padding, PATTERN_ALIGN (size) - size))
+      goto done;
+  }
+
+  guint8 digest[CHECKSUM_SIZE];
+  gsize digest_size = CHECKSUM_SIZE;
+
+  g_checksum_get_digest (checksum, digest, &digest_size);
+
+  if (fseek (f, CHECKSUM_OFFSET, SEEK_SET) != 0 || fwrite (digest, 1, CHECKSUM_SIZE, f) < CHECKSUM_SIZE) {
+    g_warning ("Write failed: %s", strerror (errno));
+    goto done;
+  }
+
+  ret = (fclose (f) == 0);
+  f = NULL;
+
+  if (!ret) {
+    g_warning ("Write failed: %s", strerror (errno));
+  } else if (g_rename (tmp, filename) != 0) {
+    g_warning ("Can't replace %s: %s", filename, strerror (errno));
+    ret = FALSE;
+  }
+
+done:
+  if (f)
+    fclose (f);
+  if (!ret)
+    g_unlink (tmp);
+  g_free (tmp);
+  g_checksum_free (checksum);
+  g_free (index);
+  for (guint i = 0; i < n_entries; i++)
+    g_free (headers[i]);
+  g_free (headers);
+  g_free (header_sizes);
+  g_free (data);
+  g_free (data_sizes);
+
+  return ret;
+}
+
+guint
+whs_pattern_bundle_get_n_patterns (WhsPatternBundle *self)
+{
+  g_return_val_if_fail (WHS_IS_PATTERN_BUNDLE (self), 0);
+
+  return self->priv->entries->len;
+}
+
+/* Names are sorted */
+const gchar *
+whs_pattern_bundle_get_name (WhsPatternBundle *self, guint index)
+{
+  g_return_val_if_fail (WHS_IS_PATTERN_BUNDLE (self), NULL);
+  g_return_val_if_fail (index < self->priv->entries->len, NULL);
+
+  return g_array_index (self->priv->entries, WhsPatternBundleEntry, index).name;
+}
+
+/* Patterns of loaded bundles use the mapped file in place
+ * and keep the bundle alive */
+WhsPattern *
+whs_pattern_bundle_get_pattern (WhsPatternBundle *self, const gchar *name)
+{
+  g_return_val_if_fail (WHS_IS_PATTERN_BUNDLE (self), NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  guint index;
+
+  if (!whs_pattern_bundle_find (self, name, &index)) {
+    g_warning ("No pattern %s in the bundle", name);
+    return NULL;
+  }
+
+  WhsPatternBundleEntry *entry = &g_array_index (self->priv->entries, WhsPatternBundleEntry, index);
+
+  if (entry->pattern)
+    return WHS_PATTERN (whs_object_ref (entry->pattern));
+
+  const guint8 *contents = (const guint8 *) g_mapped_file_get_contents (self->priv->file);
+
+  return whs_pattern_new_from_image (contents + entry->offset, entry->size, WHS_OBJECT (self));
+}
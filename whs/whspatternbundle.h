@@ -0,0 +1,66 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WHS_PATTERN_BUNDLE_H__
+#define __WHS_PATTERN_BUNDLE_H__
+
+#include <glib.h>
+#include "whsobject.h"
+#include "whspattern.h"
+
+G_BEGIN_DECLS
+
+#define WHS_TYPE_PATTERN_BUNDLE          (whs_pattern_bundle_get_type())
+#define WHS_IS_PATTERN_BUNDLE(obj)       (G_TYPE_CHECK_INSTANCE_TYPE ((obj), WHS_TYPE_PATTERN_BUNDLE))
+#define WHS_IS_PATTERN_BUNDLE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), WHS_TYPE_PATTERN_BUNDLE))
+#define WHS_PATTERN_BUNDLE_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), WHS_TYPE_PATTERN_BUNDLE, WhsPatternBundleClass))
+#define WHS_PATTERN_BUNDLE(obj)          (G_TYPE_CHECK_INSTANCE_CAST ((obj), WHS_TYPE_PATTERN_BUNDLE, WhsPatternBundle))
+#define WHS_PATTERN_BUNDLE_CLASS(klass)  (G_TYPE_CHECK_CLASS_CAST ((klass), WHS_TYPE_PATTERN_BUNDLE, WhsPatternBundleClass))
+#define WHS_PATTERN_BUNDLE_CAST(obj)     ((WhsPatternBundle*)(obj))
+
+typedef struct _WhsPatternBundle WhsPatternBundle;
+typedef struct _WhsPatternBundleClass WhsPatternBundleClass;
+typedef struct _WhsPatternBundlePrivate WhsPatternBundlePrivate;
+
+struct _WhsPatternBundle
+{
+  WhsObject parent;
+
+  WhsPatternBundlePrivate *priv;
+};
+
+struct _WhsPatternBundleClass
+{
+  WhsObjectClass parent;
+};
+
+GType whs_pattern_bundle_get_type (void);
+
+WhsPatternBundle * whs_pattern_bundle_new (void) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+gboolean whs_pattern_bundle_add (WhsPatternBundle *self, const gchar *name, WhsPattern *pattern);
+
+WhsPatternBundle * whs_pattern_bundle_load (const gchar *filename) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+gboolean whs_pattern_bundle_save (WhsPatternBundle *self, const gchar *filename);
+
+guint whs_pattern_bundle_get_n_patterns (WhsPatternBundle *self);
+const gchar * whs_pattern_bundle_get_name (WhsPatternBundle *self, guint index);
+WhsPattern * whs_pattern_bundle_get_pattern (WhsPatternBundle *self, const gchar *name) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+
+G_END_DECLS
+
+#endif /* __WHS_PATTERN_BUNDLE_H__ */
@@ -25,8 +25,21 @@
 
 G_BEGIN_DECLS
 
-G_GNUC_INTERNAL const guint8 * whs_pattern_get_classifier_data (WhsPattern *self, const gchar *classifier, gsize *size) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
-G_GNUC_INTERNAL void whs_pattern_set_classifier_data (WhsPattern *self, const gchar *classifier, guint8 *data, gsize size);
+/* Layout of the classifier data. The portable layout is defined by the
+ * classifier and big endian, the native one is the layout of the
+ * classifier in memory. Native data of a pattern file written on a host
+ * with the other byte order is swapped and has to be converted */
+typedef enum {
+  WHS_PATTERN_LAYOUT_PORTABLE = 0,
+  WHS_PATTERN_LAYOUT_NATIVE = 1,
+  WHS_PATTERN_LAYOUT_SWAPPED = 2
+} WhsPatternLayout;
+
+G_GNUC_INTERNAL WhsPattern * whs_pattern_new_from_image (const guint8 *contents, gsize length, WhsObject *owner) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+G_GNUC_INTERNAL guint8 * whs_pattern_get_image_header (WhsPattern *self, gsize *header_size) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+
+G_GNUC_INTERNAL const guint8 * whs_pattern_get_classifier_data (WhsPattern *self, const gchar *classifier, gsize *size, WhsPatternLayout *layout) G_GNUC_WARN_UNUSED_RESULT;
+G_GNUC_INTERNAL void whs_pattern_set_classifier_data (WhsPattern *self, const gchar *classifier, guint8 *data, gsize size, WhsPatternLayout layout);
 
 G_GNUC_INTERNAL void whs_pattern_set_frequency_band (WhsPattern *self, guint min_freq, guint max_freq);
 G_GNUC_INTERNAL void whs_pattern_get_frequency_band (WhsPattern *self, guint *min_freq, guint *max_freq);
@@ -24,19 +24,12 @@
 G_BEGIN_DECLS
 
 typedef struct _WhsFeatureVector WhsFeatureVector;
-typedef struct _WhsResultValue WhsResultValue;
 
 struct _WhsFeatureVector
 {
   gfloat mfcc[32];
 };
 
-struct _WhsResultValue
-{
-  gint32 result;
-  WhsFeatureVector vec;
-};
-
 G_END_DECLS
 
 #endif /* __WHS_PRIVATE_H__ */
@@ -0,0 +1,1059 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "whsstatefile.h"
+#include "whsutils.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+/* Learner state files start with "WHSL". Version 1 continues with big
+ * endian values:
+ *
+ *   guint32 min_freq, max_freq, sample_rate
+ *   guint32 size
+ *   { gint32 label, gfloat mfcc[32] } rows[size / 132]
+ *
+ * The rows are stored newest first with a row with the label
+ * G_MININT32 before the rows of every sequence.
+ *
+ * Version 2 files are written in the byte order of the host:
+ *
+ *   guint8  version, 2. It is the high byte of the minimum frequency
+ *           in version 1 files, which is always 0
+ *   guint8  byte order of all following values, 'l' or 'B'
+ *   guint16 reserved
+ *   guint32 min_freq, max_freq, sample_rate
+ *   guint32 n_features, 32
+ *   guint64 index_offset
+ *   guint8  reserved[32]
+ *
+ * followed by blocks of at most BLOCK_ROWS rows, oldest first:
+ *
+ *   guint64 n_rows
+ *   guint32 n_sequences
+ *   guint32 encoding of the vectors, a WhsStateEncoding
+ *   guint64 size of the block
+ *   guint64 reserved
+ *   guint32 ends[n_sequences]
+ *   gint32  labels[n_rows]
+ *
+ * followed by the vectors, for WHS_STATE_ENCODING_PLAIN as
+ *
+ *   gfloat  vecs[n_rows][32]
+ *
+ * for WHS_STATE_ENCODING_HALF as IEEE half precision floats
+ *
+ *   guint16 vecs[n_rows][32]
+ *
+ * and for WHS_STATE_ENCODING_Q8 with 8 bits per coefficient, which is
+ * offset[j] + scale[j] * codes[i][j]
+ *
+ *   gfloat  offset[32], scale[32]
+ *   guint8  codes[n_rows][32]
+ *
+ * ends are the row offsets in the block at which sequences end. The
+ * index at index_offset is
+ *
+ *   guint64 n_blocks, n_rows, n_sequences
+ *   guint64 reserved
+ *   { guint64 offset, n_rows } blocks[n_blocks]
+ *
+ * Blocks, their labels and vectors and the index start at multiples of
+ * 64 bytes into the file. New blocks are appended behind the index,
+ * followed by a new index. The header is updated last, so it always
+ * points to a complete index */
+
+#define VERSION (2)
+#define HEADER_SIZE (64)
+#define BLOCK_HEADER_SIZE (32)
+#define INDEX_HEADER_SIZE (32)
+#define INDEX_ENTRY_SIZE (16)
+#define ALIGN(n) (((n) + 63) & ~((guint64) 63))
+
+#define N_FEATURES (G_N_ELEMENTS (((WhsFeatureVector *) NULL)->mfcc))
+#define ROW_SIZE_V1 (4 + N_FEATURES * 4)
+
+/* 8 MiB of vectors per block */
+#define BLOCK_ROWS (65536)
+
+
+#define BYTE_ORDER_LITTLE ('l')
+#define BYTE_ORDER_BIG ('B')
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define BYTE_ORDER_HOST BYTE_ORDER_LITTLE
+#else
+#define BYTE_ORDER_HOST BYTE_ORDER_BIG
+#endif
+
+/* Buffer of the file streams, the rows themselves are written
+ * and read with one call per block */
+#define STREAM_BUFFER (1 << 20)
+
+/* Rows that are encoded at once when writing */
+#define ENCODE_ROWS (4096)
+
+typedef struct
+{
+  guint64 offset;
+  guint64 n_rows;
+} WhsStateIndexEntry;
+
+/* Offsets of the parts of a block from its start */
+typedef struct
+{
+  guint64 labels_offset;
+  guint64 vecs_offset;
+  guint64 size;
+} WhsStateBlockLayout;
+
+static void
+whs_state_block_layout (WhsStateBlockLayout *layout, guint64 n_rows, guint64 n_sequences, WhsStateEncoding encoding)
+{
+  layout->labels_offset = ALIGN (BLOCK_HEADER_SIZE + 4 * n_sequences);
+  layout->vecs_offset = ALIGN (layout->labels_offset + 4 * n_rows);
+
+  switch (encoding) {
+    case WHS_STATE_ENCODING_PLAIN:
+      layout->size = layout->vecs_offset + n_rows * sizeof (WhsFeatureVector);
+      break;
+    case WHS_STATE_ENCODING_HALF:
+      layout->size = layout->vecs_offset + n_rows * N_FEATURES * 2;
+      break;
+    case WHS_STATE_ENCODING_Q8:
+      layout->size = layout->vecs_offset + 2 * N_FEATURES * 4 + n_rows * N_FEATURES;
+      break;
+  }
+}
+
+/* Conversions between floats and IEEE half precision floats, rounding
+ * to the nearest even value. Too large values become infinite. Both
+ * branch on the exponent, for MFCCs only the normal case is taken */
+static inline guint16
+whs_half_from_float (gfloat value)
+{
+  static const guint32 denormal_magic = ((127 - 15) + (23 - 10) + 1) << 23;
+  guint32 x, sign;
+  guint16 ret;
+
+  memcpy (&x, &value, 4);
+  sign = x & 0x80000000;
+  x ^= sign;
+
+  if (x >= (127 + 16) << 23) {
+    ret = (x > 0x7f800000) ? 0x7e00 : 0x7c00;
+  } else if (x < 113 << 23) {
+    // Denormal, the addition rounds away the low bits
+    gfloat f, magic;
+
+    memcpy (&f, &x, 4);
+    memcpy (&magic, &denormal_magic, 4);
+    f += magic;
+    memcpy (&x, &f, 4);
+    ret = x - denormal_magic;
+  } else {
+    guint32 odd = (x >> 13) & 1;
+
+    x += ((guint32) (15 - 127) << 23) + 0xfff + odd;
+    ret = x >> 13;
+  }
+
+  return ret | (sign >> 16);
+}
+
+static inline gfloat
+whs_half_to_float (guint16 half)
+{
+  static const guint32 magic_bits = 113 << 23;
+  guint32 x = (half & 0x7fff) << 13;
+  guint32 exponent = x & (0x7c00 << 13);
+  gfloat ret;
+
+  x += (127 - 15) << 23;
+
+  if (exponent == 0x7c00 << 13) {
+    // Infinity or NaN
+    x += (128 - 16) << 23;
+  } else if (exponent == 0) {
+    gfloat magic;
+
+    x += 1 << 23;
+    memcpy (&ret, &x, 4);
+    memcpy (&magic, &magic_bits, 4);
+    ret -= magic;
+    memcpy (&x, &ret, 4);
+  }
+
+  x |= (guint32) (half & 0x8000) << 16;
+  memcpy (&ret, &x, 4);
+
+  return ret;
+}
+
+/* Offset and scale of the 8 bit codes of n rows from start on, the
+ * range of every coefficient is split into 255 steps */
+static void
+whs_state_q8_range (const WhsFeatureStore *store, guint start, guint n, gfloat *offset, gfloat *scale)
+{
+  gfloat max[N_FEATURES];
+
+  for (guint j = 0; j < N_FEATURES; j++) {
+    offset[j] = G_MAXFLOAT;
+    max[j] = -G_MAXFLOAT;
+  }
+
+  while (n > 0) {
+    const gint32 *labels;
+    const WhsFeatureVector *vecs;
+    guint len = MIN (n, whs_feature_store_get_run (store, start, &labels, &vecs));
+
+    for (guint i = 0; i < len; i++) {
+      for (guint j = 0; j < N_FEATURES; j++) {
+        offset[j] = MIN (offset[j], vecs[i].mfcc[j]);
+        max[j] = MAX (max[j], vecs[i].mfcc[j]);
+      }
+    }
+
+    start += len;
+    n -= len;
+  }
+
+  for (guint j = 0; j < N_FEATURES; j++)
+    scale[j] = (max[j] > offset[j]) ? (max[j] - offset[j]) / 255.0f : 0.0f;
+}
+
+static gboolean
+whs_state_file_write_all (FILE *f, gconstpointer data, gsize size)
+{
+  if (size > 0 && fwrite (data, 1, size, f) < size) {
+    g_warning ("Write failed: %s", strerror (errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+whs_state_file_read_all (FILE *f, gpointer data, gsize size)
+{
+  size_t ret;
+
+  if (size > 0 && (ret = fread (data, 1, size, f)) < size) {
+    if (ferror (f))
+      g_warning ("Read failed: %s", strerror (errno));
+    else
+      g_warning ("Read only %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes", (gsize) ret, size);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+whs_state_file_pad (FILE *f, guint64 *pos)
+{
+  static const guint8 padding[64] = { 0, };
+  guint64 end = ALIGN (*pos);
+
+  if (!whs_state_file_write_all (f, padding, end - *pos))
+    return FALSE;
+
+  *pos = end;
+  return TRUE;
+}
+
+/* Writes the labels or the vectors of n rows from start on, which
+ * can lie in several runs of the store */
+static gboolean
+whs_state_file_write_rows (FILE *f, const WhsFeatureStore *store, guint start, guint n, gboolean labels)
+{
+  while (n > 0) {
+    const gint32 *run_labels;
+    const WhsFeatureVector *run_vecs;
+    guint len = MIN (n, whs_feature_store_get_run (store, start, &run_labels, &run_vecs));
+
+    if (labels ? !whs_state_file_write_all (f, run_labels, 4 * len) :
+        !whs_state_file_write_all (f, run_vecs, len * sizeof (WhsFeatureVector)))
+      return FALSE;
+
+    start += len;
+    n -= len;
+  }
+
+  return TRUE;
+}
+
+/* Writes the vectors of n rows from start on with encoding */
+static gboolean
+whs_state_file_write_vecs (FILE *f, const WhsFeatureStore *store, guint start, guint n, WhsStateEncoding encoding)
+{
+  gfloat offset[N_FEATURES], scale[N_FEATURES], inverse[N_FEATURES];
+  guint8 *data;
+  gboolean ret = TRUE;
+
+  if (encoding == WHS_STATE_ENCODING_PLAIN)
+    return whs_state_file_write_rows (f, store, start, n, FALSE);
+
+  if (encoding == WHS_STATE_ENCODING_Q8) {
+    whs_state_q8_range (store, start, n, offset, scale);
+    for (guint j = 0; j < N_FEATURES; j++)
+      inverse[j] = (scale[j] > 0.0f) ? 1.0f / scale[j] : 0.0f;
+
+    if (!whs_state_file_write_all (f, offset, sizeof (offset)) ||
+        !whs_state_file_write_all (f, scale, sizeof (scale)))
+      return FALSE;
+  }
+
+  data = g_malloc (ENCODE_ROWS * N_FEATURES * 2);
+
+  while (n > 0 && ret) {
+    const gint32 *labels;
+    const WhsFeatureVector *vecs;
+    guint len = MIN (MIN (n, ENCODE_ROWS), whs_feature_store_get_run (store, start, &labels, &vecs));
+    const gfloat *in = vecs->mfcc;
+
+    if (encoding == WHS_STATE_ENCODING_HALF) {
+      guint16 *out = (guint16 *) data;
+
+      for (gsize i = 0; i < len * N_FEATURES; i++)
+        out[i] = whs_half_from_float (in[i]);
+
+      ret = whs_state_file_write_all (f, data, len * N_FEATURES * 2);
+    } else {
+      for (guint i = 0; i < len; i++) {
+        for (guint j = 0; j < N_FEATURES; j++) {
+          gfloat code = (in[i * N_FEATURES + j] - offset[j]) * inverse[j] + 0.5f;
+
+          // Also catches NaN
+          if (!(code >= 0.0f))
+            code = 0.0f;
+          data[i * N_FEATURES + j] = (guint8) MIN (code, 255.0f);
+        }
+      }
+
+      ret = whs_state_file_write_all (f, data, len * N_FEATURES);
+    }
+
+    start += len;
+    n -= len;
+  }
+
+  g_free (data);
+
+  return ret;
+}
+
+/* Writes the rows from start on at pos, which is aligned. sequence is
+ * the first sequence that ends after start */
+static gboolean
+whs_state_file_write_blocks (FILE *f, guint64 *pos, const WhsFeatureStore *store, guint start, guint sequence,
+    WhsStateEncoding encoding, GArray *index)
+{
+  static const guint8 padding[64] = { 0, };
+
+  while (start < store->n) {
+    guint n_rows = MIN (BLOCK_ROWS, store->n - start);
+    guint first = sequence;
+    WhsStateBlockLayout layout;
+    WhsStateIndexEntry entry;
+
+    while (sequence < store->n_sequences && store->ends[sequence] <= start + n_rows)
+      sequence++;
+
+    whs_state_block_layout (&layout, n_rows, sequence - first, encoding);
+
+    guint8 *header = g_malloc0 (layout.labels_offset);
+
+    whs_put_uint64 (header, n_rows, FALSE);
+    whs_put_uint32 (header + 8, sequence - first, FALSE);
+    whs_put_uint32 (header + 12, encoding, FALSE);
+    whs_put_uint64 (header + 16, layout.size, FALSE);
+    for (guint s = first; s < sequence; s++)
+      whs_put_uint32 (header + BLOCK_HEADER_SIZE + 4 * (s - first), store->ends[s] - start, FALSE);
+
+    gboolean ok = whs_state_file_write_all (f, header, layout.labels_offset) &&
+        whs_state_file_write_rows (f, store, start, n_rows, TRUE) &&
+        whs_state_file_write_all (f, padding, layout.vecs_offset - layout.labels_offset - 4 * n_rows) &&
+        whs_state_file_write_vecs (f, store, start, n_rows, encoding);
+
+    g_free (header);
+    if (!ok)
+      return FALSE;
+
+    entry.offset = *pos;
+    entry.n_rows = n_rows;
+    g_array_append_val (index, entry);
+
+    *pos += layout.size;
+    if (!whs_state_file_pad (f, pos))
+      return FALSE;
+
+    start += n_rows;
+  }
+
+  return TRUE;
+}
+
+/* Writes the index at pos and points the header to it */
+static gboolean
+whs_state_file_write_index (FILE *f, guint64 pos, const WhsFeatureStore *store, GArray *index)
+{
+  gsize size = INDEX_HEADER_SIZE + index->len * INDEX_ENTRY_SIZE;
+  guint8 *data = g_malloc0 (size);
+  guint8 offset[8];
+
+  whs_put_uint64 (data, index->len, FALSE);
+  whs_put_uint64 (data + 8, store->n, FALSE);
+  whs_put_uint64 (data + 16, store->n_sequences, FALSE);
+  for (guint i = 0; i < index->len; i++) {
+    whs_put_uint64 (data + INDEX_HEADER_SIZE + i * INDEX_ENTRY_SIZE, g_array_index (index, WhsStateIndexEntry, i).offset, FALSE);
+    whs_put_uint64 (data + INDEX_HEADER_SIZE + i * INDEX_ENTRY_SIZE + 8, g_array_index (index, WhsStateIndexEntry, i).n_rows, FALSE);
+  }
+
+  gboolean ok = whs_state_file_write_all (f, data, size);
+  g_free (data);
+
+  // Everything else has to be written before the header is updated
+  if (!ok || fflush (f) != 0) {
+    g_warning ("Write failed: %s", strerror (errno));
+    return FALSE;
+  }
+
+  whs_put_uint64 (offset, pos, FALSE);
+  if (fseeko (f, 24, SEEK_SET) != 0) {
+    g_warning ("Seek failed: %s", strerror (errno));
+    return FALSE;
+  }
+
+  return whs_state_file_write_all (f, offset, 8);
+}
+
+/* Writes a version 2 file with all rows of store. An existing
+ * file is only replaced once the new one is complete */
+gboolean
+whs_state_file_write (const gchar *filename, guint min_freq, guint max_freq, guint sample_rate, const WhsFeatureStore *store,
+    WhsStateEncoding encoding)
+{
+  g_return_val_if_fail (filename != NULL && *filename != '\0', FALSE);
+  g_return_val_if_fail (store != NULL, FALSE);
+
+  gchar *tmp = g_strdup_printf ("%s.%d.tmp", filename, (gint) getpid ());
+  FILE *f = g_fopen (tmp, "wb");
+  GArray *index = g_array_new (FALSE, FALSE, sizeof (WhsStateIndexEntry));
+  guint8 header[HEADER_SIZE] = { 0, };
+  guint64 pos = HEADER_SIZE;
+  gboolean ret = FALSE;
+
+  if (!f) {
+    g_warning ("Can't open file");
+    goto done;
+  }
+
+  setvbuf (f, NULL, _IOFBF, STREAM_BUFFER);
+
+  memcpy (header, "WHSL", 4);
+  header[4] = VERSION;
+  header[5] = BYTE_ORDER_HOST;
+  whs_put_uint32 (header + 8, min_freq, FALSE);
+  whs_put_uint32 (header + 12, max_freq, FALSE);
+  whs_put_uint32 (header + 16, sample_rate, FALSE);
+  whs_put_uint32 (header + 20, N_FEATURES, FALSE);
+
+  if (!whs_state_file_write_all (f, header, HEADER_SIZE) ||
+      !whs_state_file_write_blocks (f, &pos, store, 0, 0, encoding, index) ||
+      !whs_state_file_write_index (f, pos, store, index))
+    goto done;
+
+  ret = (fclose (f) == 0);
+  f = NULL;
+
+  if (!ret) {
+    g_warning ("Write failed: %s", strerror (errno));
+  } else if (g_rename (tmp, filename) != 0) {
+    g_warning ("Can't replace %s: %s", filename, strerror (errno));
+    ret = FALSE;
+  }
+
+done:
+  if (f)
+    fclose (f);
+  if (!ret)
+    g_unlink (tmp);
+  g_free (tmp);
+  g_array_free (index, TRUE);
+
+  return ret;
+}
+
+/* Reads the header and index of a version 2 file in the byte order of the
+ * host. Returns FALSE if it isn't one, with a warning if it is corrupt */
+static gboolean
+whs_state_file_read_index (FILE *f, guint8 *header, GArray *index, guint64 *n_rows, guint64 *n_sequences)
+{
+  if (fseeko (f, 0, SEEK_END) != 0) {
+    g_warning ("Seek failed: %s", strerror (errno));
+    return FALSE;
+  }
+
+  guint64 length = ftello (f);
+  rewind (f);
+
+  if (length < HEADER_SIZE || !whs_state_file_read_all (f, header, HEADER_SIZE))
+    return FALSE;
+
+  if (strncmp ((const gchar *) header, "WHSL", 4) != 0 || header[4] != VERSION ||
+      (header[5] != BYTE_ORDER_LITTLE && header[5] != BYTE_ORDER_BIG))
+    return FALSE;
+
+  const gboolean swapped = (header[5] != BYTE_ORDER_HOST);
+  guint64 index_offset = whs_get_uint64 (header + 24, swapped);
+  guint8 data[INDEX_HEADER_SIZE];
+
+  if (whs_get_uint32 (header + 20, swapped) != N_FEATURES) {
+    g_warning ("Unsupported number of features %u", whs_get_uint32 (header + 20, swapped));
+    return FALSE;
+  }
+
+  if (index_offset % 64 != 0 || index_offset < HEADER_SIZE || index_offset > length - INDEX_HEADER_SIZE ||
+      fseeko (f, index_offset, SEEK_SET) != 0 || !whs_state_file_read_all (f, data, INDEX_HEADER_SIZE)) {
+    g_warning ("Invalid learner state index");
+    return FALSE;
+  }
+
+  guint64 n_blocks = whs_get_uint64 (data, swapped);
+
+  *n_rows = whs_get_uint64 (data + 8, swapped);
+  *n_sequences = whs_get_uint64 (data + 16, swapped);
+
+  // Every row takes at least its label and a byte per coefficient
+  if (n_blocks > (length - index_offset - INDEX_HEADER_SIZE) / INDEX_ENTRY_SIZE ||
+      *n_rows > length / (4 + N_FEATURES) || *n_rows > G_MAXUINT || *n_sequences > *n_rows) {
+    g_warning ("Invalid learner state index");
+    return FALSE;
+  }
+
+  guint8 *entries = g_malloc (n_blocks * INDEX_ENTRY_SIZE);
+  guint64 total = 0;
+
+  if (!whs_state_file_read_all (f, entries, n_blocks * INDEX_ENTRY_SIZE)) {
+    g_free (entries);
+    return FALSE;
+  }
+
+  g_array_set_size (index, n_blocks);
+  for (guint i = 0; i < n_blocks; i++) {
+    WhsStateIndexEntry *entry = &g_array_index (index, WhsStateIndexEntry, i);
+
+    entry->offset = whs_get_uint64 (entries + i * INDEX_ENTRY_SIZE, swapped);
+    entry->n_rows = whs_get_uint64 (entries + i * INDEX_ENTRY_SIZE + 8, swapped);
+
+    if (entry->offset % 64 != 0 || entry->offset < HEADER_SIZE || entry->offset > length - BLOCK_HEADER_SIZE ||
+        entry->n_rows > BLOCK_ROWS || entry->n_rows == 0) {
+      g_warning ("Invalid block %u in the learner state", i);
+      g_free (entries);
+      return FALSE;
+    }
+
+    total += entry->n_rows;
+  }
+
+  g_free (entries);
+
+  if (total != *n_rows) {
+    g_warning ("Invalid learner state index");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Appends the rows from n on and the sequences from n_sequences on to
+ * a version 2 file in the byte order of the host that contains exactly
+ * the first n rows and n_sequences sequences of store. Returns FALSE
+ * without changing the file otherwise. If there is nothing to append,
+ * the file isn't opened at all */
+gboolean
+whs_state_file_append (const gchar *filename, guint min_freq, guint max_freq, guint sample_rate, const WhsFeatureStore *store,
+    guint n, guint n_sequences, WhsStateEncoding encoding)
+{
+  g_return_val_if_fail (filename != NULL && *filename != '\0', FALSE);
+  g_return_val_if_fail (store != NULL, FALSE);
+  g_return_val_if_fail (n <= store->n && n_sequences <= store->n_sequences, FALSE);
+
+  if (n == store->n && n_sequences == store->n_sequences)
+    return TRUE;
+
+  FILE *f = g_fopen (filename, "r+b");
+
+  if (!f)
+    return FALSE;
+
+  setvbuf (f, NULL, _IOFBF, STREAM_BUFFER);
+
+  GArray *index = g_array_new (FALSE, FALSE, sizeof (WhsStateIndexEntry));
+  guint8 header[HEADER_SIZE];
+  guint64 file_rows, file_sequences;
+  gboolean ret = FALSE;
+
+  if (!whs_state_file_read_index (f, header, index, &file_rows, &file_sequences) ||
+      header[5] != BYTE_ORDER_HOST || file_rows != n || file_sequences != n_sequences ||
+      whs_get_uint32 (header + 8, FALSE) != min_freq || whs_get_uint32 (header + 12, FALSE) != max_freq ||
+      whs_get_uint32 (header + 16, FALSE) != sample_rate)
+    goto done;
+
+  // The old index stays valid until the header points to the new one
+  guint64 pos = whs_get_uint64 (header + 24, FALSE) + INDEX_HEADER_SIZE + index->len * INDEX_ENTRY_SIZE;
+
+  if (fseeko (f, pos, SEEK_SET) != 0) {
+    g_warning ("Seek failed: %s", strerror (errno));
+    goto done;
+  }
+
+  if (!whs_state_file_pad (f, &pos) ||
+      !whs_state_file_write_blocks (f, &pos, store, n, n_sequences, encoding, index) ||
+      !whs_state_file_write_index (f, pos, store, index))
+    goto done;
+
+  ret = TRUE;
+
+done:
+  if (fclose (f) != 0 && ret) {
+    g_warning ("Write failed: %s", strerror (errno));
+    ret = FALSE;
+  }
+  g_array_free (index, TRUE);
+
+  return ret;
+}
+
+static WhsFeatureStore *
+whs_state_file_read_v1 (FILE *f, guint *min_freq, guint *max_freq, guint *sample_rate)
+{
+  guint8 header[20];
+
+  rewind (f);
+  if (!whs_state_file_read_all (f, header, 20))
+    return NULL;
+
+  const gboolean swapped = (G_BYTE_ORDER != G_BIG_ENDIAN);
+
+  *min_freq = whs_get_uint32 (header + 4, swapped);
+  *max_freq = whs_get_uint32 (header + 8, swapped);
+  *sample_rate = whs_get_uint32 (header + 12, swapped);
+
+  guint32 size = whs_get_uint32 (header + 16, swapped);
+
+  if (size % ROW_SIZE_V1 != 0) {
+    g_warning ("Invalid size");
+    return NULL;
+  }
+
+  // Data, newest first with a G_MININT32 row before every sequence
+  guint nresults = size / ROW_SIZE_V1;
+  gint32 *data = g_try_malloc (size);
+
+  if (size > 0 && !data) {
+    g_warning ("Can't allocate %u bytes", size);
+    return NULL;
+  }
+
+  if (!whs_state_file_read_all (f, data, size)) {
+    g_free (data);
+    return NULL;
+  }
+
+  WhsFeatureStore *store = whs_feature_store_new ();
+
+  whs_feature_store_reserve (store, nresults);
+
+  for (guint i = nresults; i > 0; i--) {
+    const gint32 *row = data + (i - 1) * (1 + N_FEATURES);
+    gint32 result = GINT32_FROM_BE (row[0]);
+
+    if (result == G_MININT32) {
+      whs_feature_store_finish_sequence (store);
+      continue;
+    }
+
+    WhsFeatureVector *vec = whs_feature_store_append (store, result);
+
+    for (gint j = 0; j < N_FEATURES; j++) {
+      gfloat mfcc;
+
+      memcpy (&mfcc, &row[1 + j], 4);
+      vec->mfcc[j] = GFLOAT_FROM_BE (mfcc);
+    }
+  }
+
+  g_free (data);
+
+  return store;
+}
+
+/* Checks a block header against its index entry */
+static gboolean
+whs_state_file_check_block (const guint8 *header, const WhsStateIndexEntry *entry, gboolean swapped,
+    WhsStateBlockLayout *layout, guint32 *n_sequences, WhsStateEncoding *encoding)
+{
+  guint64 n_rows = whs_get_uint64 (header, swapped);
+
+  *n_sequences = whs_get_uint32 (header + 8, swapped);
+  *encoding = whs_get_uint32 (header + 12, swapped);
+
+  if (*encoding != WHS_STATE_ENCODING_PLAIN && *encoding != WHS_STATE_ENCODING_HALF &&
+      *encoding != WHS_STATE_ENCODING_Q8) {
+    g_warning ("Unsupported block encoding %u", *encoding);
+    return FALSE;
+  }
+
+  if (n_rows != entry->n_rows || *n_sequences > n_rows) {
+    g_warning ("Invalid block in the learner state");
+    return FALSE;
+  }
+
+  whs_state_block_layout (layout, n_rows, *n_sequences, *encoding);
+  if (whs_get_uint64 (header + 16, swapped) != layout->size) {
+    g_warning ("Invalid block in the learner state");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Ends the sequences of a block whose first row is first */
+static gboolean
+whs_state_file_end_sequences (WhsFeatureStore *store, guint first, guint n_rows,
+    const guint8 *ends, guint32 n_sequences, gboolean swapped)
+{
+  guint32 previous = 0;
+
+  for (guint s = 0; s < n_sequences; s++) {
+    guint32 end = whs_get_uint32 (ends + 4 * s, swapped);
+
+    if (end <= previous || end > n_rows) {
+      g_warning ("Invalid sequence in the learner state");
+      return FALSE;
+    }
+
+    whs_feature_store_end_sequence (store, first + end);
+    previous = end;
+  }
+
+  return TRUE;
+}
+
+/* Reads the encoded vectors of n rows and decodes them to vecs */
+static gboolean
+whs_state_file_read_vecs (FILE *f, WhsFeatureVector *vecs, guint n, gboolean swapped, WhsStateEncoding encoding)
+{
+  gfloat *out = vecs->mfcc;
+
+  if (encoding == WHS_STATE_ENCODING_PLAIN) {
+    if (!whs_state_file_read_all (f, vecs, n * sizeof (WhsFeatureVector)))
+      return FALSE;
+
+    if (swapped) {
+      guint32 *words = (guint32 *) out;
+
+      for (gsize i = 0; i < n * N_FEATURES; i++)
+        words[i] = GUINT32_SWAP_LE_BE (words[i]);
+    }
+
+    return TRUE;
+  }
+
+  gsize size = (encoding == WHS_STATE_ENCODING_HALF) ? n * N_FEATURES * 2 : 2 * N_FEATURES * 4 + n * N_FEATURES;
+  guint8 *data = g_malloc (size);
+
+  if (!whs_state_file_read_all (f, data, size)) {
+    g_free (data);
+    return FALSE;
+  }
+
+  if (encoding == WHS_STATE_ENCODING_HALF) {
+    for (gsize i = 0; i < n * N_FEATURES; i++)
+      out[i] = whs_half_to_float (whs_get_uint16 (data + 2 * i, swapped));
+  } else {
+    gfloat offset[N_FEATURES], scale[N_FEATURES];
+    const guint8 *codes = data + 2 * N_FEATURES * 4;
+
+    for (guint j = 0; j < N_FEATURES; j++) {
+      guint32 o = whs_get_uint32 (data + 4 * j, swapped);
+      guint32 s = whs_get_uint32 (data + 4 * (N_FEATURES + j), swapped);
+
+      memcpy (&offset[j], &o, 4);
+      memcpy (&scale[j], &s, 4);
+    }
+
+    for (guint i = 0; i < n; i++)
+      for (guint j = 0; j < N_FEATURES; j++)
+        out[i * N_FEATURES + j] = offset[j] + scale[j] * codes[i * N_FEATURES + j];
+  }
+
+  g_free (data);
+
+  return TRUE;
+}
+
+static gboolean
+whs_state_file_read_block (FILE *f, const WhsStateIndexEntry *entry, gboolean swapped, WhsFeatureStore *store)
+{
+  guint8 header[BLOCK_HEADER_SIZE];
+  WhsStateBlockLayout layout;
+  guint32 n_sequences;
+  WhsStateEncoding encoding;
+
+  if (fseeko (f, entry->offset, SEEK_SET) != 0 || !whs_state_file_read_all (f, header, BLOCK_HEADER_SIZE) ||
+      !whs_state_file_check_block (header, entry, swapped, &layout, &n_sequences, &encoding))
+    return FALSE;
+
+  guint n_rows = entry->n_rows;
+  guint8 *ends = g_malloc (4 * n_sequences);
+  guint first = whs_feature_store_extend (store, n_rows);
+
+  // The store is only in memory, so first is also the offset in its arrays
+  if (!whs_state_file_read_all (f, ends, 4 * n_sequences) ||
+      fseeko (f, entry->offset + layout.labels_offset, SEEK_SET) != 0 ||
+      !whs_state_file_read_all (f, store->labels + first, 4 * n_rows) ||
+      fseeko (f, entry->offset + layout.vecs_offset, SEEK_SET) != 0 ||
+      !whs_state_file_read_vecs (f, store->vecs + first, n_rows, swapped, encoding)) {
+    g_free (ends);
+    return FALSE;
+  }
+
+  if (swapped) {
+    guint32 *words = (guint32 *) (store->labels + first);
+
+    for (guint i = 0; i < n_rows; i++)
+      words[i] = GUINT32_SWAP_LE_BE (words[i]);
+  }
+
+  gboolean ret = whs_state_file_end_sequences (store, first, n_rows, ends, n_sequences, swapped);
+
+  g_free (ends);
+
+  return ret;
+}
+
+/* Adds the rows of a block of a mapped file as a segment. Encoded
+ * blocks can't be used in place, encoded is set for them */
+static gboolean
+whs_state_file_map_block (const guint8 *contents, gsize length, const WhsStateIndexEntry *entry, WhsFeatureStore *store,
+    gboolean *encoded)
+{
+  WhsStateBlockLayout layout;
+  guint32 n_sequences;
+  WhsStateEncoding encoding;
+
+  if (length < BLOCK_HEADER_SIZE || entry->offset > length - BLOCK_HEADER_SIZE) {
+    g_warning ("Invalid block in the learner state");
+    return FALSE;
+  }
+
+  const guint8 *block = contents + entry->offset;
+
+  if (!whs_state_file_check_block (block, entry, FALSE, &layout, &n_sequences, &encoding))
+    return FALSE;
+
+  if (encoding != WHS_STATE_ENCODING_PLAIN) {
+    *encoded = TRUE;
+    return FALSE;
+  }
+
+  if (layout.size > length - entry->offset) {
+    g_warning ("Invalid block in the learner state");
+    return FALSE;
+  }
+
+  guint first = store->n;
+
+  whs_feature_store_add_segment (store, (const gint32 *) (block + layout.labels_offset),
+      (const WhsFeatureVector *) (block + layout.vecs_offset), entry->n_rows);
+
+  return whs_state_file_end_sequences (store, first, entry->n_rows, block + BLOCK_HEADER_SIZE, n_sequences, FALSE);
+}
+
+/* Reads a state file of either version */
+WhsFeatureStore *
+whs_state_file_read (const gchar *filename, guint *min_freq, guint *max_freq, guint *sample_rate)
+{
+  g_return_val_if_fail (filename != NULL && *filename != '\0', NULL);
+  g_return_val_if_fail (min_freq != NULL && max_freq != NULL && sample_rate != NULL, NULL);
+
+  FILE *f = g_fopen (filename, "rb");
+
+  if (!f) {
+    g_warning ("Can't open file");
+    return NULL;
+  }
+
+  setvbuf (f, NULL, _IOFBF, STREAM_BUFFER);
+
+  guint8 header[HEADER_SIZE];
+
+  if (!whs_state_file_read_all (f, header, 8) || strncmp ((const gchar *) header, "WHSL", 4) != 0) {
+    g_warning ("Not a valid learner state file");
+    fclose (f);
+    return NULL;
+  }
+
+  if (header[4] == 0) {
+    WhsFeatureStore *store = whs_state_file_read_v1 (f, min_freq, max_freq, sample_rate);
+
+    fclose (f);
+    return store;
+  } else if (header[4] != VERSION) {
+    g_warning ("Unsupported learner state version %u", header[4]);
+    fclose (f);
+    return NULL;
+  }
+
+  GArray *index = g_array_new (FALSE, FALSE, sizeof (WhsStateIndexEntry));
+  guint64 n_rows, n_sequences;
+  WhsFeatureStore *store = NULL;
+
+  if (!whs_state_file_read_index (f, header, index, &n_rows, &n_sequences)) {
+    g_warning ("Not a valid learner state file");
+    goto done;
+  }
+
+  const gboolean swapped = (header[5] != BYTE_ORDER_HOST);
+
+  *min_freq = whs_get_uint32 (header + 8, swapped);
+  *max_freq = whs_get_uint32 (header + 12, swapped);
+  *sample_rate = whs_get_uint32 (header + 16, swapped);
+
+  store = whs_feature_store_new ();
+  whs_feature_store_reserve (store, n_rows);
+
+  for (guint i = 0; i < index->len; i++) {
+    if (!whs_state_file_read_block (f, &g_array_index (index, WhsStateIndexEntry, i), swapped, store)) {
+      whs_feature_store_free (store);
+      store = NULL;
+      goto done;
+    }
+  }
+
+  if (store->n_sequences != n_sequences) {
+    g_warning ("Invalid learner state index");
+    whs_feature_store_free (store);
+    store = NULL;
+  }
+
+done:
+  fclose (f);
+  g_array_free (index, TRUE);
+
+  return store;
+}
+
+/* Maps a version 2 file in the byte order of the host and uses its rows
+ * in place, other files and files with encoded blocks are read like with
+ * whs_state_file_read (). The
+ * file must not be modified in place while the store exists, appending
+ * to it with whs_state_file_append () or replacing it is fine */
+WhsFeatureStore *
+whs_state_file_map (const gchar *filename, guint *min_freq, guint *max_freq, guint *sample_rate)
+{
+  g_return_val_if_fail (filename != NULL && *filename != '\0', NULL);
+  g_return_val_if_fail (min_freq != NULL && max_freq != NULL && sample_rate != NULL, NULL);
+
+  GError *error = NULL;
+  GMappedFile *file = g_mapped_file_new (filename, FALSE, &error);
+
+  if (!file) {
+    g_warning ("Can't map file: %s", error->message);
+    g_error_free (error);
+    return NULL;
+  }
+
+  const guint8 *contents = (const guint8 *) g_mapped_file_get_contents (file);
+  gsize length = g_mapped_file_get_length (file);
+
+  if (length < HEADER_SIZE || strncmp ((const gchar *) contents, "WHSL", 4) != 0 ||
+      contents[4] != VERSION || contents[5] != BYTE_ORDER_HOST) {
+    g_mapped_file_free (file);
+    return whs_state_file_read (filename, min_freq, max_freq, sample_rate);
+  }
+
+  // The index is small, the blocks are checked against the mapping
+  FILE *f = g_fopen (filename, "rb");
+  GArray *index = g_array_new (FALSE, FALSE, sizeof (WhsStateIndexEntry));
+  guint8 header[HEADER_SIZE];
+  guint64 n_rows, n_sequences;
+  WhsFeatureStore *store = NULL;
+  gboolean encoded = FALSE;
+
+  if (!f) {
+    g_warning ("Can't open file");
+    g_mapped_file_free (file);
+    goto done;
+  }
+
+  if (!whs_state_file_read_index (f, header, index, &n_rows, &n_sequences) || header[5] != BYTE_ORDER_HOST) {
+    g_warning ("Not a valid learner state file");
+    g_mapped_file_free (file);
+    goto done;
+  }
+
+#ifdef HAVE_POSIX_MADVISE
+  // Training reads the rows in file order, once per epoch
+  posix_madvise ((gpointer) contents, length, POSIX_MADV_SEQUENTIAL);
+#endif
+
+  *min_freq = whs_get_uint32 (header + 8, FALSE);
+  *max_freq = whs_get_uint32 (header + 12, FALSE);
+  *sample_rate = whs_get_uint32 (header + 16, FALSE);
+
+  store = whs_feature_store_new_mapped (file);
+
+  for (guint i = 0; i < index->len; i++) {
+    if (!whs_state_file_map_block (contents, length, &g_array_index (index, WhsStateIndexEntry, i), store, &encoded)) {
+      whs_feature_store_free (store);
+      store = NULL;
+      goto done;
+    }
+  }
+
+  if (store->n_sequences != n_sequences) {
+    g_warning ("Invalid learner state index");
+    whs_feature_store_free (store);
+    store = NULL;
+  }
+
+done:
+  if (f)
+    fclose (f);
+  g_array_free (index, TRUE);
+
+  if (encoded)
+    return whs_state_file_read (filename, min_freq, max_freq, sample_rate);
+
+  return store;
+}
@@ -0,0 +1,36 @@
+/* This file is part of whistler
+ *
+ * Copyright (C) 2007-2008 Sebastian Dröge <slomo@upb.de>
+ * 
+ * Whistler is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Whistler is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Whistler. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WHS_STATE_FILE_H__
+#define __WHS_STATE_FILE_H__
+
+#include <glib.h>
+#include "whsfeaturestore.h"
+#include "whslearner.h"
+
+G_BEGIN_DECLS
+
+G_GNUC_INTERNAL WhsFeatureStore * whs_state_file_read (const gchar *filename, guint *min_freq, guint *max_freq, guint *sample_rate) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+G_GNUC_INTERNAL WhsFeatureStore * whs_state_file_map (const gchar *filename, guint *min_freq, guint *max_freq, guint *sample_rate) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+
+G_GNUC_INTERNAL gboolean whs_state_file_write (const gchar *filename, guint min_freq, guint max_freq, guint sample_rate, const WhsFeatureStore *store, WhsStateEncoding encoding);
+G_GNUC_INTERNAL gboolean whs_state_file_append (const gchar *filename, guint min_freq, guint max_freq, guint sample_rate, const WhsFeatureStore *store, guint n, guint n_sequences, WhsStateEncoding encoding);
+
+G_END_DECLS
+
+#endif /* __WHS_STATE_FILE_H__ */
@@ -20,6 +20,7 @@
 #define __WHS_UTILS_H__
 
 #include <glib.h>
+#include <string.h>
 
 G_BEGIN_DECLS
 
@@ -72,6 +73,59 @@ GDOUBLE_SWAP_LE_BE(gdouble in)
 #define GDOUBLE_FROM_LE(val) (GDOUBLE_TO_LE (val))
 #define GDOUBLE_FROM_BE(val) (GDOUBLE_TO_BE (val))
 
+/* Values in files aren't aligned, they are swapped if the file
+ * was written on a host with the other byte order */
+inline static guint16
+whs_get_uint16 (const guint8 *p, gboolean swapped)
+{
+  guint16 v;
+
+  memcpy (&v, p, 2);
+  return (swapped) ? GUINT16_SWAP_LE_BE (v) : v;
+}
+
+inline static guint32
+whs_get_uint32 (const guint8 *p, gboolean swapped)
+{
+  guint32 v;
+
+  memcpy (&v, p, 4);
+  return (swapped) ? GUINT32_SWAP_LE_BE (v) : v;
+}
+
+inline static guint64
+whs_get_uint64 (const guint8 *p, gboolean swapped)
+{
+  guint64 v;
+
+  memcpy (&v, p, 8);
+  return (swapped) ? GUINT64_SWAP_LE_BE (v) : v;
+}
+
+inline static void
+whs_put_uint16 (guint8 *p, guint16 v, gboolean swapped)
+{
+  if (swapped)
+    v = GUINT16_SWAP_LE_BE (v);
+  memcpy (p, &v, 2);
+}
+
+inline static void
+whs_put_uint32 (guint8 *p, guint32 v, gboolean swapped)
+{
+  if (swapped)
+    v = GUINT32_SWAP_LE_BE (v);
+  memcpy (p, &v, 4);
+}
+
+inline static void
+whs_put_uint64 (guint8 *p, guint64 v, gboolean swapped)
+{
+  if (swapped)
+    v = GUINT64_SWAP_LE_BE (v);
+  memcpy (p, &v, 8);
+}
+
 G_END_DECLS
 
 #endif /* __WHS_UTILS_H__ */